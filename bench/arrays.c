@@ -0,0 +1,95 @@
+/*
+** arrays.c -- cost of moving arrays between C and tables
+** usage: arrays [elements]
+** Copies an array of `elements' (default 1000000) numbers into a table and
+** back, one element at a time with inlua_rawseti/inlua_rawgeti and in bulk
+** with inlua_setnumbers/inlua_getnumbers, and the same for strings. Prints
+** the milliseconds each takes as JSON, after checking that both agree.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "inlua.h"
+#include "inlauxlib.h"
+#include "inlualib.h"
+
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+static void check (int ok, const char *what) {
+  if (!ok) {
+    fprintf(stderr, "arrays: %s\n", what);
+    exit(EXIT_FAILURE);
+  }
+}
+
+
+int main (int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+  inlua_Number *a = malloc(n * sizeof(inlua_Number));
+  inlua_Number *b = malloc(n * sizeof(inlua_Number));
+  const char **s = malloc(n * sizeof(char *));
+  const char **s2 = malloc(n * sizeof(char *));
+  char *names = malloc(n * 12);
+  double t[8];
+  int i;
+  inlua_State *L = inluaL_newstate();
+  check(n > 0 && a && b && s && s2 && names, "not enough memory");
+  for (i = 0; i < n; i++) {
+    a[i] = i * 0.5;
+    s[i] = names + i * 12;
+    sprintf(names + i * 12, "k%d", i);
+  }
+  /* numbers, one at a time */
+  t[0] = now();
+  inlua_createtable(L, n, 0);
+  for (i = 0; i < n; i++) {
+    inlua_pushnumber(L, a[i]);
+    inlua_rawseti(L, -2, i + 1);
+  }
+  t[1] = now();
+  for (i = 0; i < n; i++) {
+    inlua_rawgeti(L, -1, i + 1);
+    b[i] = inlua_tonumber(L, -1);
+    inlua_pop(L, 1);
+  }
+  t[2] = now();
+  inlua_pop(L, 1);
+  /* numbers, in bulk */
+  inlua_newtable(L);
+  inlua_setnumbers(L, -1, a, n);
+  t[3] = now();
+  check(inlua_getnumbers(L, -1, b, n) == n, "inlua_getnumbers stopped");
+  t[4] = now();
+  check(memcmp(a, b, n * sizeof(inlua_Number)) == 0, "numbers differ");
+  check(inlua_objlen(L, -1) == (size_t)n, "wrong length");
+  inlua_pop(L, 1);
+  /* strings, one at a time and in bulk */
+  t[5] = now();
+  inlua_createtable(L, n, 0);
+  for (i = 0; i < n; i++) {
+    inlua_pushstring(L, s[i]);
+    inlua_rawseti(L, -2, i + 1);
+  }
+  t[6] = now();
+  inlua_newtable(L);
+  inlua_setstrings(L, -1, s, n);
+  t[7] = now();
+  check(inlua_getstrings(L, -1, s2, n) == n, "inlua_getstrings stopped");
+  for (i = 0; i < n; i++)
+    check(strcmp(s[i], s2[i]) == 0, "strings differ");
+  printf("[\n  {\"elements\": %d, \"set_numbers_ms\": [%.3f, %.3f], "
+         "\"get_numbers_ms\": [%.3f, %.3f],\n   \"set_strings_ms\": "
+         "[%.3f, %.3f]}\n]\n", n, t[1] - t[0], t[3] - t[2], t[2] - t[1],
+         t[4] - t[3], t[6] - t[5], t[7] - t[6]);
+  inlua_close(L);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+-- block expressions: values, multiple results and early returns from blocks
+
+local function clamp(x, lo, hi)
+    return (x < lo and lo or (x > hi and hi or x))
+end
+
+local function minmax(a, b)
+    if a < b then return a, b else return b, a end
+end
+
+local sum = 0
+for i=1,2000000 do
+    local y = i % 97
+    local x = y * y - 50
+    local lo, hi = minmax(x, i % 13)
+    sum = sum + clamp(x, lo, hi) + (i % 2 == 0 and (hi - lo) or 1)
+end
+print(sum)
@@ -0,0 +1,34 @@
+-- closures made in loops, capturing variables of each iteration
+
+local function map(t, f)
+    local r = {}
+    for i=1,#t do r[i] = f(t[i]) end
+    return r
+end
+
+local data = {}
+for i=1,100 do data[i] = i end
+
+-- a callback per iteration, called at once
+local total = 0
+for round=1,20000 do
+    local scale = round % 7 + 1
+    local offset = round % 3
+    local r = map(data, function(x) return x * scale + offset end)
+    total = total + r[100]
+end
+print(total)
+
+-- closures kept: handlers for each item, called later
+local handlers = {}
+for round=1,20 do
+    for i=1,20000 do
+        local name = i % 100
+        local weight = i * round % 13
+        handlers[i] = function(v) return v * weight + name end
+    end
+    local sum = 0
+    for i=1,20000 do sum = sum + handlers[i](round) end
+    total = (total + sum) % 1000003
+end
+print(total)
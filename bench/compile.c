@@ -0,0 +1,177 @@
+/*
+** compile.c -- time to compile many source files at start-up
+** usage: compile [files] [threads]
+** Writes `files' (default 400) generated modules of a few hundred lines,
+** as an application loads them, and loads them all one after another with
+** inluaL_loadfile and at once with inluaL_loadfiles on `threads' threads
+** (default 0: one per processor). Also times dumping and undumping them,
+** the part of inluaL_loadfiles that stays on the calling thread. Prints
+** the best of several times of each as JSON, after checking that both
+** ways give modules that return the same.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "inlua.h"
+#include "inlauxlib.h"
+#include "inlualib.h"
+
+
+#define RUNS		5
+#define FUNCS		24	/* per module */
+
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+static void fail (inlua_State *L) {
+  fprintf(stderr, "compile: %s\n", inlua_tostring(L, -1));
+  exit(EXIT_FAILURE);
+}
+
+
+static void module (const char *name, int m) {
+  FILE *f = fopen(name, "w");
+  int i;
+  if (f == NULL) {
+    fprintf(stderr, "compile: cannot write %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "-- generated module %d\n@M = {.name='mod%d'}\n", m, m);
+  for (i = 0; i < FUNCS; i++)
+    fprintf(f, "M.f%d = [t, n](\n"
+               "  @s, c = 0, {.count=0, .last=~}\n"
+               "  ?? i=1,n -> (\n"
+               "    @v = t.(i)\n"
+               "    ? v != ~ & v > %d -> (s = s + v * %d; v = v - 1)\n"
+               "    c.count = c.count + 1; c.last = (v == ~) & 'none' | v\n"
+               "  )\n"
+               "  @msg = 'module %d function %d: ' .. s .. ' ' .. c.count\n"
+               "  ^^ s + #msg, c\n"
+               ")\n", i, i, m + i, m, i);
+  fprintf(f, "@sum = 0\n?? i=0,%d -> (sum = sum + M.('f' .. i)({%d, 2, 3}, 3))\n"
+             "^^ sum\n", FUNCS - 1, m);
+  fclose(f);
+}
+
+
+static void names (char **file, int n) {
+  int i;
+  for (i = 0; i < n; i++) {
+    file[i] = malloc(32);
+    if (file[i] == NULL) exit(EXIT_FAILURE);
+    sprintf(file[i], "compile%d.tmp", i);
+    module(file[i], i);
+  }
+}
+
+
+static int writer (inlua_State *L, const void *p, size_t sz, void *ud) {
+  (void)L;
+  inluaL_addlstring((inluaL_Buffer *)ud, (const char *)p, sz);
+  return 0;
+}
+
+
+/* what each timed run does */
+enum { LOADFILE, LOADFILES, UNDUMP };
+
+static double best (inlua_State *L, char **file, int n, int threads,
+                    int what) {
+  double t = 1e30;
+  int r, i;
+  for (r = 0; r < RUNS; r++) {
+    double start;
+    int top = inlua_gettop(L);
+    if (what == UNDUMP) {  /* dump them all first */
+      for (i = 0; i < n; i++) {
+        inluaL_Buffer b;
+        if (inluaL_loadfile(L, file[i]) != 0) fail(L);
+        inluaL_buffinit(L, &b);
+        inlua_dump(L, writer, &b);
+        inluaL_pushresult(&b);
+        inlua_replace(L, -2);
+      }
+    }
+    start = now();
+    switch (what) {
+      case LOADFILE:
+        for (i = 0; i < n; i++)
+          if (inluaL_loadfile(L, file[i]) != 0) fail(L);
+        break;
+      case LOADFILES:
+        if (inluaL_loadfiles(L, (const char *const *)file, n, threads) != 0)
+          fail(L);
+        break;
+      case UNDUMP:
+        for (i = 0; i < n; i++) {
+          size_t len;
+          const char *s = inlua_tolstring(L, top + 1 + i, &len);
+          if (inluaL_loadbuffer(L, s, len, file[i]) != 0) fail(L);
+        }
+        break;
+    }
+    start = now() - start;
+    if (start < t) t = start;
+    inlua_settop(L, top);
+    inlua_gc(L, INLUA_GCCOLLECT, 0);
+  }
+  return t;
+}
+
+
+static inlua_Number sum (inlua_State *L, int n) {
+  inlua_Number s = 0;
+  int base = inlua_gettop(L) - n, i;
+  for (i = 1; i <= n; i++) {
+    inlua_pushvalue(L, base + i);
+    if (inlua_pcall(L, 0, 1, 0) != 0) fail(L);
+    s += inlua_tonumber(L, -1);
+    inlua_pop(L, 1);
+  }
+  inlua_settop(L, base);
+  return s;
+}
+
+
+int main (int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 400;
+  int threads = (argc > 2) ? atoi(argv[2]) : 0;
+  char **file = malloc(n * sizeof(char *));
+  double t[3];
+  inlua_Number s;
+  int i;
+  inlua_State *L = inluaL_newstate();
+  if (n <= 0 || file == NULL) return EXIT_FAILURE;
+  inluaL_openlibs(L);
+  names(file, n);
+  for (i = 0; i < n; i++)
+    if (inluaL_loadfile(L, file[i]) != 0) fail(L);
+  s = sum(L, n);
+  if (inluaL_loadfiles(L, (const char *const *)file, n, threads) != 0)
+    fail(L);
+  if (sum(L, n) != s) {
+    fprintf(stderr, "compile: inluaL_loadfiles gave different modules\n");
+    return EXIT_FAILURE;
+  }
+  t[LOADFILE] = best(L, file, n, threads, LOADFILE);
+  t[LOADFILES] = best(L, file, n, threads, LOADFILES);
+  t[UNDUMP] = best(L, file, n, threads, UNDUMP);
+  for (i = 0; i < n; i++) {
+    remove(file[i]);
+    free(file[i]);
+  }
+  free(file);
+  printf("[\n  {\"files\": %d, \"threads\": %d, \"loadfile_ms\": %.2f, "
+         "\"loadfiles_ms\": %.2f, \"undump_ms\": %.2f,\n   "
+         "\"speedup\": %.2f}\n]\n", n, threads, t[LOADFILE], t[LOADFILES],
+         t[UNDUMP], t[LOADFILE] / t[LOADFILES]);
+  inlua_close(L);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,55 @@
+-- locals that hold constants: opcodes of a stack machine, fixed-point math
+
+local PUSH = 1
+local ADD = 2
+local SUB = 3
+local MUL = 4
+local DUP = 5
+local SWAP = 6
+local POP = 7
+local JNZ = 8
+local HALT = 9
+local M = 1000003
+
+-- acc = 1; count = n; repeat acc = acc * 3 + count; count = count - 1 until count == 0
+local prog = {PUSH, 1, PUSH, 300000,
+              SWAP, PUSH, 3, MUL, SWAP, DUP, PUSH, 0, SWAP, SUB, PUSH, 0, SWAP, SUB,
+              SWAP, SWAP, DUP, PUSH, 1, SUB, SWAP, POP, SWAP, ADD, SWAP, PUSH, 1, SUB,
+              DUP, JNZ, 5, POP, HALT}
+local stack, sp, pc, steps = {}, 0, 1, 0
+while pc > 0 do
+    local op = prog[pc]
+    steps = steps + 1
+    if op == PUSH then sp = sp + 1; stack[sp] = prog[pc + 1]; pc = pc + 2
+    elseif op == ADD then stack[sp - 1] = (stack[sp - 1] + stack[sp]) % M; sp = sp - 1; pc = pc + 1
+    elseif op == SUB then stack[sp - 1] = stack[sp - 1] - stack[sp]; sp = sp - 1; pc = pc + 1
+    elseif op == MUL then stack[sp - 1] = stack[sp - 1] * stack[sp] % M; sp = sp - 1; pc = pc + 1
+    elseif op == DUP then sp = sp + 1; stack[sp] = stack[sp - 1]; pc = pc + 1
+    elseif op == SWAP then local t = stack[sp]; stack[sp] = stack[sp - 1]; stack[sp - 1] = t; pc = pc + 1
+    elseif op == POP then sp = sp - 1; pc = pc + 1
+    elseif op == JNZ then local c = stack[sp]; sp = sp - 1; if c ~= 0 then pc = prog[pc + 1] else pc = pc + 2 end
+    elseif op == HALT then pc = 0
+    end
+end
+print(stack[1], steps)
+
+local SHIFT = 8
+local ONE = 2 ^ SHIFT
+local HALF = ONE / 2
+local W = 320
+local H = 200
+local SIZE = W * H
+local function blend(a, b, alpha) return (a * alpha + b * (ONE - alpha) + HALF) / ONE end
+local img = {}
+for i=1,SIZE do img[i] = i % ONE end
+local sum = 0
+for frame=1,12 do
+    for y=0,H - 1 do
+        local row = y * W
+        for x=1,W do
+            local p = img[row + x]
+            sum = (sum + blend(p, ONE - 1 - p, frame * 16 % ONE) - p * HALF / ONE) % M
+        end
+    end
+end
+print(sum)
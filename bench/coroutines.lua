@@ -0,0 +1,24 @@
+-- coroutine ping-pong between a producer and a consumer
+
+local producer = coroutine.create(function(n)
+    for i=1,n do coroutine.yield(i) end
+    return nil
+end)
+
+local consumer = coroutine.wrap(function()
+    local sum = 0
+    while 1 do
+        local v = coroutine.yield()
+        if v == nil then break end
+        sum = sum + v
+    end
+    return sum
+end)
+consumer()
+
+local ok, v = coroutine.resume(producer, 500000)
+while v do
+    consumer(v)
+    ok, v = coroutine.resume(producer)
+end
+print(consumer(nil))
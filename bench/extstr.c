@@ -0,0 +1,136 @@
+/*
+** extstr.c -- cost of passing large host buffers to a script
+** usage: extstr [megabytes]
+** Calls a script function with payloads of several sizes, pushed either
+** with inlua_pushlstring (a copy) or with inlua_pushexternalstring (no
+** copy), and prints the time per call of each as JSON. Each size gets
+** enough calls to pass `megabytes' (default 256) of payload. Before that, it
+** checks that the string library gives the same results for both.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "inlua.h"
+#include "inlauxlib.h"
+#include "inlualib.h"
+
+
+static const size_t sizes[] = {1024, 64*1024, 1024*1024, 16*1024*1024};
+
+static int released = 0;
+
+
+static void release (void *ud, const char *s, size_t sz) {
+  (void)ud; (void)s; (void)sz;
+  released++;
+}
+
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static void fail (inlua_State *L) {
+  fprintf(stderr, "extstr: %s\n", inlua_tostring(L, -1));
+  exit(EXIT_FAILURE);
+}
+
+
+static const char check[] =
+  "@s, t = ..., {};"
+  "t.(s) = 1;"
+  "^^ table.concat({s.upper(s), s.sub(s, 3, 7), #s, s.find(s, 'wor'),"
+  "  s.gsub(s, 'o', '0'), s.format('%q', s), s .. '!', s.rep(s, 2),"
+  "  tostring(s == 'hello' .. ' world'), t.('hello' .. ' world')}, ',')";
+
+/* runs `check' on an external string, then on a copy of it */
+static int checkstrlib (inlua_State *L) {
+  static const char hello[] = "hello world";
+  char copy[sizeof(hello)];
+  const char *ext;
+  if (inluaL_loadstring(L, check)) fail(L);
+  inlua_pushvalue(L, -1);
+  inlua_pushexternalstring(L, hello, strlen(hello), release, NULL);
+  if (inlua_pcall(L, 1, 1, 0)) fail(L);
+  ext = inlua_tostring(L, -1);
+  inlua_insert(L, -2);
+  memcpy(copy, hello, sizeof(hello));  /* interned: same string as above */
+  inlua_pushstring(L, copy);
+  if (inlua_pcall(L, 1, 1, 0)) fail(L);
+  return strcmp(inlua_tostring(L, -1), ext) == 0;
+}
+
+
+/* a new payload, as the host would have for each request */
+static char *payload (size_t size, int n) {
+  char *buff = malloc(size + 1);  /* external strings end with a '\0' */
+  if (buff == NULL) exit(EXIT_FAILURE);
+  memset(buff, 'x', size);
+  memcpy(buff, &n, sizeof(n));
+  buff[size] = '\0';
+  return buff;
+}
+
+
+static void freepayload (void *ud, const char *s, size_t sz) {
+  (void)ud; (void)sz;
+  free((void *)s);
+}
+
+
+/* time per call of pushing the payload and calling the function at 1 */
+static double bench (inlua_State *L, size_t size, int calls, int external) {
+  int i;
+  double t = 0;
+  for (i = 0; i < calls; i++) {
+    char *buff = payload(size, i);
+    double start = now();
+    inlua_pushvalue(L, 1);
+    if (external)
+      inlua_pushexternalstring(L, buff, size, freepayload, NULL);
+    else
+      inlua_pushlstring(L, buff, size);
+    if (inlua_pcall(L, 1, 0, 0)) fail(L);
+    if (!external) free(buff);  /* else the collector frees it */
+    t += now() - start;
+  }
+  return t / calls;
+}
+
+
+int main (int argc, char *argv[]) {
+  double budget = (argc > 1) ? atof(argv[1]) : 256;  /* megabytes */
+  size_t i;
+  inlua_State *L = inluaL_newstate();
+  inluaL_openlibs(L);
+  if (!checkstrlib(L)) {
+    fprintf(stderr, "extstr: string library results differ\n");
+    return EXIT_FAILURE;
+  }
+  inlua_settop(L, 0);
+  if (inluaL_loadstring(L, "@s = ...; ^^ #s")) fail(L);
+  printf("[\n");
+  for (i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    int calls = (int)(budget * 1024 * 1024 / sizes[i]);
+    double copy, ext;
+    if (calls < 10) calls = 10;
+    copy = bench(L, sizes[i], calls, 0);
+    ext = bench(L, sizes[i], calls, 1);
+    printf("%s  {\"size\": %lu, \"calls\": %d, \"pushlstring_ns\": %.0f, "
+           "\"pushexternalstring_ns\": %.0f}", i ? ",\n" : "",
+           (unsigned long)sizes[i], calls, copy, ext);
+  }
+  printf("\n]\n");
+  inlua_close(L);
+  if (released != 1) {  /* only the string of checkstrlib */
+    fprintf(stderr, "extstr: released %d times\n", released);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
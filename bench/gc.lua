@@ -0,0 +1,21 @@
+-- garbage collector: a large live tree plus lots of short-lived garbage
+
+local tree
+tree = function(depth)
+    return depth == 0 and {} or {tree(depth - 1), tree(depth - 1)}
+end
+
+local check
+check = function(t)
+    return t[1] and 1 + check(t[1]) + check(t[2]) or 1
+end
+
+local live = tree(16)
+local total = 0
+for i=1,60 do
+    local tmp = tree(12)
+    total = total + check(tmp)
+    local s = {}
+    for j=1,2000 do s[j] = tostring(j) .. "x" end
+end
+print(total + check(live), collectgarbage("count") > 0)
@@ -0,0 +1,87 @@
+/*
+** gcpause.c -- length of single collector steps on a large heap
+** usage: gcpause [megabytes]
+** Builds a heap of large tables (default about 320 megabytes), then runs
+** whole collection cycles one step at a time, in the default mode and in
+** pause-target mode (collectgarbage("setpausetarget")), and prints the
+** longest, 99th percentile and mean step times of each as JSON.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "inlua.h"
+#include "inlauxlib.h"
+#include "inlualib.h"
+
+
+#define CYCLES		3
+#define MAXSTEPS	(1 << 20)
+#define TARGET		1000  /* microseconds */
+
+
+static const char build[] =
+  "@mb = ...;"
+  "@pool = {}; ?? i=1,1000 -> (pool.(i) = {.id=i, .name='n' .. i});"
+  "heap = {};"
+  "?? t=1,mb / 32 -> ("
+  "  @a = {};"
+  "  ?? i=1,2000000 -> (a.(i) = (i % 3 == 0) & i | pool.(i % 1000 + 1));"
+  "  heap.(t) = a"
+  ")";
+
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+static int cmpdouble (const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+
+static void cycles (inlua_State *L, int target, int first) {
+  static double ms[MAXSTEPS];
+  double total = 0;
+  int n = 0, c;
+  inlua_gc(L, INLUA_GCSETPAUSETARGET, target);
+  inlua_gc(L, INLUA_GCCOLLECT, 0);  /* start from the same point */
+  for (c = 0; c < CYCLES; c++) {
+    int done = 0;
+    while (!done && n < MAXSTEPS) {
+      double t = now();
+      done = inlua_gc(L, INLUA_GCSTEP, 0);
+      ms[n] = now() - t;
+      total += ms[n++];
+    }
+  }
+  qsort(ms, n, sizeof(double), cmpdouble);
+  printf("%s  {\"target_us\": %d, \"steps\": %d, "
+         "\"max_ms\": %.3f, \"p99_ms\": %.3f, \"mean_ms\": %.4f}",
+         first ? "" : ",\n", target, n, ms[n - 1],
+         ms[(99 * n + 99) / 100 - 1], total / n);
+}
+
+
+int main (int argc, char *argv[]) {
+  int mb = (argc > 1) ? atoi(argv[1]) : 320;
+  inlua_State *L = inluaL_newstate();
+  inluaL_openlibs(L);
+  if (inluaL_loadstring(L, build) != 0) goto error;
+  inlua_pushinteger(L, mb < 32 ? 32 : mb);
+  if (inlua_pcall(L, 1, 0, 0) != 0) goto error;
+  printf("[\n");
+  cycles(L, 0, 1);
+  cycles(L, TARGET, 0);
+  printf("\n]\n");
+  inlua_close(L);
+  return EXIT_SUCCESS;
+error:
+  fprintf(stderr, "gcpause: %s\n", inlua_tostring(L, -1));
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,16 @@
+-- small local helper functions called from hot loops
+
+local sq = function(x) return x * x end
+local lerp = function(a, b, t) return a + (b - a) * t end
+local clamp = function(x, lo, hi) return x < lo and lo or x > hi and hi or x end
+local dot = function(ax, ay, bx, by) return ax * bx + ay * by end
+local sign = function(x) if x < 0 then return -1 end return x > 0 and 1 or 0 end
+
+local sum = 0
+for i=1,3000000 do
+    local t = i % 1000 / 1000
+    local x = lerp(-5, 5, t)
+    local y = clamp(sq(x) - 10, -4, 4)
+    sum = sum + dot(x, y, t, 1 - t) + sign(y)
+end
+print(string.format("%.6f", sum))
@@ -0,0 +1,154 @@
+/*
+** load.c -- time to load a large generated data file
+** usage: load [megabytes]
+** Writes a source of about `megabytes' (default 8) that returns a list of
+** table literals of records, with comments, strings and numerals with `_'
+** separators, as data files written by programs look. Compiles it with
+** inluaL_loadbuffer and with inluaL_loadfile, and runs it; then builds
+** the same value from its pure-data form with inluaL_loaddata. Prints the
+** best of several times of each as JSON, after checking that both give
+** the same data.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "inlua.h"
+#include "inlauxlib.h"
+#include "inlualib.h"
+
+
+#define RUNS		5
+#define RECORDS		8000	/* per chunk: keeps constants below the limit */
+
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+static void fail (inlua_State *L) {
+  fprintf(stderr, "load: %s\n", inlua_tostring(L, -1));
+  exit(EXIT_FAILURE);
+}
+
+
+/*
+** a source of about `size' bytes. As code, each list of records is a
+** function that returns it; as data, the lists are items of a constructor
+*/
+static char *source (size_t size, int data, size_t *len) {
+  char *s = malloc(size + 4096);
+  size_t n = 0;
+  int i = 0;
+  if (s == NULL) exit(EXIT_FAILURE);
+  n += sprintf(s + n, data ? "-- generated data\n{\n" :
+                 "-- generated data\n@parts = {}\n");
+  while (n < size) {
+    int j;
+    n += sprintf(s + n, data ? "{\n" : "parts.(#parts + 1) = [](^^ {\n");
+    for (j = 0; j < RECORDS && n < size; j++, i++)
+      n += sprintf(s + n, "  {.id=%d, .name=\"item %d\", .price=%d.%02d, "
+                   ".stock=1_000_%03d, .tags={'red', 'green', 'blue'}},"
+                   "  -- record %d\n", i, i % 5000, i % 1000, i % 100,
+                   i % 1000, i);
+    n += sprintf(s + n, data ? "},\n" : "})\n");
+  }
+  n += sprintf(s + n, data ? "}\n" : "?? i=1,#parts -> (parts.(i) = parts.(i)())\n"
+                               "^^ parts\n");
+  *len = n;
+  return s;
+}
+
+
+/* what each timed run does */
+enum { COMPILE, COMPILEFILE, RUN, DATA };
+
+static double best (inlua_State *L, const char *buff, size_t len,
+                    const char *file, int what) {
+  double t = 1e30;
+  int i;
+  for (i = 0; i < RUNS; i++) {
+    double start;
+    if (what == RUN && inluaL_loadbuffer(L, buff, len, "=data") != 0)
+      fail(L);
+    start = now();
+    switch (what) {
+      case COMPILE:
+        if (inluaL_loadbuffer(L, buff, len, "=data") != 0) fail(L);
+        break;
+      case COMPILEFILE:
+        if (inluaL_loadfile(L, file) != 0) fail(L);
+        break;
+      case RUN:
+        if (inlua_pcall(L, 0, 1, 0) != 0) fail(L);
+        break;
+      case DATA:
+        if (inluaL_loaddata(L, buff, len, "=data") != 0) fail(L);
+        break;
+    }
+    start = now() - start;
+    if (start < t) t = start;
+    inlua_pop(L, 1);
+    inlua_gc(L, INLUA_GCCOLLECT, 0);
+  }
+  return t;
+}
+
+
+static const char same[] =
+  "@a, b = ...;"
+  "#a == #b & ?? i=1,#a -> ("
+  "  #a.(i) != #b.(i) & ^^^ 1;"
+  "  ?? j=1,#a.(i) -> ("
+  "    @x, y = a.(i).(j), b.(i).(j);"
+  "    x.id != y.id | x.name != y.name | x.stock != y.stock |"
+  "      x.tags.(3) != y.tags.(3) & ^^^ 1"
+  "  )"
+  ") | 1";
+
+
+int main (int argc, char *argv[]) {
+  double mb = (argc > 1) ? atof(argv[1]) : 8;
+  size_t len, dlen;
+  char *s = source((size_t)(mb * 1024 * 1024), 0, &len);
+  char *d = source((size_t)(mb * 1024 * 1024), 1, &dlen);
+  char file[] = "load.tmp";
+  FILE *f = fopen(file, "wb");
+  double t[4];
+  inlua_State *L = inluaL_newstate();
+  inluaL_openlibs(L);
+  if (f == NULL || fwrite(s, 1, len, f) != len || fclose(f) != 0) {
+    fprintf(stderr, "load: cannot write %s\n", file);
+    return EXIT_FAILURE;
+  }
+  if (inluaL_loadstring(L, same) != 0 ||
+      inluaL_loadbuffer(L, s, len, "=data") != 0 ||
+      inlua_pcall(L, 0, 1, 0) != 0 ||
+      inluaL_loaddata(L, d, dlen, "=data") != 0 ||
+      inlua_pcall(L, 2, 1, 0) != 0)
+    fail(L);
+  if (!inlua_isnil(L, -1)) {
+    fprintf(stderr, "load: inluaL_loaddata gave different data\n");
+    return EXIT_FAILURE;
+  }
+  inlua_pop(L, 1);
+  t[COMPILE] = best(L, s, len, NULL, COMPILE);
+  t[COMPILEFILE] = best(L, NULL, 0, file, COMPILEFILE);
+  t[RUN] = best(L, s, len, NULL, RUN);
+  t[DATA] = best(L, d, dlen, NULL, DATA);
+  remove(file);
+  printf("[\n  {\"bytes\": %lu, \"loadbuffer_ms\": %.2f, "
+         "\"loadfile_ms\": %.2f, \"run_ms\": %.2f,\n   "
+         "\"loaddata_ms\": %.2f, \"speedup\": %.1f}\n]\n",
+         (unsigned long)len, t[COMPILE], t[COMPILEFILE], t[RUN], t[DATA],
+         (t[COMPILE] + t[RUN]) / t[DATA]);
+  inlua_close(L);
+  free(s);
+  free(d);
+  return EXIT_SUCCESS;
+}
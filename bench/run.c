@@ -0,0 +1,224 @@
+/*
+** run.c -- benchmark runner for inlua
+** usage: run [-n runs] [-i interpreter] [-r reference] script.inlua ...
+** Each script runs `runs' times, each time in a fresh process. The runner
+** reports, as a JSON array on stdout, the median and 95th percentile of the
+** wall-clock time, the peak resident set size and the number of user-mode
+** instructions (Linux perf counters; null where they are not available).
+** With -r, the twin script.lua of each benchmark also runs under the given
+** reference Lua 5.1 interpreter, and the outputs of both are compared.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#define USE_PERF
+#endif
+
+
+#define MAXRUNS		1000
+#define MAXOUTPUT	(64*1024)
+
+
+static const char *progname = "run";
+
+
+typedef struct Result {
+  double ms;  /* wall-clock time in milliseconds */
+  long rsskb;  /* peak resident set size in kilobytes */
+  long long instr;  /* user-mode instructions, or -1 */
+  int status;  /* exit status of the script */
+  char out[MAXOUTPUT];  /* (start of) its standard output */
+  size_t outlen;
+} Result;
+
+
+static void fatal (const char *what) {
+  fprintf(stderr, "%s: %s: %s\n", progname, what, strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+
+/* counter of user-mode instructions of process `pid', enabled on exec */
+static int opencounter (pid_t pid) {
+#if defined(USE_PERF)
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HARDWARE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_INSTRUCTIONS;
+  pe.disabled = 1;
+  pe.enable_on_exec = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  return (int)syscall(__NR_perf_event_open, &pe, pid, -1, -1, 0);
+#else
+  (void)pid;
+  return -1;
+#endif
+}
+
+
+static void runonce (const char *interp, const char *script, Result *r) {
+  int sync[2], out[2], counter;
+  char go = 'g';
+  double start;
+  struct rusage ru;
+  pid_t pid;
+  ssize_t n;
+  if (pipe(sync) != 0 || pipe(out) != 0) fatal("pipe");
+  pid = fork();
+  if (pid < 0) fatal("fork");
+  if (pid == 0) {  /* child: wait until the counter is ready, then run */
+    close(sync[1]);
+    close(out[0]);
+    if (read(sync[0], &go, 1) != 1) _exit(127);
+    dup2(out[1], STDOUT_FILENO);
+    execlp(interp, interp, script, (char *)NULL);
+    fprintf(stderr, "%s: cannot run %s: %s\n", progname, interp,
+            strerror(errno));
+    _exit(127);
+  }
+  close(sync[0]);
+  close(out[1]);
+  counter = opencounter(pid);
+  start = now();
+  if (write(sync[1], &go, 1) != 1) fatal("write");
+  close(sync[1]);
+  r->outlen = 0;
+  for (;;) {  /* keep the start of the output and drain the rest */
+    char buff[4096];
+    n = read(out[0], buff, sizeof(buff));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    if ((size_t)n > MAXOUTPUT - r->outlen) n = MAXOUTPUT - r->outlen;
+    memcpy(r->out + r->outlen, buff, n);
+    r->outlen += n;
+  }
+  close(out[0]);
+  if (wait4(pid, &r->status, 0, &ru) < 0) fatal("wait4");
+  r->ms = now() - start;
+  r->rsskb = ru.ru_maxrss;
+  r->instr = -1;
+  if (counter >= 0) {
+    long long c;
+    if (read(counter, &c, sizeof(c)) == sizeof(c)) r->instr = c;
+    close(counter);
+  }
+}
+
+
+static int cmpdouble (const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+
+static int cmplong (const void *a, const void *b) {
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+
+/* returns the first run, whose output is used for comparisons */
+static Result *bench (const char *interp, const char *script, int runs,
+                      int first) {
+  static Result r;
+  static Result keep;
+  double ms[MAXRUNS];
+  long long instr[MAXRUNS];
+  long rss = 0;
+  int i, failed = 0;
+  for (i = 0; i < runs; i++) {
+    runonce(interp, script, &r);
+    if (i == 0) keep = r;
+    if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) != 0) failed = 1;
+    ms[i] = r.ms;
+    instr[i] = r.instr;
+    if (r.rsskb > rss) rss = r.rsskb;
+  }
+  qsort(ms, runs, sizeof(double), cmpdouble);
+  qsort(instr, runs, sizeof(long long), cmplong);
+  printf("%s  {\"script\": \"%s\", \"interpreter\": \"%s\", \"runs\": %d, "
+         "\"ok\": %s,\n   \"median_ms\": %.3f, \"p95_ms\": %.3f, "
+         "\"maxrss_kb\": %ld, \"instructions\": ",
+         first ? "" : ",\n", script, interp, runs, failed ? "false" : "true",
+         (runs % 2) ? ms[runs/2] : (ms[runs/2 - 1] + ms[runs/2]) / 2,
+         ms[(95 * runs + 99) / 100 - 1], rss);
+  if (instr[0] < 0) printf("null");
+  else printf("%lld", instr[runs/2]);
+  return &keep;
+}
+
+
+static void usage (void) {
+  fprintf(stderr,
+  "usage: %s [-n runs] [-i interpreter] [-r reference] script.inlua ...\n",
+  progname);
+  exit(EXIT_FAILURE);
+}
+
+
+int main (int argc, char *argv[]) {
+  const char *interp = "inlua";
+  const char *ref = NULL;
+  int runs = 5;
+  int i, first = 1;
+  if (argv[0] && argv[0][0]) progname = argv[0];
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (i + 1 >= argc) usage();
+    switch (argv[i][1]) {
+      case 'n': runs = atoi(argv[++i]); break;
+      case 'i': interp = argv[++i]; break;
+      case 'r': ref = argv[++i]; break;
+      default: usage();
+    }
+  }
+  if (i >= argc || runs < 1 || runs > MAXRUNS) usage();
+  printf("[\n");
+  for (; i < argc; i++) {
+    static char twin[FILENAME_MAX];
+    static char out[MAXOUTPUT];
+    size_t outlen;
+    const char *dot = strrchr(argv[i], '.');
+    Result *r = bench(interp, argv[i], runs, first);
+    first = 0;
+    if (ref == NULL || dot == NULL || dot - argv[i] + 5 > FILENAME_MAX) {
+      printf("}");
+      continue;
+    }
+    memcpy(out, r->out, r->outlen);
+    outlen = r->outlen;
+    sprintf(twin, "%.*s.lua", (int)(dot - argv[i]), argv[i]);
+    if (access(twin, R_OK) != 0) {
+      printf("}");
+      continue;
+    }
+    printf("},\n");
+    r = bench(ref, twin, runs, 1);
+    printf(", \"same_output\": %s}",
+           (outlen == r->outlen && memcmp(out, r->out, outlen) == 0) ?
+           "true" : "false");
+  }
+  printf("\n]\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,22 @@
+-- string patterns: gsub, gmatch, find and format
+
+local words = {}
+for i=1,2000 do words[i] = string.format("w%05d=%d;", i, i * 7) end
+local text = table.concat(words)
+
+local total = 0
+for round=1,30 do
+    for k, v in string.gmatch(text, "(w%d+)=(%d+);") do
+        total = total + #k + v
+    end
+    local s, n = string.gsub(text, "w0*(%d+)", "%1")
+    total = total + n + #s
+    local pos = 1
+    while pos do
+        local a, b = string.find(text, "=%d*7;", pos)
+        pos = b and b + 1
+        if b then total = total + 1 end
+    end
+    total = total + #string.upper(string.sub(text, round, round + 100))
+end
+print(total)
@@ -0,0 +1,36 @@
+-- dispatch on a value with long chains of `==' tests
+
+local M = 1000003
+
+local function run(code, n)
+    local acc, pc = 1, 1
+    for step=1,n do
+        local op = code[pc]
+        if op == 1 then acc = acc + 1 elseif op == 2 then acc = acc + 3
+        elseif op == 3 then acc = acc * 2 % M elseif op == 4 then acc = acc * 3 % M
+        elseif op == 5 then acc = acc + step elseif op == 6 then acc = (acc + 7) % M
+        elseif op == 7 then acc = acc - 1 elseif op == 8 then acc = acc + 11
+        elseif op == 9 then acc = acc * 5 % M elseif op == 10 then acc = acc + pc
+        elseif op == 11 then acc = acc - 2 elseif op == 12 then acc = acc + 13
+        elseif op == 13 then acc = acc * 7 % M elseif op == 14 then acc = acc + 17
+        elseif op == 15 then acc = acc - 3 elseif op == 16 then acc = acc + 19
+        else acc = 0 end
+        pc = pc % #code + 1
+    end
+    return acc
+end
+
+local function command(s, v)
+    return s == "add" and v + 1 or s == "sub" and v - 1 or s == "double" and v * 2 or
+       s == "half" and v / 2 or s == "neg" and -v or s == "square" and v * v % M or
+       s == "mod" and v % 97 or s == "inc10" and v + 10 or v
+end
+
+local code = {}
+for i=1,1000 do code[i] = (i * 7919) % 17 + 1 end
+print(run(code, 3000000))
+
+local names = {"add", "sub", "double", "half", "neg", "square", "mod", "inc10", "nop"}
+local v = 1
+for i=1,2000000 do v = command(names[i % #names + 1], v) % M end
+print(v)
@@ -0,0 +1,21 @@
+-- table churn: short-lived records, array growth and hash inserts
+
+local total = 0
+for round=1,40 do
+    local list = {}
+    for i=1,20000 do
+        list[i] = {id=i, name="item", weight=i % 17}
+    end
+    local index = {}
+    for i, r in ipairs(list) do
+        index[r.id * 3] = r
+        total = total + r.weight
+    end
+    for i=1,20000,7 do
+        index[i * 3] = nil
+    end
+    local n = 0
+    for k, v in pairs(index) do n = n + 1 end
+    total = total + n
+end
+print(total)
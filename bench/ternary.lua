@@ -0,0 +1,13 @@
+-- chains of ternaries used as if-elseif-else
+
+local function classify(n)
+    return n % 15 == 0 and "fizzbuzz" or n % 5 == 0 and "buzz" or n % 3 == 0 and "fizz" or
+       n % 7 == 0 and "seven" or n % 11 == 0 and "eleven" or "number"
+end
+
+local counts = {}
+for i=1,2000000 do
+    local c = classify(i)
+    counts[c] = (counts[c] or 0) + 1
+end
+print(counts.fizzbuzz, counts.buzz, counts.fizz, counts.seven, counts.eleven, counts.number)
@@ -5,12 +5,14 @@
 #define inluaall_c
 
 #include "lapi.c"
+#include "larray.c"
 #include "lcode.c"
 #include "ldebug.c"
 #include "ldo.c"
 #include "ldump.c"
 #include "lfunc.c"
 #include "lgc.c"
+#include "ljit.c"
 #include "llex.c"
 #include "lmem.c"
 #include "lobject.c"
@@ -24,6 +26,7 @@
 #include "lvm.c"
 #include "lzio.c"
 
+#include "larraylib.c"
 #include "lauxlib.c"
 #include "lbaselib.c"
 #include "ldblib.c"
@@ -0,0 +1,81 @@
+/*
+* bindbench.cpp -- compares inlua.hpp bindings with hand-written C functions
+* calls each version from a loop in inlua and prints the times.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "inlua.hpp"
+
+/* the same function, written against the C API... */
+static int c_add(inlua_State *L)
+{
+ double a=inluaL_checknumber(L,1);
+ double b=inluaL_checknumber(L,2);
+ inlua_pushnumber(L,a+b);
+ return 1;
+}
+
+/* ...and bound with the template layer */
+static double add(double a, double b)
+{
+ return a+b;
+}
+
+struct Counter {
+ long n;
+ Counter() : n(0) {}
+ long bump(long k) { return n+=k; }
+};
+
+static int c_bump(inlua_State *L)
+{
+ Counter *c=(Counter *)inluaL_checkudata(L,1,"Counter");
+ long k=(long)inluaL_checkinteger(L,2);
+ inlua_pushinteger(L,c->n+=k);
+ return 1;
+}
+
+static int newcounter(inlua_State *L)
+{
+ inlua::newuserdata<Counter>(L);
+ return 1;
+}
+
+static const inluaL_Reg methods[] = {
+ {"bump", INLUA_METHOD(&Counter::bump)},
+ {"cbump", c_bump},
+ {NULL, NULL}
+};
+
+static double run(inlua_State *L, const char *code)
+{
+ inlua::StackGuard guard(L);
+ clock_t t=clock();
+ if (inluaL_dostring(L,code))
+ {
+  fprintf(stderr,"bindbench: %s\n",inlua_tostring(L,-1));
+  return -1;
+ }
+ return (double)(clock()-t)/CLOCKS_PER_SEC;
+}
+
+int main(void)
+{
+ double c,t;
+ inlua_State *L=inluaL_newstate();
+ inlua_register(L,"c_add",c_add);
+ inlua_register(L,"add",INLUA_FUNCTION(add));
+ inlua::registerclass<Counter>(L,"Counter",methods);
+ inlua_register(L,"counter",newcounter);
+ printf("function   C API    inlua.hpp\n");
+ c=run(L,"@f=c_add; ?? i=1,10000000 -> (f(i,1))");
+ t=run(L,"@f=add; ?? i=1,10000000 -> (f(i,1))");
+ printf("add      %6.3fs  %6.3fs\n",c,t);
+ c=run(L,"@c=counter(); @f=c.cbump; ?? i=1,10000000 -> (f(c,1))");
+ t=run(L,"@c=counter(); @f=c.bump; ?? i=1,10000000 -> (f(c,1))");
+ printf("method   %6.3fs  %6.3fs\n",c,t);
+ inlua_close(L);
+ return 0;
+}
@@ -0,0 +1,599 @@
+/*
+* heapsnap.c -- analyze heap snapshots written by debug.heapsnapshot.
+* "heapsnap snap.json [n]" prints the memory used by each type and the n
+* objects that retain the most memory (an object retains everything that
+* can only be reached through it), with a path from a root to each one.
+* "heapsnap old.json new.json [n]" lists what was added between two
+* snapshots of the same state, grouped by type, name and the object that
+* retains them, and the objects whose retained size grew the most.
+* Edges that weak tables do not count (keys of __mode=k tables, values of
+* __mode=v ones) are ignored.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned long long Id;
+
+typedef struct Object
+{
+ Id id;
+ char* type;
+ char* name;
+ unsigned long size;
+ int first,count;		/* edges */
+ int idom,order,parent,parentedge;
+ unsigned long retained;
+} Object;
+
+typedef struct Edge
+{
+ Id to;
+ int target;			/* index of `to', or -1 */
+ char* label;
+} Edge;
+
+typedef struct Heap
+{
+ Object* obj;
+ int nobj,maxobj;
+ Edge* edge;
+ int nedge,maxedge;
+ Id* root;
+ char** rootname;
+ int nroot,maxroot;
+ int* hash;			/* open addressing on ids */
+ int sizehash;
+} Heap;
+
+/* the parser */
+
+static const char* filename;
+static const char* p;
+
+static void fail(const char* what)
+{
+ fprintf(stderr,"heapsnap: %s: %s\n",filename,what);
+ exit(EXIT_FAILURE);
+}
+
+static void* grow(void* v, int* max, size_t size)
+{
+ *max=(*max) ? 2*(*max) : 1024;
+ v=realloc(v,*max*size);
+ if (v==NULL) fail("not enough memory");
+ return v;
+}
+
+static void skip(void)
+{
+ while (*p==' ' || *p=='\n' || *p=='\r' || *p=='\t') p++;
+}
+
+static int accept(int c)
+{
+ skip();
+ if (*p!=c) return 0;
+ p++;
+ return 1;
+}
+
+static void expect(int c)
+{
+ if (!accept(c)) fail("not a heap snapshot");
+}
+
+static Id number(void)
+{
+ char* end;
+ Id n;
+ skip();
+ n=strtoull(p,&end,10);
+ if (end==p) fail("number expected");
+ p=end;
+ return n;
+}
+
+static char* string(void)
+{
+ char* s;
+ char* d;
+ const char* q;
+ expect('"');
+ for (q=p; *q!='"'; q++)
+ {
+  if (*q=='\0') fail("unfinished string");
+  if (*q=='\\') q++;
+ }
+ s=d=malloc(q-p+1);
+ if (s==NULL) fail("not enough memory");
+ while (*p!='"')
+ {
+  if (*p!='\\') { *d++=*p++; continue; }
+  p++;
+  if (*p=='u')
+  {
+   char hex[5];
+   memcpy(hex,p+1,4);
+   hex[4]='\0';
+   *d++=(char)strtol(hex,NULL,16);
+   p+=5;
+  }
+  else if (*p=='n') { *d++='\n'; p++; }
+  else *d++=*p++;
+ }
+ p++;
+ *d='\0';
+ return s;
+}
+
+static void parseroots(Heap* h)
+{
+ expect('[');
+ if (accept(']')) return;
+ do
+ {
+  if (h->nroot==h->maxroot)
+  {
+   int max=h->maxroot;
+   h->root=grow(h->root,&h->maxroot,sizeof(Id));
+   h->rootname=grow(h->rootname,&max,sizeof(char*));
+  }
+  expect('[');
+  h->rootname[h->nroot]=string();
+  expect(',');
+  h->root[h->nroot++]=number();
+  expect(']');
+ } while (accept(','));
+ expect(']');
+}
+
+static void parseobjects(Heap* h)
+{
+ expect('[');
+ if (accept(']')) return;
+ do
+ {
+  Object* o;
+  if (h->nobj==h->maxobj) h->obj=grow(h->obj,&h->maxobj,sizeof(Object));
+  o=&h->obj[h->nobj++];
+  expect('[');
+  o->id=number();
+  expect(',');
+  o->type=string();
+  expect(',');
+  o->size=(unsigned long)number();
+  expect(',');
+  o->name=string();
+  expect(',');
+  expect('[');
+  o->first=h->nedge;
+  o->count=0;
+  if (!accept(']'))
+  {
+   do
+   {
+    Edge* e;
+    if (h->nedge==h->maxedge) h->edge=grow(h->edge,&h->maxedge,sizeof(Edge));
+    e=&h->edge[h->nedge++];
+    expect('[');
+    e->to=number();
+    expect(',');
+    e->label=string();
+    expect(']');
+    o->count++;
+   } while (accept(','));
+   expect(']');
+  }
+  expect(']');
+ } while (accept(','));
+ expect(']');
+}
+
+static char* readfile(const char* name)
+{
+ FILE* f=fopen(name,"rb");
+ char* b;
+ long n;
+ if (f==NULL || fseek(f,0,SEEK_END)!=0 || (n=ftell(f))<0) fail("cannot read");
+ rewind(f);
+ b=malloc(n+1);
+ if (b==NULL) fail("not enough memory");
+ if (fread(b,1,n,f)!=(size_t)n) fail("cannot read");
+ b[n]='\0';
+ fclose(f);
+ return b;
+}
+
+/* the analysis */
+
+static unsigned hashid(Id id)
+{
+ return (unsigned)((id>>3)*2654435761u);
+}
+
+static int find(const Heap* h, Id id)
+{
+ unsigned i=hashid(id)&(h->sizehash-1);
+ while (h->hash[i]>=0)
+ {
+  if (h->obj[h->hash[i]].id==id) return h->hash[i];
+  i=(i+1)&(h->sizehash-1);
+ }
+ return -1;
+}
+
+/* is the edge one that a weak table does not count? */
+static int isweak(const Object* o, const Edge* e)
+{
+ const char* mode;
+ if (strncmp(o->name,"__mode=",7)!=0) return 0;
+ mode=o->name+7;
+ if (strcmp(e->label,"key")==0) return strchr(mode,'k')!=NULL;
+ if (strcmp(e->label,"metatable")==0) return 0;
+ return strchr(mode,'v')!=NULL;
+}
+
+static int intersect(const Heap* h, int a, int b)
+{
+ while (a!=b)
+ {
+  while (h->obj[a].order>h->obj[b].order) a=h->obj[a].idom;
+  while (h->obj[b].order>h->obj[a].order) b=h->obj[b].idom;
+ }
+ return a;
+}
+
+/*
+* Dominators, with the iterative algorithm of Cooper, Harvey and Kennedy.
+* Object `n' (one past the last) stands for the roots. Objects get their
+* `order' in a reverse postorder and their `parent' on a shortest path
+* from a root; unreachable ones keep order -1.
+*/
+static void analyze(Heap* h)
+{
+ int n=h->nobj,i,j,k,changed;
+ int* stack;
+ int* next;
+ int* rpo;
+ int* npred;
+ int* pred;
+ int* queue;
+ Object* root;
+ h->sizehash=1;
+ while (h->sizehash<2*n) h->sizehash*=2;
+ h->hash=malloc(h->sizehash*sizeof(int));
+ h->obj=realloc(h->obj,(n+1)*sizeof(Object));
+ stack=malloc((n+1)*sizeof(int));
+ next=malloc((n+1)*sizeof(int));
+ rpo=malloc((n+1)*sizeof(int));
+ npred=calloc(n+2,sizeof(int));
+ queue=malloc((n+1)*sizeof(int));
+ if (!h->hash || !h->obj || !stack || !next || !rpo || !npred || !queue)
+  fail("not enough memory");
+ for (i=0; i<h->sizehash; i++) h->hash[i]=-1;
+ for (i=0; i<n; i++)
+ {
+  unsigned s=hashid(h->obj[i].id)&(h->sizehash-1);
+  while (h->hash[s]>=0) s=(s+1)&(h->sizehash-1);
+  h->hash[s]=i;
+ }
+ for (i=0; i<h->nedge; i++) h->edge[i].target=-1;
+ for (i=0; i<n; i++)
+ {
+  Object* o=&h->obj[i];
+  for (j=o->first; j<o->first+o->count; j++)
+   if (!isweak(o,&h->edge[j])) h->edge[j].target=find(h,h->edge[j].to);
+ }
+ root=&h->obj[n];
+ memset(root,0,sizeof(Object));
+ root->type=root->name="";
+ for (i=0; i<=n; i++) { h->obj[i].order=-1; h->obj[i].idom=-1; }
+ /* shortest paths, for printing */
+ k=0;
+ for (i=0; i<h->nroot; i++)
+ {
+  int r=find(h,h->root[i]);
+  if (r>=0 && h->obj[r].order<0)
+  {
+   h->obj[r].order=0;
+   h->obj[r].parent=-1;
+   h->obj[r].parentedge=i;
+   queue[k++]=r;
+  }
+ }
+ for (i=0; i<k; i++)
+ {
+  Object* o=&h->obj[queue[i]];
+  for (j=o->first; j<o->first+o->count; j++)
+  {
+   int t=h->edge[j].target;
+   if (t>=0 && h->obj[t].order<0)
+   {
+    h->obj[t].order=0;
+    h->obj[t].parent=queue[i];
+    h->obj[t].parentedge=j;
+    queue[k++]=t;
+   }
+  }
+ }
+ /* reverse postorder from the roots, with an explicit stack */
+ for (i=0; i<=n; i++) { h->obj[i].order=-1; next[i]=0; }
+ k=n+1;
+ j=0;
+ stack[j++]=n;
+ h->obj[n].order=0;
+ while (j>0)
+ {
+  int v=stack[j-1];
+  int t=-1;
+  if (v==n)
+  {
+   while (t<0 && next[v]<h->nroot)
+   {
+    t=find(h,h->root[next[v]++]);
+    if (t>=0 && h->obj[t].order>=0) t=-1;
+   }
+  }
+  else
+  {
+   Object* o=&h->obj[v];
+   while (t<0 && next[v]<o->count)
+   {
+    t=h->edge[o->first+next[v]++].target;
+    if (t>=0 && h->obj[t].order>=0) t=-1;
+   }
+  }
+  if (t>=0) { h->obj[t].order=0; stack[j++]=t; }
+  else rpo[--k]=stack[--j];
+ }
+ for (i=k; i<=n; i++) h->obj[rpo[i]].order=i-k;
+ /* predecessors */
+ for (i=0; i<n; i++)
+ {
+  Object* o=&h->obj[i];
+  if (o->order<0) continue;
+  for (j=o->first; j<o->first+o->count; j++)
+   if (h->edge[j].target>=0) npred[h->edge[j].target+1]++;
+ }
+ for (i=0; i<h->nroot; i++)
+ {
+  int r=find(h,h->root[i]);
+  if (r>=0) npred[r+1]++;
+ }
+ for (i=0; i<=n; i++) npred[i+1]+=npred[i];
+ pred=malloc((npred[n+1]+1)*sizeof(int));
+ if (pred==NULL) fail("not enough memory");
+ memcpy(next,npred,(n+1)*sizeof(int));
+ for (i=0; i<n; i++)
+ {
+  Object* o=&h->obj[i];
+  if (o->order<0) continue;
+  for (j=o->first; j<o->first+o->count; j++)
+   if (h->edge[j].target>=0) pred[next[h->edge[j].target]++]=i;
+ }
+ for (i=0; i<h->nroot; i++)
+ {
+  int r=find(h,h->root[i]);
+  if (r>=0) pred[next[r]++]=n;
+ }
+ /* dominators */
+ h->obj[n].idom=n;
+ do
+ {
+  changed=0;
+  for (i=k+1; i<=n; i++)
+  {
+   int v=rpo[i];
+   int d=-1;
+   for (j=npred[v]; j<npred[v+1]; j++)
+   {
+    int u=pred[j];
+    if (h->obj[u].idom<0) continue;
+    d=(d<0) ? u : intersect(h,u,d);
+   }
+   if (d!=h->obj[v].idom) { h->obj[v].idom=d; changed=1; }
+  }
+ } while (changed);
+ /* retained sizes, children before their dominators */
+ for (i=0; i<=n; i++) h->obj[i].retained=h->obj[i].size;
+ for (i=n; i>k; i--)
+ {
+  Object* o=&h->obj[rpo[i]];
+  h->obj[o->idom].retained+=o->retained;
+ }
+ free(stack); free(next); free(rpo); free(npred); free(pred); free(queue);
+}
+
+static void load(Heap* h, const char* name)
+{
+ char* b;
+ memset(h,0,sizeof(Heap));
+ filename=name;
+ p=b=readfile(name);
+ expect('{');
+ do
+ {
+  char* key=string();
+  expect(':');
+  if (strcmp(key,"roots")==0) parseroots(h);
+  else if (strcmp(key,"objects")==0) parseobjects(h);
+  else number();
+  free(key);
+ } while (accept(','));
+ expect('}');
+ free(b);
+ analyze(h);
+}
+
+static void printpath(const Heap* h, int i)
+{
+ const Object* o=&h->obj[i];
+ if (o->order<0) { printf("(unreachable)"); return; }
+ if (o->parent<0) { printf("%s",h->rootname[o->parentedge]); return; }
+ printpath(h,o->parent);
+ printf(" > %s",h->edge[o->parentedge].label);
+}
+
+static const Heap* sorted;
+
+static int byretained(const void* x, const void* y)
+{
+ const Object* a=&sorted->obj[*(const int*)x];
+ const Object* b=&sorted->obj[*(const int*)y];
+ return (a->retained<b->retained) - (a->retained>b->retained);
+}
+
+static void printobject(const Heap* h, int i, long delta)
+{
+ const Object* o=&h->obj[i];
+ printf("%10lu",o->retained);
+ if (delta) printf(" %+10ld",delta);
+ printf("  %-8s %-24s ",o->type,o->name);
+ printpath(h,i);
+ printf("\n");
+}
+
+static void summary(const Heap* h, int top)
+{
+ static const char* types[]={"string","table","function","userdata",
+  "thread","proto","upvalue",NULL};
+ unsigned long total=0,count[8],bytes[8],lost=0;
+ int i,t,n=h->nobj;
+ int* idx=malloc(n*sizeof(int));
+ memset(count,0,sizeof(count));
+ memset(bytes,0,sizeof(bytes));
+ for (i=0; i<n; i++)
+ {
+  const Object* o=&h->obj[i];
+  for (t=0; types[t]!=NULL && strcmp(types[t],o->type)!=0; t++) ;
+  count[t]++;
+  bytes[t]+=o->size;
+  total+=o->size;
+  if (o->order<0) lost+=o->size;
+  idx[i]=i;
+ }
+ printf("%d objects, %lu bytes (%lu of them unreachable)\n",n,total,lost);
+ for (t=0; types[t]!=NULL; t++)
+  if (count[t]) printf("  %-10s %10lu objects %12lu bytes\n",types[t],count[t],bytes[t]);
+ sorted=h;
+ qsort(idx,n,sizeof(int),byretained);
+ printf("\n  retained  type     name                     path\n");
+ for (i=0; i<n && i<top; i++) printobject(h,idx[i],0);
+ free(idx);
+}
+
+typedef struct Group
+{
+ const char* type;
+ const char* name;
+ int idom;
+ unsigned long count,bytes;
+} Group;
+
+static int bybytes(const void* x, const void* y)
+{
+ const Group* a=(const Group*)x;
+ const Group* b=(const Group*)y;
+ return (a->bytes<b->bytes) - (a->bytes>b->bytes);
+}
+
+static int bygroup(const void* x, const void* y)
+{
+ const Object* a=&sorted->obj[*(const int*)x];
+ const Object* b=&sorted->obj[*(const int*)y];
+ int c=strcmp(a->type,b->type);
+ if (c==0) c=strcmp(a->name,b->name);
+ return c ? c : (a->idom>b->idom) - (a->idom<b->idom);
+}
+
+static long* growth;
+
+static int bygrowth(const void* x, const void* y)
+{
+ long a=growth[*(const int*)x];
+ long b=growth[*(const int*)y];
+ return (a<b) - (a>b);
+}
+
+static void diff(const Heap* a, const Heap* b, int top)
+{
+ int n=b->nobj,i,k=0,ng=0,nc=0;
+ int* added=malloc(n*sizeof(int));
+ int* common=malloc(n*sizeof(int));
+ Group* g=malloc(n*sizeof(Group));
+ unsigned long bytes=0;
+ growth=malloc(n*sizeof(long));
+ for (i=0; i<n; i++)
+ {
+  int j=find(a,b->obj[i].id);
+  if (j<0 || strcmp(a->obj[j].type,b->obj[i].type)!=0)
+  {
+   added[k++]=i;
+   bytes+=b->obj[i].size;
+  }
+  else
+  {
+   growth[i]=(long)b->obj[i].retained-(long)a->obj[j].retained;
+   if (growth[i]>0) common[nc++]=i;
+  }
+ }
+ printf("%d objects added, %lu bytes\n",k,bytes);
+ sorted=b;
+ qsort(added,k,sizeof(int),bygroup);
+ for (i=0; i<k; i++)
+ {
+  const Object* o=&b->obj[added[i]];
+  if (ng==0 || strcmp(g[ng-1].type,o->type)!=0 ||
+      strcmp(g[ng-1].name,o->name)!=0 || g[ng-1].idom!=o->idom)
+  {
+   g[ng].type=o->type;
+   g[ng].name=o->name;
+   g[ng].idom=o->idom;
+   g[ng].count=g[ng].bytes=0;
+   ng++;
+  }
+  g[ng-1].count++;
+  g[ng-1].bytes+=o->size;
+ }
+ qsort(g,ng,sizeof(Group),bybytes);
+ printf("\n     count       bytes  type     name                     retained by\n");
+ for (i=0; i<ng && i<top; i++)
+ {
+  printf("%10lu %11lu  %-8s %-24s ",g[i].count,g[i].bytes,g[i].type,g[i].name);
+  if (g[i].idom<0) printf("(unreachable)");
+  else if (g[i].idom==n) printf("(roots)");
+  else printpath(b,g[i].idom);
+  printf("\n");
+ }
+ qsort(common,nc,sizeof(int),bygrowth);
+ printf("\n  retained     growth  type     name                     path\n");
+ for (i=0; i<nc && i<top; i++) printobject(b,common[i],growth[common[i]]);
+ free(added); free(common); free(g); free(growth);
+}
+
+int main(int argc, char* argv[])
+{
+ Heap a,b;
+ int top;
+ if (argc<2)
+ {
+  fprintf(stderr,"usage: %s snapshot [n]\n       %s old new [n]\n",argv[0],argv[0]);
+  return EXIT_FAILURE;
+ }
+ if (argc>2 && atoi(argv[2])==0 && strcmp(argv[2],"0")!=0)
+ {
+  top=(argc>3) ? atoi(argv[3]) : 20;
+  load(&a,argv[1]);
+  load(&b,argv[2]);
+  diff(&a,&b,top);
+ }
+ else
+ {
+  top=(argc>2) ? atoi(argv[2]) : 20;
+  load(&a,argv[1]);
+  summary(&a,top);
+ }
+ return EXIT_SUCCESS;
+}
@@ -7,3 +7,269 @@ extern "C" {
 #include "inlualib.h"
 #include "inlauxlib.h"
 }
+
+// C++11 binding layer (header only)
+// Define INLUA_NOBINDINGS before including this file to get only the C API;
+// older compilers (C++98) get only the C API too.
+//
+// INLUA_FUNCTION(f) turns a plain C++ function into an inlua_CFunction: the
+// signature of f is deduced at compile time and expands to the same
+// inluaL_check* / inlua_push* calls one would write by hand, with f called
+// directly (it is a template argument, not a pointer stored somewhere).
+// INLUA_METHOD(&C::m) does the same for member functions of a userdata
+// class C registered with inlua::registerclass<C>, taking the object as the
+// first argument. Argument types without a Stack<> specialization are
+// compile-time errors.
+//
+// Lua errors use longjmp unless the core is compiled as C++, so arguments
+// are limited to types without destructors (numbers, booleans, C strings,
+// inlua::String, userdata pointers and references); std::string may be
+// returned.
+
+#if !defined(INLUA_NOBINDINGS) && (__cplusplus >= 201103L || \
+    (defined(_MSVC_LANG) && _MSVC_LANG >= 201103L))
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace inlua {
+
+// a string argument that keeps its length (embedded zeros are fine)
+struct String {
+  const char *data;
+  std::size_t size;
+};
+
+
+// conversions between C++ types and stack values
+template <typename T, typename Enable = void> struct Stack;
+
+template <typename T>
+struct Stack<T, typename std::enable_if<std::is_integral<T>::value &&
+                                        !std::is_same<T, bool>::value>::type> {
+  static void push (inlua_State *L, T v) {
+    inlua_pushinteger(L, static_cast<inlua_Integer>(v));
+  }
+  static T check (inlua_State *L, int i) {
+    return static_cast<T>(inluaL_checkinteger(L, i));
+  }
+};
+
+template <typename T>
+struct Stack<T, typename std::enable_if<
+                    std::is_floating_point<T>::value>::type> {
+  static void push (inlua_State *L, T v) {
+    inlua_pushnumber(L, static_cast<inlua_Number>(v));
+  }
+  static T check (inlua_State *L, int i) {
+    return static_cast<T>(inluaL_checknumber(L, i));
+  }
+};
+
+template <> struct Stack<bool> {
+  static void push (inlua_State *L, bool v) { inlua_pushboolean(L, v); }
+  static bool check (inlua_State *L, int i) {
+    return inlua_toboolean(L, i) != 0;
+  }
+};
+
+template <> struct Stack<const char *> {
+  static void push (inlua_State *L, const char *v) { inlua_pushstring(L, v); }
+  static const char *check (inlua_State *L, int i) {
+    return inluaL_checkstring(L, i);
+  }
+};
+
+template <> struct Stack<String> {
+  static void push (inlua_State *L, String v) {
+    inlua_pushlstring(L, v.data, v.size);
+  }
+  static String check (inlua_State *L, int i) {
+    String s;
+    s.data = inluaL_checklstring(L, i, &s.size);
+    return s;
+  }
+};
+
+template <> struct Stack<std::string> {  // results only
+  static void push (inlua_State *L, const std::string &v) {
+    inlua_pushlstring(L, v.data(), v.size());
+  }
+};
+
+
+// name of the metatable of userdata class T (set by registerclass)
+template <typename T> const char *&classname () {
+  static const char *name = NULL;
+  return name;
+}
+
+// the same, raising an error when T was never registered
+template <typename T> const char *checkclassname (inlua_State *L) {
+  if (classname<T>() == NULL)
+    inluaL_error(L, "userdata class not registered");
+  return classname<T>();
+}
+
+template <typename T> struct Stack<T *, typename std::enable_if<
+                                          std::is_class<T>::value>::type> {
+  static T *check (inlua_State *L, int i) {
+    return static_cast<T *>(inluaL_checkudata(L, i, checkclassname<T>(L)));
+  }
+};
+
+template <typename T> struct Stack<T &, typename std::enable_if<
+                                          std::is_class<T>::value>::type> {
+  static T &check (inlua_State *L, int i) {
+    return *Stack<T *>::check(L, i);
+  }
+};
+
+
+// argument type as stored for the call: values, or references to userdata
+template <typename T> struct Arg {
+  typedef typename std::conditional<
+      std::is_lvalue_reference<T>::value &&
+          std::is_class<typename std::remove_reference<T>::type>::value,
+      T, typename std::decay<T>::type>::type type;
+};
+
+
+// compile-time list of argument positions
+template <int... I> struct Indices {};
+template <int N, int... I> struct MakeIndices
+    : MakeIndices<N - 1, N - 1, I...> {};
+template <int... I> struct MakeIndices<0, I...> {
+  typedef Indices<I...> type;
+};
+
+
+// calls `f' with the checked arguments and pushes its result, if any
+template <typename R> struct Caller {
+  template <typename F, typename Tuple, int... I>
+  static int call (inlua_State *L, F f, Tuple &a, Indices<I...>) {
+    Stack<typename std::decay<R>::type>::push(L, f(std::get<I>(a)...));
+    return 1;
+  }
+};
+
+template <> struct Caller<void> {
+  template <typename F, typename Tuple, int... I>
+  static int call (inlua_State *, F f, Tuple &a, Indices<I...>) {
+    f(std::get<I>(a)...);
+    return 0;
+  }
+};
+
+
+// the inlua_CFunction for `Call', whose arguments are A... at 1, 2, ...
+template <typename R, typename Call, typename... A> struct Invoke {
+  template <int... I>
+  static int apply (inlua_State *L, Indices<I...> ix) {
+    // a braced list is evaluated in order: arguments are checked left to right
+    std::tuple<A...> a{Stack<A>::check(L, I + 1)...};
+    return Caller<R>::call(L, Call(), a, ix);
+  }
+  static int cfunction (inlua_State *L) {
+    return apply(L, typename MakeIndices<sizeof...(A)>::type());
+  }
+};
+
+
+template <typename Sig, Sig F> struct Function;
+
+template <typename R, typename... A, R (*F)(A...)>
+struct Function<R (*)(A...), F> {
+  struct Call {
+    R operator() (typename Arg<A>::type... a) const { return F(a...); }
+  };
+  static int cfunction (inlua_State *L) {
+    return Invoke<R, Call, typename Arg<A>::type...>::cfunction(L);
+  }
+};
+
+
+template <typename Sig, Sig M> struct Method;
+
+template <typename C, typename R, typename... A, R (C::*M)(A...)>
+struct Method<R (C::*)(A...), M> {
+  struct Call {
+    R operator() (C *self, typename Arg<A>::type... a) const {
+      return (self->*M)(a...);
+    }
+  };
+  static int cfunction (inlua_State *L) {
+    return Invoke<R, Call, C *, typename Arg<A>::type...>::cfunction(L);
+  }
+};
+
+template <typename C, typename R, typename... A, R (C::*M)(A...) const>
+struct Method<R (C::*)(A...) const, M> {
+  struct Call {
+    R operator() (C *self, typename Arg<A>::type... a) const {
+      return (self->*M)(a...);
+    }
+  };
+  static int cfunction (inlua_State *L) {
+    return Invoke<R, Call, C *, typename Arg<A>::type...>::cfunction(L);
+  }
+};
+
+
+// userdata holding a C++ object of class T; dropping its metatable marks it
+// destroyed, so that methods (and a second call) reject it afterwards
+template <typename T> int destroy (inlua_State *L) {
+  Stack<T *>::check(L, 1)->~T();
+  inlua_pushnil(L);
+  inlua_setmetatable(L, 1);
+  return 0;
+}
+
+// creates the metatable of class T; `methods' are reached through __index,
+// in a table of their own, so that scripts cannot call __gc as a method
+template <typename T>
+void registerclass (inlua_State *L, const char *name,
+                    const inluaL_Reg *methods) {
+  classname<T>() = name;
+  inluaL_newmetatable(L, name);
+  inlua_pushcfunction(L, destroy<T>);
+  inlua_setfield(L, -2, "__gc");
+  inlua_newtable(L);
+  if (methods != NULL) inluaL_register(L, NULL, methods);
+  inlua_setfield(L, -2, "__index");
+  inlua_pop(L, 1);
+}
+
+// pushes a new object of class T, built in place from `x'
+template <typename T, typename... X>
+T *newuserdata (inlua_State *L, X &&... x) {
+  const char *name = checkclassname<T>(L);
+  T *o = new (inlua_newuserdata(L, sizeof(T))) T(std::forward<X>(x)...);
+  inluaL_getmetatable(L, name);  // after construction succeeded
+  inlua_setmetatable(L, -2);
+  return o;
+}
+
+
+// restores the stack top when leaving a scope
+class StackGuard {
+ public:
+  explicit StackGuard (inlua_State *L) : L(L), top(inlua_gettop(L)) {}
+  ~StackGuard () { inlua_settop(L, top); }
+ private:
+  StackGuard (const StackGuard &);
+  StackGuard &operator= (const StackGuard &);
+  inlua_State *L;
+  int top;
+};
+
+}  // namespace inlua
+
+#define INLUA_FUNCTION(f)	(&inlua::Function<decltype(&f), &f>::cfunction)
+#define INLUA_METHOD(m)		(&inlua::Method<decltype(m), m>::cfunction)
+
+#endif
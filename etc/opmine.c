@@ -0,0 +1,86 @@
+/*
+* opmine.c -- mine opcode bigrams from an execution trace.
+* Build the core with -DINLUA_USE_OPTRACE, run a workload with the
+* environment variable INLUA_OPTRACE naming the trace file, and then
+* run "opmine tracefile [n]" to list the n most frequent opcodes and
+* opcode pairs. Pairs that dominate the list are candidates for fused
+* instructions (see OP_GETTABLEOP and friends in lopcodes.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INLUA_CORE
+
+#include "inlua.h"
+#include "lopcodes.h"
+
+typedef struct Entry
+{
+ int a,b;
+ unsigned long n;
+} Entry;
+
+static unsigned long single[NUM_OPCODES];
+static unsigned long pair[NUM_OPCODES][NUM_OPCODES];
+static Entry list[NUM_OPCODES*NUM_OPCODES];
+
+static int compare(const void* x, const void* y)
+{
+ const Entry* a=(const Entry*)x;
+ const Entry* b=(const Entry*)y;
+ return (a->n<b->n) - (a->n>b->n);
+}
+
+static double percent(unsigned long n, unsigned long total)
+{
+ return total ? 100.0*(double)n/(double)total : 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+ FILE* f;
+ int c,prev=-1,a,b,n,top;
+ unsigned long total=0;
+ if (argc<2)
+ {
+  fprintf(stderr,"usage: %s tracefile [n]\n",argv[0]);
+  return EXIT_FAILURE;
+ }
+ top=(argc>2) ? atoi(argv[2]) : 20;
+ f=fopen(argv[1],"rb");
+ if (f==NULL)
+ {
+  perror(argv[1]);
+  return EXIT_FAILURE;
+ }
+ while ((c=getc(f))!=EOF)
+ {
+  if (c>=NUM_OPCODES) { prev=-1; continue; }
+  single[c]++;
+  if (prev>=0) pair[prev][c]++;
+  prev=c;
+  total++;
+ }
+ fclose(f);
+ for (n=0,a=0; a<NUM_OPCODES; a++)
+ {
+  list[n].a=a; list[n].b=-1; list[n].n=single[a]; n++;
+ }
+ qsort(list,n,sizeof(Entry),compare);
+ printf("%lu instructions\n\nopcodes:\n",total);
+ for (a=0; a<n && a<top && list[a].n>0; a++)
+  printf("%12lu %6.2f%%  %s\n",list[a].n,percent(list[a].n,total),
+	luaP_opnames[list[a].a]);
+ for (n=0,a=0; a<NUM_OPCODES; a++)
+  for (b=0; b<NUM_OPCODES; b++)
+  {
+   list[n].a=a; list[n].b=b; list[n].n=pair[a][b]; n++;
+  }
+ qsort(list,n,sizeof(Entry),compare);
+ printf("\nbigrams:\n");
+ for (a=0; a<n && a<top && list[a].n>0; a++)
+  printf("%12lu %6.2f%%  %-9s %s\n",list[a].n,percent(list[a].n,total),
+	luaP_opnames[list[a].a],luaP_opnames[list[a].b]);
+ return EXIT_SUCCESS;
+}
@@ -78,6 +78,11 @@ INLUALIB_API int (inluaL_loadfile) (inlua_State *L, const char *filename);
 INLUALIB_API int (inluaL_loadbuffer) (inlua_State *L, const char *buff, size_t sz,
                                   const char *name);
 INLUALIB_API int (inluaL_loadstring) (inlua_State *L, const char *s);
+INLUALIB_API int (inluaL_loaddata) (inlua_State *L, const char *buff, size_t sz,
+                                const char *name);
+INLUALIB_API int (inluaL_loadfiles) (inlua_State *L,
+                                 const char *const *filenames, int n,
+                                 int nthreads);
 
 INLUALIB_API inlua_State *(inluaL_newstate) (void);
 
@@ -62,6 +62,12 @@ typedef const char * (*inlua_Reader) (inlua_State *L, void *ud, size_t *sz);
 typedef int (*inlua_Writer) (inlua_State *L, const void* p, size_t sz, void* ud);
 
 
+/*
+** function that gives back the bytes of an external string
+*/
+typedef void (*inlua_Release) (void *ud, const char *s, size_t sz);
+
+
 /*
 ** prototype for memory-allocation functions
 */
@@ -84,6 +90,15 @@ typedef void * (*inlua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 #define INLUA_TTHREAD		8
 
 
+/*
+** element types of typed arrays (ORDER INLUA_ARRAY)
+*/
+#define INLUA_ARRAYF64		1
+#define INLUA_ARRAYF32		2
+#define INLUA_ARRAYI32		3
+#define INLUA_ARRAYU8		4
+
+
 
 /* minimum Lua stack available to a C function */
 #define INLUA_MINSTACK	20
@@ -152,6 +167,8 @@ INLUA_API const char     *(inlua_tolstring) (inlua_State *L, int idx, size_t *le
 INLUA_API size_t          (inlua_objlen) (inlua_State *L, int idx);
 INLUA_API inlua_CFunction   (inlua_tocfunction) (inlua_State *L, int idx);
 INLUA_API void	       *(inlua_touserdata) (inlua_State *L, int idx);
+INLUA_API void	       *(inlua_toarray) (inlua_State *L, int idx, int *type,
+                                         size_t *n);
 INLUA_API inlua_State      *(inlua_tothread) (inlua_State *L, int idx);
 INLUA_API const void     *(inlua_topointer) (inlua_State *L, int idx);
 
@@ -164,6 +181,9 @@ INLUA_API void  (inlua_pushnumber) (inlua_State *L, inlua_Number n);
 INLUA_API void  (inlua_pushinteger) (inlua_State *L, inlua_Integer n);
 INLUA_API void  (inlua_pushlstring) (inlua_State *L, const char *s, size_t l);
 INLUA_API void  (inlua_pushstring) (inlua_State *L, const char *s);
+INLUA_API const char *(inlua_pushexternalstring) (inlua_State *L,
+                          const char *s, size_t l, inlua_Release release,
+                          void *ud);
 INLUA_API const char *(inlua_pushvfstring) (inlua_State *L, const char *fmt,
                                                       va_list argp);
 INLUA_API const char *(inlua_pushfstring) (inlua_State *L, const char *fmt, ...);
@@ -180,8 +200,15 @@ INLUA_API void  (inlua_gettable) (inlua_State *L, int idx);
 INLUA_API void  (inlua_getfield) (inlua_State *L, int idx, const char *k);
 INLUA_API void  (inlua_rawget) (inlua_State *L, int idx);
 INLUA_API void  (inlua_rawgeti) (inlua_State *L, int idx, int n);
+INLUA_API int   (inlua_getnumbers) (inlua_State *L, int idx, inlua_Number *a,
+                                    int n);
+INLUA_API int   (inlua_getintegers) (inlua_State *L, int idx,
+                                     inlua_Integer *a, int n);
+INLUA_API int   (inlua_getstrings) (inlua_State *L, int idx, const char **a,
+                                    int n);
 INLUA_API void  (inlua_createtable) (inlua_State *L, int narr, int nrec);
 INLUA_API void *(inlua_newuserdata) (inlua_State *L, size_t sz);
+INLUA_API void *(inlua_newarray) (inlua_State *L, int type, size_t n);
 INLUA_API int   (inlua_getmetatable) (inlua_State *L, int objindex);
 INLUA_API void  (inlua_getfenv) (inlua_State *L, int idx);
 
@@ -193,6 +220,12 @@ INLUA_API void  (inlua_settable) (inlua_State *L, int idx);
 INLUA_API void  (inlua_setfield) (inlua_State *L, int idx, const char *k);
 INLUA_API void  (inlua_rawset) (inlua_State *L, int idx);
 INLUA_API void  (inlua_rawseti) (inlua_State *L, int idx, int n);
+INLUA_API void  (inlua_setnumbers) (inlua_State *L, int idx,
+                                    const inlua_Number *a, int n);
+INLUA_API void  (inlua_setintegers) (inlua_State *L, int idx,
+                                     const inlua_Integer *a, int n);
+INLUA_API void  (inlua_setstrings) (inlua_State *L, int idx,
+                                    const char *const *a, int n);
 INLUA_API int   (inlua_setmetatable) (inlua_State *L, int objindex);
 INLUA_API int   (inlua_setfenv) (inlua_State *L, int idx);
 
@@ -205,9 +238,16 @@ INLUA_API int   (inlua_pcall) (inlua_State *L, int nargs, int nresults, int errf
 INLUA_API int   (inlua_cpcall) (inlua_State *L, inlua_CFunction func, void *ud);
 INLUA_API int   (inlua_load) (inlua_State *L, inlua_Reader reader, void *dt,
                                         const char *chunkname);
+INLUA_API int   (inlua_loaddata) (inlua_State *L, inlua_Reader reader, void *dt,
+                                            const char *chunkname);
 
 INLUA_API int (inlua_dump) (inlua_State *L, inlua_Writer writer, void *data);
 
+#if defined(INLUA_USE_STATS)
+INLUA_API int (inlua_dumpstats) (inlua_State *L, inlua_Writer writer,
+                                 void *data);
+#endif
+
 
 /*
 ** coroutine functions
@@ -228,10 +268,41 @@ INLUA_API int  (inlua_status) (inlua_State *L);
 #define INLUA_GCSTEP		5
 #define INLUA_GCSETPAUSE		6
 #define INLUA_GCSETSTEPMUL	7
+#define INLUA_GCASYNCFREE	8
+#define INLUA_GCTELEMETRY	9
+#define INLUA_GCSETPAUSETARGET	10
+#define INLUA_GCSETGROWTH	11
 
 INLUA_API int (inlua_gc) (inlua_State *L, int what, int data);
 
 
+/*
+** collector telemetry: times are recorded only while INLUA_GCTELEMETRY
+** is on; objects and bytes are counted by each call to inlua_gcstats
+*/
+
+/* phases (ORDER INLUA_GCP): propagate, atomic, sweepstring, sweep, finalize */
+#define INLUA_GCPHASES		5
+/* kinds of objects: string, table, function, userdata, thread, proto,
+   upvalue */
+#define INLUA_GCKINDS		7
+/* step times: under 1us, under 2us, ..., under 2^14us, longer */
+#define INLUA_GCHISTSIZE	16
+
+typedef struct inlua_GCStats {
+  double phasetime[INLUA_GCPHASES];  /* seconds spent in each phase */
+  double pausetotal;  /* seconds spent in steps and full collections */
+  double pausemax;  /* longest of them */
+  unsigned long pauses;  /* how many there were */
+  unsigned long histogram[INLUA_GCHISTSIZE];  /* of their times */
+  unsigned long cycles;  /* cycles finished */
+  unsigned long objects[INLUA_GCKINDS];  /* objects in the heap */
+  size_t bytes[INLUA_GCKINDS];  /* memory used by them */
+} inlua_GCStats;
+
+INLUA_API void (inlua_gcstats) (inlua_State *L, inlua_GCStats *s);
+
+
 /*
 ** miscellaneous functions
 */
@@ -344,6 +415,10 @@ INLUA_API inlua_Hook inlua_gethook (inlua_State *L);
 INLUA_API int inlua_gethookmask (inlua_State *L);
 INLUA_API int inlua_gethookcount (inlua_State *L);
 
+INLUA_API int inlua_gethotspots (inlua_State *L, int n);
+INLUA_API int inlua_heapsnapshot (inlua_State *L, inlua_Writer writer,
+                                  void *data);
+
 
 struct inlua_Debug {
   int event;
@@ -358,6 +433,7 @@ struct inlua_Debug {
   char short_src[INLUA_IDSIZE]; /* (S) */
   /* private part */
   int i_ci;  /* active function */
+  int i_inl;  /* inlined call it runs, or -1 for the function itself */
 };
 
 /* }====================================================================== */
@@ -313,6 +313,59 @@
 #define INLUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 
 
+/*
+@@ INLUAI_GCGROWTH is the default heap-growth budget of the pause-target
+@* mode, as a percentage of the memory in use after the last collection.
+** CHANGE it if you can afford more (or less) memory. In that mode, set
+** with collectgarbage("setpausetarget", microseconds), each step runs
+** for about that long instead of doing INLUAI_GCMUL work, and cycles
+** are paced so that they end before the heap passes the budget; if it
+** does pass it, steps come more often but do not get longer. Marking a
+** single table or thread, and the atomic phase, cannot be split, so
+** steps that do that can still exceed the target.
+*/
+#define INLUAI_GCGROWTH	200
+
+
+/*
+@@ INLUA_USE_PARALLELGC gives the collector a helper thread, which frees
+@* the blocks of dead objects while the program runs.
+** CHANGE it (define INLUA_USE_PARALLELGC) if you have POSIX threads and
+** sweep steps spend too long in the allocator. Link with -lpthread.
+*/
+/* #define INLUA_USE_PARALLELGC */
+
+#if defined(INLUA_USE_PARALLELGC) && !defined(INLUA_USE_POSIX)
+#undef INLUA_USE_PARALLELGC
+#endif
+
+
+/*
+@@ INLUA_USE_PARALLELLOAD makes inluaL_loadfiles compile its files on
+@* several threads.
+** CHANGE it (define INLUA_USE_PARALLELLOAD) if you have POSIX threads and
+** load many files at start-up. Link with -lpthread. Each thread compiles
+** into a state of its own and the results are undumped into the calling
+** state, so that part stays serial; a file is worth sending to another
+** thread only if compiling it costs more than undumping it.
+*/
+/* #define INLUA_USE_PARALLELLOAD */
+
+#if defined(INLUA_USE_PARALLELLOAD) && !defined(INLUA_USE_POSIX)
+#undef INLUA_USE_PARALLELLOAD
+#endif
+
+
+/*
+@@ INLUAI_GCFREEBATCH is the number of blocks freed by sweep steps that
+@* the helper of INLUA_USE_PARALLELGC gives back to the allocator at once.
+** CHANGE it if you want the helper to be woken up more or less often.
+** Blocks are freed this way only if the host says that its allocator is
+** thread-safe (inlua_gc(L, INLUA_GCASYNCFREE, 1); inluaL_newstate does).
+*/
+#define INLUAI_GCFREEBATCH	512
+
+
 
 /*
 @@ INLUA_COMPAT_GETN controls compatibility with old getn behavior.
@@ -470,9 +523,11 @@
 
 /*
 @@ INLUAI_MAXVARS is the maximum number of local variables per function
-@* (must be smaller than 250).
+@* (must be smaller than 256). Variables declared in blocks nested in
+@* expressions count here, but the registers all of them use are limited
+@* separately, to MAXSTACK.
 */
-#define INLUAI_MAXVARS		200
+#define INLUAI_MAXVARS		250
 
 
 /*
@@ -482,11 +537,69 @@
 #define INLUAI_MAXUPVALUES	60
 
 
+/*
+@@ INLUAI_INLINESIZE is the largest function literal, in instructions,
+@* whose calls the compiler replaces by a copy of its code.
+@@ INLUAI_MAXINLINE is the maximum number of such calls per function.
+** CHANGE INLUAI_INLINESIZE to 0 to turn inlining off. Only functions
+** without upvalues or varargs, kept in a local variable that is never
+** used but to call them, are inlined (see luaK_inline in lcode.c).
+*/
+#define INLUAI_INLINESIZE	20
+#define INLUAI_MAXINLINE	32
+
+
+/*
+@@ INLUAI_MAXCONSTS is the maximum number of local variables per function
+@* that the compiler may replace by their values.
+** CHANGE it if your functions declare more constants. A variable declared
+** alone with a constant value (`@N = 1024'), or with arithmetic on such
+** variables, and never assigned again, is compiled as that value where
+** it is used (see luaK_constants in lcode.c).
+*/
+#define INLUAI_MAXCONSTS	64
+
+
+/*
+@@ INLUAI_MAXCAPTURES is the maximum number of local variables per
+@* function whose closures may copy their values in.
+** CHANGE it if your functions have more variables used by closures. A
+** variable that is never assigned while it is active is given to the
+** closures that use it by value, without an upvalue shared with the
+** stack (see luaK_captures in lcode.c). Other variables are shared.
+*/
+#define INLUAI_MAXCAPTURES	64
+
+
+/*
+@@ INLUAI_SWITCHMIN is the shortest chain of equality tests of a variable
+@* against constants (`x == 1 & (...) | x == 2 & (...) | ...') that the
+@* compiler gives a jump table (see luaK_switches in lcode.c).
+** CHANGE it if your chains are mostly shorter or longer. Below it, the
+** tests one by one are faster than looking the value up in a table. The
+** JIT always runs the tests, which are cheap in machine code.
+*/
+#define INLUAI_SWITCHMIN	6
+
+
 /*
 @@ INLUAL_BUFFERSIZE is the buffer size used by the lauxlib buffer system.
 */
 #define INLUAL_BUFFERSIZE		BUFSIZ
 
+
+/*
+@@ INLUA_USE_MMAP makes inluaL_loadfile map source files into memory.
+** The lexer scans tokens in place while they are within one piece of
+** the source, so a mapped file (one piece) loads faster than one read
+** in pieces of INLUAL_BUFFERSIZE bytes. Files that fit in one such piece
+** are still read. It is on with INLUA_USE_POSIX.
+** CHANGE it (undefine it) if your system has no mmap.
+*/
+#if defined(INLUA_USE_POSIX)
+#define INLUA_USE_MMAP
+#endif
+
 /* }================================================================== */
 
 
@@ -728,6 +841,56 @@ union luai_Cast { double l_d; long l_l; };
 #define inluai_userstateyield(L,n)	((void)L)
 
 
+/*
+@@ INLUA_USE_OPTRACE makes the interpreter append the opcode of every
+@* executed instruction (one byte each) to the file named by the
+@* environment variable INLUA_OPTRACE.
+** CHANGE it (define it) if you want to mine opcode sequences before
+** touching the instruction set (see etc/opmine.c). It slows down the
+** interpreter considerably, so never define it for production builds.
+*/
+/* #define INLUA_USE_OPTRACE */
+
+
+/*
+@@ INLUA_USE_STATS makes the core count executed opcodes, table reads
+@* (hits, misses and metamethods), string interning (hits and new strings)
+@* and bytes allocated by object type. The stand-alone interpreter writes
+@* them as JSON, at exit, to the file named by the environment variable
+@* INLUA_STATS ("-" means stderr).
+** CHANGE it (define it) if you want to see where a script spends its
+** time before tuning it. When it is not defined the counters do not
+** exist at all. The JIT is turned off in such builds, because machine
+** code does not count opcodes.
+*/
+/* #define INLUA_USE_STATS */
+
+
+/*
+@@ INLUA_USE_JIT turns on the baseline JIT compiler (ljit.c), which
+@* translates hot Lua functions into x86-64 machine code.
+@@ INLUAI_JITHOT is the number of calls after which a function is compiled.
+@@ INLUAI_JITHOTLOOP is the number of iterations of a single loop after
+@* which its function is compiled (and the loop goes on in machine code).
+@@ INLUAI_JITMAXCODE is the size (in instructions) of the largest function
+@* the JIT compiles.
+** CHANGE them (define INLUA_USE_JIT) if you want the JIT. It needs an
+** x86-64 POSIX system (System V calling convention and mmap), so it is
+** turned off on any other platform.
+*/
+/* #define INLUA_USE_JIT */
+
+#if defined(INLUA_USE_JIT) && \
+    (!(defined(__x86_64__) && defined(INLUA_USE_POSIX)) || \
+     defined(INLUA_USE_STATS))
+#undef INLUA_USE_JIT
+#endif
+
+#define INLUAI_JITHOT		50
+#define INLUAI_JITHOTLOOP	1000
+#define INLUAI_JITMAXCODE	20000
+
+
 /*
 @@ INLUA_INTFRMLEN is the length modifier for integer conversions
 @* in 'string.format'.
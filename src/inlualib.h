@@ -33,6 +33,10 @@ INLUALIB_API int (inluaopen_string) (inlua_State *L);
 #define INLUA_MATHLIBNAME	"math"
 INLUALIB_API int (inluaopen_math) (inlua_State *L);
 
+#define INLUA_ARRAYLIBNAME	"array"
+#define INLUA_ARRAYHANDLE	"array"
+INLUALIB_API int (inluaopen_array) (inlua_State *L);
+
 #define INLUA_DBLIBNAME	"debug"
 INLUALIB_API int (inluaopen_debug) (inlua_State *L);
 
@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 
 #define lapi_c
@@ -16,6 +17,7 @@
 #include "inlua.h"
 
 #include "lapi.h"
+#include "larray.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
@@ -362,7 +364,10 @@ INLUA_API size_t inlua_objlen (inlua_State *L, int idx) {
   StkId o = index2adr(L, idx);
   switch (ttype(o)) {
     case INLUA_TSTRING: return tsvalue(o)->len;
-    case INLUA_TUSERDATA: return uvalue(o)->len;
+    case INLUA_TUSERDATA: {  /* arrays give their elements, as `#' does */
+      Udata *u = rawuvalue(o);
+      return (u->uv.array) ? arraylen(u) : u->uv.len;
+    }
     case INLUA_TTABLE: return luaH_getn(hvalue(o));
     case INLUA_TNUMBER: {
       size_t l;
@@ -392,6 +397,18 @@ INLUA_API void *inlua_touserdata (inlua_State *L, int idx) {
 }
 
 
+INLUA_API void *inlua_toarray (inlua_State *L, int idx, int *type,
+                              size_t *n) {
+  StkId o = index2adr(L, idx);
+  Udata *u;
+  if (!isarray(o)) return NULL;
+  u = rawuvalue(o);
+  if (type) *type = u->uv.array;
+  if (n) *n = arraylen(u);
+  return arraydata(u);
+}
+
+
 INLUA_API inlua_State *inlua_tothread (inlua_State *L, int idx) {
   StkId o = index2adr(L, idx);
   return (!ttisthread(o)) ? NULL : thvalue(o);
@@ -451,6 +468,24 @@ INLUA_API void inlua_pushlstring (inlua_State *L, const char *s, size_t len) {
 }
 
 
+INLUA_API const char *inlua_pushexternalstring (inlua_State *L,
+                          const char *s, size_t len, inlua_Release release,
+                          void *ud) {
+  TString *ts;
+  lua_lock(L);
+  if (s[len] != '\0') {  /* the library reads strings as C strings too */
+    if (release) release(ud, s, len);
+    luaG_runerror(L, "external string not terminated by '\\0'");
+  }
+  ts = luaS_newextstr(L, s, len, release, ud);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);  /* after the string owns the buffer */
+  lua_unlock(L);
+  return getstr(ts);
+}
+
+
 INLUA_API void inlua_pushstring (inlua_State *L, const char *s) {
   if (s == NULL)
     inlua_pushnil(L);
@@ -575,6 +610,74 @@ INLUA_API void inlua_rawgeti (inlua_State *L, int idx, int n) {
 }
 
 
+/*
+** Bulk transfers between C arrays and t[1..n]. They stop at the first
+** element of another type and return how many were copied. Strings stay
+** valid while the table keeps them.
+*/
+
+static const TValue *arrayslot (Table *t, int i) {
+  return (i < t->sizearray) ? &t->array[i] : luaH_getnum(t, i+1);
+}
+
+
+INLUA_API int inlua_getnumbers (inlua_State *L, int idx, inlua_Number *a,
+                                int n) {
+  StkId o;
+  Table *t;
+  int i;
+  lua_lock(L);
+  o = index2adr(L, idx);
+  api_check(L, ttistable(o));
+  t = hvalue(o);
+  for (i = 0; i < n; i++) {
+    const TValue *v = arrayslot(t, i);
+    if (!ttisnumber(v)) break;
+    a[i] = nvalue(v);
+  }
+  lua_unlock(L);
+  return i;
+}
+
+
+INLUA_API int inlua_getintegers (inlua_State *L, int idx, inlua_Integer *a,
+                                 int n) {
+  StkId o;
+  Table *t;
+  int i;
+  lua_lock(L);
+  o = index2adr(L, idx);
+  api_check(L, ttistable(o));
+  t = hvalue(o);
+  for (i = 0; i < n; i++) {
+    const TValue *v = arrayslot(t, i);
+    if (!ttisnumber(v)) break;
+    inlua_number2integer(a[i], nvalue(v));
+  }
+  lua_unlock(L);
+  return i;
+}
+
+
+INLUA_API int inlua_getstrings (inlua_State *L, int idx, const char **a,
+                                int n) {
+  StkId o;
+  Table *t;
+  int i;
+  lua_lock(L);
+  o = index2adr(L, idx);
+  api_check(L, ttistable(o));
+  t = hvalue(o);
+  for (i = 0; i < n; i++) {
+    const TValue *v = arrayslot(t, i);
+    if (!ttisstring(v)) break;
+    a[i] = svalue(v);
+  }
+  lua_unlock(L);
+  return i;
+}
+
+
 INLUA_API void inlua_createtable (inlua_State *L, int narray, int nrec) {
   lua_lock(L);
   luaC_checkGC(L);
@@ -694,6 +797,58 @@ INLUA_API void inlua_rawseti (inlua_State *L, int idx, int n) {
 }
 
 
+/* array part of the table at `idx', grown to hold at least t[1..n] */
+static Table *arraytable (inlua_State *L, int idx, int n) {
+  StkId o = index2adr(L, idx);
+  Table *t;
+  api_check(L, ttistable(o));
+  api_check(L, n >= 0);
+  t = hvalue(o);
+  if (t->sizearray < n)
+    luaH_resizearray(L, t, n);
+  return t;
+}
+
+
+INLUA_API void inlua_setnumbers (inlua_State *L, int idx,
+                                 const inlua_Number *a, int n) {
+  Table *t;
+  int i;
+  lua_lock(L);
+  t = arraytable(L, idx, n);
+  for (i = 0; i < n; i++)
+    setnvalue(&t->array[i], a[i]);
+  lua_unlock(L);
+}
+
+
+INLUA_API void inlua_setintegers (inlua_State *L, int idx,
+                                  const inlua_Integer *a, int n) {
+  Table *t;
+  int i;
+  lua_lock(L);
+  t = arraytable(L, idx, n);
+  for (i = 0; i < n; i++)
+    setnvalue(&t->array[i], cast_num(a[i]));
+  lua_unlock(L);
+}
+
+
+INLUA_API void inlua_setstrings (inlua_State *L, int idx,
+                                 const char *const *a, int n) {
+  Table *t;
+  int i;
+  lua_lock(L);
+  luaC_checkGC(L);
+  t = arraytable(L, idx, n);
+  if (isblack(obj2gco(t)))  /* it will get white strings: gray it first */
+    luaC_barrierback(L, t);
+  for (i = 0; i < n; i++)
+    setsvalue(L, &t->array[i], luaS_new(L, a[i]));
+  lua_unlock(L);
+}
+
+
 INLUA_API int inlua_setmetatable (inlua_State *L, int objindex) {
   TValue *obj;
   Table *mt;
@@ -872,6 +1027,19 @@ INLUA_API int inlua_load (inlua_State *L, inlua_Reader reader, void *data,
 }
 
 
+INLUA_API int inlua_loaddata (inlua_State *L, inlua_Reader reader, void *data,
+                          const char *chunkname) {
+  ZIO z;
+  int status;
+  lua_lock(L);
+  if (!chunkname) chunkname = "?";
+  luaZ_init(L, &z, reader, data);
+  status = luaD_protecteddata(L, &z, chunkname);
+  lua_unlock(L);
+  return status;
+}
+
+
 INLUA_API int inlua_dump (inlua_State *L, inlua_Writer writer, void *data) {
   int status;
   TValue *o;
@@ -887,6 +1055,67 @@ INLUA_API int inlua_dump (inlua_State *L, inlua_Writer writer, void *data) {
 }
 
 
+#if defined(INLUA_USE_STATS)
+
+typedef struct StatsState {
+  inlua_State *L;
+  inlua_Writer writer;
+  void *data;
+  int status;
+} StatsState;
+
+
+static void statsput (StatsState *S, const char *s) {
+  if (S->status == 0) {
+    lua_unlock(S->L);
+    S->status = (*S->writer)(S->L, s, strlen(s), S->data);
+    lua_lock(S->L);
+  }
+}
+
+
+static void statsfield (StatsState *S, const char *key, unsigned long n,
+                        int last) {
+  char buff[80];
+  sprintf(buff, "\"%.40s\": %lu%s", key, n, last ? "" : ", ");
+  statsput(S, buff);
+}
+
+
+INLUA_API int inlua_dumpstats (inlua_State *L, inlua_Writer writer,
+                               void *data) {
+  static const int types[] = {INLUA_TSTRING, INLUA_TTABLE, INLUA_TFUNCTION,
+    INLUA_TUSERDATA, INLUA_TTHREAD, LUA_TPROTO, LUA_TUPVAL};
+  Stats *st = &G(L)->stats;
+  StatsState S;
+  int i;
+  lua_lock(L);
+  S.L = L;
+  S.writer = writer;
+  S.data = data;
+  S.status = 0;
+  statsput(&S, "{\n  \"opcodes\": {");
+  for (i = 0; i < NUM_OPCODES; i++)
+    statsfield(&S, luaP_opnames[i], st->opcodes[i], i == NUM_OPCODES - 1);
+  statsput(&S, "},\n  \"tables\": {");
+  statsfield(&S, "hit", st->gethit, 0);
+  statsfield(&S, "miss", st->getmiss, 0);
+  statsfield(&S, "metamethod", st->getmeta, 1);
+  statsput(&S, "},\n  \"strings\": {");
+  statsfield(&S, "hit", st->strhit, 0);
+  statsfield(&S, "new", st->strnew, 1);
+  statsput(&S, "},\n  \"alloc\": {");
+  for (i = 0; i < cast_int(sizeof(types)/sizeof(types[0])); i++)
+    statsfield(&S, luaT_typenames[types[i]], st->alloc[types[i]], 0);
+  statsfield(&S, "other", st->alloc[0], 1);
+  statsput(&S, "}\n}\n");
+  lua_unlock(L);
+  return S.status;
+}
+
+#endif
+
+
 INLUA_API int  inlua_status (inlua_State *L) {
   return L->status;
 }
@@ -948,6 +1177,30 @@ INLUA_API int inlua_gc (inlua_State *L, int what, int data) {
       g->gcstepmul = data;
       break;
     }
+    case INLUA_GCASYNCFREE: {
+#if defined(INLUA_USE_PARALLELGC)
+      res = g->gcasyncfree;
+      g->gcasyncfree = cast_byte(data != 0);
+#else
+      res = -1;  /* not available */
+#endif
+      break;
+    }
+    case INLUA_GCTELEMETRY: {
+      res = g->gctelemetry;
+      g->gctelemetry = cast_byte(data != 0);
+      break;
+    }
+    case INLUA_GCSETPAUSETARGET: {
+      res = g->gctarget;
+      luaC_settarget(L, (data > 0) ? data : 0);
+      break;
+    }
+    case INLUA_GCSETGROWTH: {
+      res = g->gcgrowth;
+      g->gcgrowth = (data > 100) ? data : 100;
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -956,6 +1209,15 @@ INLUA_API int inlua_gc (inlua_State *L, int what, int data) {
 
 
 
+INLUA_API void inlua_gcstats (inlua_State *L, inlua_GCStats *s) {
+  lua_lock(L);
+  *s = G(L)->gcstats;
+  luaC_countobjects(L, s);
+  lua_unlock(L);
+}
+
+
+
 /*
 ** miscellaneous functions
 */
@@ -1016,6 +1278,10 @@ INLUA_API inlua_Alloc inlua_getallocf (inlua_State *L, void **ud) {
 
 INLUA_API void inlua_setallocf (inlua_State *L, inlua_Alloc f, void *ud) {
   lua_lock(L);
+#if defined(INLUA_USE_PARALLELGC)
+  luaC_stophelper(L);  /* blocks freed so far go back to the old allocator */
+  G(L)->gcasyncfree = 0;  /* the new one may not be thread-safe */
+#endif
   G(L)->ud = ud;
   G(L)->frealloc = f;
   lua_unlock(L);
@@ -1034,6 +1300,23 @@ INLUA_API void *inlua_newuserdata (inlua_State *L, size_t size) {
 }
 
 
+INLUA_API void *inlua_newarray (inlua_State *L, int type, size_t n) {
+  Udata *u;
+  lua_lock(L);
+  api_check(L, INLUA_ARRAYF64 <= type && type <= INLUA_ARRAYU8);
+  luaC_checkGC(L);
+  if (n > MAX_SIZET / luaA_size[type])
+    luaM_toobig(L);
+  u = luaS_newudata(L, n * luaA_size[type], getcurrenv(L));
+  u->uv.array = cast_byte(type);
+  memset(arraydata(u), 0, u->uv.len);
+  setuvalue(L, L->top, u);
+  api_incr_top(L);
+  lua_unlock(L);
+  return arraydata(u);
+}
+
+
 
 
 static const char *aux_upvalue (StkId fi, int n, TValue **val) {
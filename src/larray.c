@@ -0,0 +1,85 @@
+/*
+** $Id: larray.c $
+** Typed arrays: userdata holding a C array of numbers
+** See Copyright Notice in inlua.h
+*/
+
+
+#define larray_c
+#define INLUA_CORE
+
+#include "inlua.h"
+
+#include "larray.h"
+#include "ldebug.h"
+#include "lobject.h"
+
+
+const lu_byte luaA_size[] = {  /* ORDER INLUA_ARRAY */
+  0, sizeof(double), sizeof(float), sizeof(int), sizeof(unsigned char)
+};
+
+
+/* position of numeric key `key' in `u', or -1 */
+static int elemindex (const Udata *u, const TValue *key) {
+  inlua_Number n = nvalue(key);
+  int k;
+  inlua_number2int(k, n);
+  if (inluai_numeq(cast_num(k), n) && k >= 1 && cast(size_t, k) <= arraylen(u))
+    return k - 1;
+  return -1;
+}
+
+
+/*
+** Reads `u[key]' into `res'. Returns 0, leaving the work to the metatable,
+** for keys that are not numbers; numbers out of range give nil.
+*/
+int luaA_get (const Udata *u, const TValue *key, TValue *res) {
+  const void *a = arraydata(u);
+  int k;
+  if (!ttisnumber(key)) return 0;
+  k = elemindex(u, key);
+  if (k < 0) {
+    setnilvalue(res);
+    return 1;
+  }
+  switch (u->uv.array) {
+    case INLUA_ARRAYF64: setnvalue(res, ((const double *)a)[k]); break;
+    case INLUA_ARRAYF32: setnvalue(res, ((const float *)a)[k]); break;
+    case INLUA_ARRAYI32: setnvalue(res, ((const int *)a)[k]); break;
+    default: setnvalue(res, ((const unsigned char *)a)[k]); break;
+  }
+  return 1;
+}
+
+
+/*
+** Stores `val' in `u[key]', converting it to the element type. Returns 0
+** for keys that are not numbers.
+*/
+int luaA_set (inlua_State *L, Udata *u, const TValue *key,
+              const TValue *val) {
+  void *a = arraydata(u);
+  inlua_Number n;
+  int k;
+  if (!ttisnumber(key)) return 0;
+  k = elemindex(u, key);
+  if (k < 0)
+    luaG_runerror(L, "array index out of range");
+  if (!ttisnumber(val))
+    luaG_runerror(L, "array elements must be numbers");
+  n = nvalue(val);
+  switch (u->uv.array) {
+    case INLUA_ARRAYF64: ((double *)a)[k] = cast(double, n); break;
+    case INLUA_ARRAYF32: ((float *)a)[k] = cast(float, n); break;
+    case INLUA_ARRAYI32: inlua_number2int(((int *)a)[k], n); break;
+    default: {
+      int b;
+      inlua_number2int(b, n);
+      ((unsigned char *)a)[k] = cast(unsigned char, b);
+      break;
+    }
+  }
+  return 1;
+}
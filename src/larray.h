@@ -0,0 +1,26 @@
+/*
+** $Id: larray.h $
+** Typed arrays: userdata holding a C array of numbers
+** See Copyright Notice in inlua.h
+*/
+
+#ifndef larray_h
+#define larray_h
+
+
+#include "lobject.h"
+
+
+#define isarray(o)	(ttisuserdata(o) && uvalue(o)->array)
+
+#define arraydata(u)	cast(void *, (u)+1)
+#define arraylen(u)	((u)->uv.len / luaA_size[(u)->uv.array])
+
+
+INLUAI_DATA const lu_byte luaA_size[];
+
+INLUAI_FUNC int luaA_get (const Udata *u, const TValue *key, TValue *res);
+INLUAI_FUNC int luaA_set (inlua_State *L, Udata *u, const TValue *key,
+                          const TValue *val);
+
+#endif
@@ -0,0 +1,591 @@
+/*
+** $Id: larraylib.c $
+** Library for typed arrays
+** See Copyright Notice in inlua.h
+*/
+
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define larraylib_c
+#define INLUA_LIB
+
+#include "inlua.h"
+
+#include "inlauxlib.h"
+#include "inlualib.h"
+
+
+/* the kernels are plain loops meant to be vectorized; GCC needs asking */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize ("tree-vectorize", "vect-cost-model=dynamic")
+#endif
+
+
+static const char *const typenames[] = {"f64", "f32", "i32", "u8", NULL};
+
+
+/* runs statement `S' with `T' defined as the element type `t' */
+#define FORTYPE(t,S) \
+  switch (t) { \
+    case INLUA_ARRAYF64: { typedef double T; S; break; } \
+    case INLUA_ARRAYF32: { typedef float T; S; break; } \
+    case INLUA_ARRAYI32: { typedef int T; S; break; } \
+    default: { typedef unsigned char T; S; break; } \
+  }
+
+
+typedef struct Array {
+  void *a;
+  size_t n;
+  int type;
+} Array;
+
+
+static Array checkarray (inlua_State *L, int narg) {
+  Array arr;
+  arr.a = inlua_toarray(L, narg, &arr.type, &arr.n);
+  if (arr.a == NULL) inluaL_typerror(L, narg, "array");
+  return arr;
+}
+
+
+static void *newarray (inlua_State *L, int type, size_t n) {
+  void *a = inlua_newarray(L, type, n);
+  inluaL_getmetatable(L, INLUA_ARRAYHANDLE);
+  inlua_setmetatable(L, -2);
+  return a;
+}
+
+
+/* array at `narg' if given, else a new one like `like'; pushes it */
+static Array optresult (inlua_State *L, int narg, const Array *like) {
+  Array res;
+  if (inlua_isnoneornil(L, narg)) {
+    res.a = newarray(L, like->type, like->n);
+    res.n = like->n;
+    res.type = like->type;
+  }
+  else {
+    res = checkarray(L, narg);
+    inluaL_argcheck(L, res.type == like->type && res.n == like->n, narg,
+                    "array of another type or length");
+    inlua_pushvalue(L, narg);
+  }
+  return res;
+}
+
+
+static double getelem (const Array *arr, size_t i) {
+  double v;
+  FORTYPE(arr->type, v = ((const T *)arr->a)[i]);
+  return v;
+}
+
+
+static void setelem (Array *arr, size_t i, double v) {
+  if (arr->type == INLUA_ARRAYI32 || arr->type == INLUA_ARRAYU8) {
+    int k;
+    inlua_number2int(k, v);
+    FORTYPE(arr->type, ((T *)arr->a)[i] = (T)k);
+  }
+  else
+    FORTYPE(arr->type, ((T *)arr->a)[i] = (T)v);
+}
+
+
+static int arr_new (inlua_State *L) {
+  int type = inluaL_checkoption(L, 1, NULL, typenames) + 1;
+  if (inlua_istable(L, 2)) {
+    Array arr;
+    size_t i;
+    arr.n = inlua_objlen(L, 2);
+    arr.type = type;
+    arr.a = newarray(L, type, arr.n);
+    if (type == INLUA_ARRAYF64 &&  /* try a bulk copy first */
+        inlua_getnumbers(L, 2, (inlua_Number *)arr.a, (int)arr.n) ==
+        (int)arr.n)
+      return 1;
+    for (i = 0; i < arr.n; i++) {
+      inlua_rawgeti(L, 2, (int)i + 1);
+      if (!inlua_isnumber(L, -1))
+        return inluaL_error(L, "element %d is not a number", (int)i + 1);
+      setelem(&arr, i, inlua_tonumber(L, -1));
+      inlua_pop(L, 1);
+    }
+  }
+  else {
+    inlua_Integer n = inluaL_checkinteger(L, 2);
+    inluaL_argcheck(L, n >= 0, 2, "negative size");
+    newarray(L, type, (size_t)n);
+  }
+  return 1;
+}
+
+
+static int arr_type (inlua_State *L) {
+  Array arr = checkarray(L, 1);
+  inlua_pushstring(L, typenames[arr.type - 1]);
+  return 1;
+}
+
+
+static int arr_totable (inlua_State *L) {
+  Array arr = checkarray(L, 1);
+  size_t i;
+  inlua_createtable(L, (int)arr.n, 0);
+  if (arr.type == INLUA_ARRAYF64)
+    inlua_setnumbers(L, -1, (const inlua_Number *)arr.a, (int)arr.n);
+  else {
+    for (i = 0; i < arr.n; i++) {
+      inlua_pushnumber(L, getelem(&arr, i));
+      inlua_rawseti(L, -2, (int)i + 1);
+    }
+  }
+  return 1;
+}
+
+
+/*
+** {======================================================
+** Bulk kernels. Each is a plain loop over one element type, which the
+** compiler vectorizes.
+** =======================================================
+*/
+
+
+/* i32 elements wrap around: their arithmetic is done as unsigned */
+#define BINARY(name,op) \
+static int name (inlua_State *L) { \
+  Array a = checkarray(L, 1); \
+  Array b = checkarray(L, 2); \
+  Array c; \
+  size_t i; \
+  inluaL_argcheck(L, a.type == b.type && a.n == b.n, 2, \
+                  "array of another type or length"); \
+  c = optresult(L, 3, &a); \
+  if (a.type == INLUA_ARRAYI32) { \
+    const unsigned int *x = (const unsigned int *)a.a; \
+    const unsigned int *y = (const unsigned int *)b.a; \
+    unsigned int *z = (unsigned int *)c.a; \
+    for (i = 0; i < a.n; i++) z[i] = x[i] op y[i]; \
+  } \
+  else FORTYPE(a.type, { \
+    const T *x = (const T *)a.a; \
+    const T *y = (const T *)b.a; \
+    T *z = (T *)c.a; \
+    for (i = 0; i < a.n; i++) z[i] = (T)(x[i] op y[i]); \
+  }); \
+  return 1; \
+}
+
+BINARY(arr_add, +)
+BINARY(arr_sub, -)
+BINARY(arr_mul, *)
+
+
+static int arr_scale (inlua_State *L) {
+  Array a = checkarray(L, 1);
+  double s = (double)inluaL_checknumber(L, 2);
+  Array c = optresult(L, 3, &a);
+  size_t i;
+  switch (a.type) {
+    case INLUA_ARRAYF64: {
+      const double *x = (const double *)a.a;
+      double *z = (double *)c.a;
+      for (i = 0; i < a.n; i++) z[i] = x[i] * s;
+      break;
+    }
+    case INLUA_ARRAYF32: {
+      const float *x = (const float *)a.a;
+      float *z = (float *)c.a;
+      float fs = (float)s;
+      for (i = 0; i < a.n; i++) z[i] = x[i] * fs;
+      break;
+    }
+    default: {  /* integers are rounded like stores */
+      for (i = 0; i < a.n; i++) setelem(&c, i, getelem(&a, i) * s);
+      break;
+    }
+  }
+  return 1;
+}
+
+
+/* sums with four accumulators, so that the adds can run in parallel */
+static int arr_sum (inlua_State *L) {
+  Array a = checkarray(L, 1);
+  double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  size_t i = 0;
+  FORTYPE(a.type, {
+    const T *x = (const T *)a.a;
+    for (; i + 4 <= a.n; i += 4) {
+      s0 += x[i]; s1 += x[i+1]; s2 += x[i+2]; s3 += x[i+3];
+    }
+    for (; i < a.n; i++) s0 += x[i];
+  });
+  inlua_pushnumber(L, (s0 + s1) + (s2 + s3));
+  return 1;
+}
+
+
+static int arr_dot (inlua_State *L) {
+  Array a = checkarray(L, 1);
+  Array b = checkarray(L, 2);
+  double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  size_t i = 0;
+  inluaL_argcheck(L, a.type == b.type && a.n == b.n, 2,
+                  "array of another type or length");
+  FORTYPE(a.type, {
+    const T *x = (const T *)a.a;
+    const T *y = (const T *)b.a;
+    for (; i + 4 <= a.n; i += 4) {
+      s0 += (double)x[i] * y[i];
+      s1 += (double)x[i+1] * y[i+1];
+      s2 += (double)x[i+2] * y[i+2];
+      s3 += (double)x[i+3] * y[i+3];
+    }
+    for (; i < a.n; i++) s0 += (double)x[i] * y[i];
+  });
+  inlua_pushnumber(L, (s0 + s1) + (s2 + s3));
+  return 1;
+}
+
+
+#define MINMAX(name,cmp) \
+static int name (inlua_State *L) { \
+  Array a = checkarray(L, 1); \
+  size_t i; \
+  if (a.n == 0) return 0; \
+  FORTYPE(a.type, { \
+    const T *x = (const T *)a.a; \
+    T m = x[0]; \
+    for (i = 1; i < a.n; i++) m = (x[i] cmp m) ? x[i] : m; \
+    inlua_pushnumber(L, (inlua_Number)m); \
+  }); \
+  return 1; \
+}
+
+MINMAX(arr_min, <)
+MINMAX(arr_max, >)
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Compiled expressions for `map'. An expression over `x' (the element)
+** and `i' (its index) becomes a postfix program, which runs over blocks
+** of elements: every operation is a loop over a whole block.
+** =======================================================
+*/
+
+
+#define MAXCODE		64
+#define MAXDEPTH	16
+#define BLOCK		256
+
+
+enum {  /* ORDER: pushes, unary, binary */
+  E_PX, E_PI, E_PK, E_NEG, E_ABS, E_SQRT, E_FLOOR, E_CEIL,
+  E_ADD, E_SUB, E_MUL, E_DIV, E_POW, E_MIN, E_MAX
+};
+
+typedef struct Expr {
+  inlua_State *L;
+  const char *src;  /* whole expression, for messages */
+  const char *s;  /* current position */
+  int code[MAXCODE];
+  double k[MAXCODE];
+  int ncode;
+  int depth;  /* values on the stack */
+} Expr;
+
+
+static const struct {
+  const char *name;
+  int op, nargs;
+} functions[] = {
+  {"abs", E_ABS, 1}, {"sqrt", E_SQRT, 1}, {"floor", E_FLOOR, 1},
+  {"ceil", E_CEIL, 1}, {"min", E_MIN, 2}, {"max", E_MAX, 2}, {NULL, 0, 0}
+};
+
+
+static void m_error (Expr *e, const char *msg) {
+  inluaL_error(e->L, "bad expression " INLUA_QS " at position %d: %s",
+               e->src, (int)(e->s - e->src) + 1, msg);
+}
+
+
+static void m_emit (Expr *e, int op, double k) {
+  if (e->ncode >= MAXCODE) m_error(e, "too long");
+  e->k[e->ncode] = k;
+  e->code[e->ncode++] = op;
+  if (op <= E_PK) {  /* pushes a value */
+    if (++e->depth > MAXDEPTH) m_error(e, "too complex");
+  }
+  else if (op >= E_ADD)  /* binary operation */
+    e->depth--;
+}
+
+
+static int m_peek (Expr *e) {
+  while (isspace((unsigned char)*e->s)) e->s++;
+  return *e->s;
+}
+
+
+static void m_expect (Expr *e, int c) {
+  if (m_peek(e) != c) {
+    char msg[] = "'?' expected";
+    msg[1] = (char)c;
+    m_error(e, msg);
+  }
+  e->s++;
+}
+
+
+static void m_expr (Expr *e);
+
+static void m_primary (Expr *e) {
+  int c = m_peek(e);
+  if (isdigit((unsigned char)c) || c == '.') {
+    char *end;
+    double k = strtod(e->s, &end);
+    if (end == e->s) m_error(e, "malformed number");
+    e->s = end;
+    m_emit(e, E_PK, k);
+  }
+  else if (isalpha((unsigned char)c)) {
+    const char *name = e->s;
+    size_t len;
+    int f;
+    while (isalnum((unsigned char)*e->s)) e->s++;
+    len = e->s - name;
+    if (len == 1 && (*name == 'x' || *name == 'i')) {
+      m_emit(e, (*name == 'x') ? E_PX : E_PI, 0);
+      return;
+    }
+    for (f = 0; functions[f].name; f++)
+      if (strlen(functions[f].name) == len &&
+          memcmp(functions[f].name, name, len) == 0) break;
+    if (functions[f].name == NULL) m_error(e, "unknown name");
+    m_expect(e, '(');
+    m_expr(e);
+    if (functions[f].nargs == 2) {
+      m_expect(e, ',');
+      m_expr(e);
+    }
+    m_expect(e, ')');
+    m_emit(e, functions[f].op, 0);
+  }
+  else if (c == '(') {
+    e->s++;
+    m_expr(e);
+    m_expect(e, ')');
+  }
+  else m_error(e, "unexpected symbol");
+}
+
+
+static void m_power (Expr *e) {
+  m_primary(e);
+  if (m_peek(e) == '^') {  /* right associative */
+    e->s++;
+    if (m_peek(e) == '-') {
+      e->s++;
+      m_power(e);
+      m_emit(e, E_NEG, 0);
+    }
+    else m_power(e);
+    m_emit(e, E_POW, 0);
+  }
+}
+
+
+static void m_unary (Expr *e) {
+  if (m_peek(e) == '-') {
+    e->s++;
+    m_unary(e);
+    m_emit(e, E_NEG, 0);
+  }
+  else m_power(e);
+}
+
+
+static void m_term (Expr *e) {
+  m_unary(e);
+  for (;;) {
+    int c = m_peek(e);
+    if (c != '*' && c != '/') return;
+    e->s++;
+    m_unary(e);
+    m_emit(e, (c == '*') ? E_MUL : E_DIV, 0);
+  }
+}
+
+
+static void m_expr (Expr *e) {
+  m_term(e);
+  for (;;) {
+    int c = m_peek(e);
+    if (c != '+' && c != '-') return;
+    e->s++;
+    m_term(e);
+    m_emit(e, (c == '+') ? E_ADD : E_SUB, 0);
+  }
+}
+
+
+static void m_compile (inlua_State *L, Expr *e, const char *src) {
+  e->L = L;
+  e->src = e->s = src;
+  e->ncode = e->depth = 0;
+  m_expr(e);
+  if (m_peek(e) != '\0') m_error(e, "unexpected symbol");
+}
+
+
+#define R	st[sp]  /* top of the stack */
+#define Q	st[sp-1]  /* value below it */
+
+/* runs `e' over elements [i0, i0+n) of `a' into `c' */
+static void runblock (const Expr *e, const Array *a, Array *c, size_t i0,
+                      int n) {
+  double st[MAXDEPTH][BLOCK];
+  int pc, sp = -1, j;
+  for (pc = 0; pc < e->ncode; pc++) {
+    switch (e->code[pc]) {
+      case E_PX: {
+        double *d = st[++sp];
+        FORTYPE(a->type, {
+          const T *x = (const T *)a->a + i0;
+          for (j = 0; j < n; j++) d[j] = x[j];
+        });
+        break;
+      }
+      case E_PI: {
+        double *d = st[++sp];
+        for (j = 0; j < n; j++) d[j] = (double)(i0 + j + 1);
+        break;
+      }
+      case E_PK: {
+        double *d = st[++sp];
+        double k = e->k[pc];
+        for (j = 0; j < n; j++) d[j] = k;
+        break;
+      }
+      case E_ADD: for (j = 0; j < n; j++) Q[j] += R[j]; sp--; break;
+      case E_SUB: for (j = 0; j < n; j++) Q[j] -= R[j]; sp--; break;
+      case E_MUL: for (j = 0; j < n; j++) Q[j] *= R[j]; sp--; break;
+      case E_DIV: for (j = 0; j < n; j++) Q[j] /= R[j]; sp--; break;
+      case E_POW:
+        for (j = 0; j < n; j++) Q[j] = pow(Q[j], R[j]);
+        sp--;
+        break;
+      case E_MIN:
+        for (j = 0; j < n; j++) Q[j] = (R[j] < Q[j]) ? R[j] : Q[j];
+        sp--;
+        break;
+      case E_MAX:
+        for (j = 0; j < n; j++) Q[j] = (R[j] > Q[j]) ? R[j] : Q[j];
+        sp--;
+        break;
+      case E_NEG: for (j = 0; j < n; j++) R[j] = -R[j]; break;
+      case E_ABS: for (j = 0; j < n; j++) R[j] = fabs(R[j]); break;
+      case E_SQRT: for (j = 0; j < n; j++) R[j] = sqrt(R[j]); break;
+      case E_FLOOR: for (j = 0; j < n; j++) R[j] = floor(R[j]); break;
+      case E_CEIL: for (j = 0; j < n; j++) R[j] = ceil(R[j]); break;
+    }
+  }
+  switch (c->type) {
+    case INLUA_ARRAYF64: {
+      double *z = (double *)c->a + i0;
+      for (j = 0; j < n; j++) z[j] = st[0][j];
+      break;
+    }
+    case INLUA_ARRAYF32: {
+      float *z = (float *)c->a + i0;
+      for (j = 0; j < n; j++) z[j] = (float)st[0][j];
+      break;
+    }
+    default: {
+      for (j = 0; j < n; j++) setelem(c, i0 + j, st[0][j]);
+      break;
+    }
+  }
+}
+
+#undef R
+#undef Q
+
+
+/* map(a, f [, c]): c[i] = f(a[i], i), `f' being an expression or function */
+static int arr_map (inlua_State *L) {
+  Array a = checkarray(L, 1);
+  Array c;
+  size_t i;
+  if (inlua_isfunction(L, 2)) {
+    c = optresult(L, 3, &a);
+    for (i = 0; i < a.n; i++) {
+      inlua_pushvalue(L, 2);
+      inlua_pushnumber(L, getelem(&a, i));
+      inlua_pushinteger(L, (inlua_Integer)i + 1);
+      inlua_call(L, 2, 1);
+      if (!inlua_isnumber(L, -1))
+        return inluaL_error(L, "function must return a number");
+      setelem(&c, i, inlua_tonumber(L, -1));
+      inlua_pop(L, 1);
+    }
+  }
+  else {
+    Expr e;
+    m_compile(L, &e, inluaL_checkstring(L, 2));
+    c = optresult(L, 3, &a);
+    for (i = 0; i < a.n; i += BLOCK)
+      runblock(&e, &a, &c,
+               i, (a.n - i < BLOCK) ? (int)(a.n - i) : BLOCK);
+  }
+  return 1;
+}
+
+/* }====================================================== */
+
+
+static const inluaL_Reg arraylib[] = {
+  {"add", arr_add},
+  {"dot", arr_dot},
+  {"map", arr_map},
+  {"max", arr_max},
+  {"min", arr_min},
+  {"mul", arr_mul},
+  {"new", arr_new},
+  {"scale", arr_scale},
+  {"sub", arr_sub},
+  {"sum", arr_sum},
+  {"totable", arr_totable},
+  {"type", arr_type},
+  {NULL, NULL}
+};
+
+
+/*
+** Open array library. Numeric keys and `#' are handled by the core;
+** other keys (method names) go to the library through __index.
+*/
+INLUALIB_API int inluaopen_array (inlua_State *L) {
+  inluaL_register(L, INLUA_ARRAYLIBNAME, arraylib);
+  inluaL_newmetatable(L, INLUA_ARRAYHANDLE);
+  inlua_pushvalue(L, -2);
+  inlua_setfield(L, -2, "__index");
+  inlua_pop(L, 1);
+  return 1;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
@@ -24,6 +24,11 @@
 
 #include "inlauxlib.h"
 
+#if defined(INLUA_USE_MMAP)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 
 #define FREELIST_REF	0	/* free list of references */
 
@@ -522,6 +527,9 @@ INLUALIB_API void inluaL_unref (inlua_State *L, int t, int ref) {
 typedef struct LoadF {
   int extraline;
   FILE *f;
+  char *map;  /* whole file, when it is mapped */
+  size_t mapsize;
+  size_t mappos;  /* start of what was not read yet */
   char buff[INLUAL_BUFFERSIZE];
 } LoadF;
 
@@ -534,12 +542,41 @@ static const char *getF (inlua_State *L, void *ud, size_t *size) {
     *size = 1;
     return "\n";
   }
+  if (lf->map != NULL) {  /* give the rest of the file in one piece */
+    size_t pos = lf->mappos;
+    if (pos >= lf->mapsize) return NULL;
+    lf->mappos = lf->mapsize;
+    *size = lf->mapsize - pos;
+    return lf->map + pos;
+  }
   if (feof(lf->f)) return NULL;
   *size = fread(lf->buff, 1, sizeof(lf->buff), lf->f);
   return (*size > 0) ? lf->buff : NULL;
 }
 
 
+#if defined(INLUA_USE_MMAP)
+
+/* maps a regular file larger than the read buffer, from where `f' is */
+static void mapfile (LoadF *lf) {
+  struct stat st;
+  long pos = ftell(lf->f);
+  void *m;
+  if (pos < 0 || fstat(fileno(lf->f), &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size <= (off_t)sizeof(lf->buff) ||
+      (off_t)(size_t)st.st_size != st.st_size)
+    return;
+  m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+           fileno(lf->f), 0);
+  if (m == MAP_FAILED) return;  /* read it instead */
+  lf->map = (char *)m;
+  lf->mapsize = (size_t)st.st_size;
+  lf->mappos = (size_t)pos;
+}
+
+#endif
+
+
 static int errfile (inlua_State *L, const char *what, int fnameindex) {
   const char *serr = strerror(errno);
   const char *filename = inlua_tostring(L, fnameindex) + 1;
@@ -555,6 +592,7 @@ INLUALIB_API int inluaL_loadfile (inlua_State *L, const char *filename) {
   int c;
   int fnameindex = inlua_gettop(L) + 1;  /* index of filename on the stack */
   lf.extraline = 0;
+  lf.map = NULL;
   if (filename == NULL) {
     inlua_pushliteral(L, "=stdin");
     lf.f = stdin;
@@ -578,8 +616,14 @@ INLUALIB_API int inluaL_loadfile (inlua_State *L, const char *filename) {
     lf.extraline = 0;
   }
   ungetc(c, lf.f);
+#if defined(INLUA_USE_MMAP)
+  if (filename) mapfile(&lf);
+#endif
   status = inlua_load(L, getF, &lf, inlua_tostring(L, -1));
   readstatus = ferror(lf.f);
+#if defined(INLUA_USE_MMAP)
+  if (lf.map != NULL) munmap(lf.map, lf.mapsize);
+#endif
   if (filename) fclose(lf.f);  /* close file (even in case of errors) */
   if (readstatus) {
     inlua_settop(L, fnameindex);  /* ignore results from `inlua_load' */
@@ -620,6 +664,175 @@ INLUALIB_API int (inluaL_loadstring) (inlua_State *L, const char *s) {
 }
 
 
+INLUALIB_API int inluaL_loaddata (inlua_State *L, const char *buff, size_t size,
+                              const char *name) {
+  LoadS ls;
+  ls.s = buff;
+  ls.size = size;
+  return inlua_loaddata(L, getS, &ls, name);
+}
+
+
+
+/*
+** Loading many files. With INLUA_USE_PARALLELLOAD, worker threads compile
+** them, each into a state of its own, and dump the functions into
+** `images'; the calling thread then undumps the images in order into L.
+** Strings and prototypes are only made in L by undumping, so workers
+** never touch it.
+*/
+
+/* on an error, leave only the message of the first failing file */
+static int loadfailed (inlua_State *L, int base, int status) {
+  if (inlua_gettop(L) > base + 1) {
+    inlua_replace(L, base + 1);
+    inlua_settop(L, base + 1);
+  }
+  return status;
+}
+
+
+#if defined(INLUA_USE_PARALLELLOAD)
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct Image {
+  char *buff;  /* dumped function, or error message */
+  size_t size;
+  size_t cap;
+  int status;
+} Image;
+
+
+static int writeimage (inlua_State *L, const void *p, size_t sz, void *ud) {
+  Image *im = (Image *)ud;
+  (void)L;
+  if (im->size + sz > im->cap) {
+    size_t cap = (im->cap == 0) ? 4096 : im->cap;
+    char *b;
+    while (cap < im->size + sz) cap *= 2;
+    b = (char *)realloc(im->buff, cap);
+    if (b == NULL) return 1;
+    im->buff = b;
+    im->cap = cap;
+  }
+  memcpy(im->buff + im->size, p, sz);
+  im->size += sz;
+  return 0;
+}
+
+
+static void compile (inlua_State *C, const char *filename, Image *im) {
+  if (C == NULL)  /* worker could not create its state? */
+    im->status = INLUA_ERRMEM;
+  else {
+    im->status = inluaL_loadfile(C, filename);
+    if (im->status == 0 && inlua_dump(C, writeimage, im) != 0)
+      im->status = INLUA_ERRMEM;
+    if (im->status != 0) {  /* keep the message instead */
+      const char *msg = (im->status == INLUA_ERRMEM) ? "not enough memory" :
+                                                      inlua_tostring(C, -1);
+      im->size = 0;
+      if (writeimage(C, msg, strlen(msg), im) != 0)
+        im->size = 0;
+    }
+    inlua_settop(C, 0);
+  }
+}
+
+
+typedef struct Loader {
+  const char *const *filenames;
+  Image *images;
+  int n;
+  int next;  /* first file not taken by a worker yet */
+  pthread_mutex_t lock;
+} Loader;
+
+
+static void *worker (void *ud) {
+  Loader *ld = (Loader *)ud;
+  inlua_State *C = inluaL_newstate();
+  for (;;) {
+    int i;
+    pthread_mutex_lock(&ld->lock);
+    i = ld->next++;
+    pthread_mutex_unlock(&ld->lock);
+    if (i >= ld->n) break;
+    compile(C, ld->filenames[i], &ld->images[i]);
+  }
+  if (C) inlua_close(C);
+  return NULL;
+}
+
+
+static int loadparallel (inlua_State *L, const char *const *filenames,
+                         int n, int nthreads) {
+  Loader ld;
+  pthread_t *threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+  int base = inlua_gettop(L);
+  int i, started = 0, status = 0;
+  ld.filenames = filenames;
+  ld.images = (Image *)calloc(n, sizeof(Image));
+  ld.n = n;
+  ld.next = 0;
+  if (threads == NULL || ld.images == NULL || !inlua_checkstack(L, n + 1)) {
+    free(threads);
+    free(ld.images);
+    return -1;  /* load them one by one instead */
+  }
+  pthread_mutex_init(&ld.lock, NULL);
+  while (started < nthreads - 1 &&
+         pthread_create(&threads[started], NULL, worker, &ld) == 0)
+    started++;
+  worker(&ld);  /* this thread compiles too */
+  for (i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&ld.lock);
+  free(threads);
+  for (i = 0; i < n && status == 0; i++) {
+    Image *im = &ld.images[i];
+    if (im->status == 0)
+      status = inluaL_loadbuffer(L, im->buff, im->size, filenames[i]);
+    else {
+      status = im->status;
+      if (im->size > 0) inlua_pushlstring(L, im->buff, im->size);
+      else inlua_pushliteral(L, "not enough memory");
+    }
+  }
+  for (i = 0; i < n; i++)
+    free(ld.images[i].buff);
+  free(ld.images);
+  return (status == 0) ? 0 : loadfailed(L, base, status);
+}
+
+#endif
+
+
+INLUALIB_API int inluaL_loadfiles (inlua_State *L,
+                               const char *const *filenames, int n,
+                               int nthreads) {
+  int base = inlua_gettop(L);
+  int i, status = 0;
+#if defined(INLUA_USE_PARALLELLOAD)
+  if (nthreads <= 0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > n) nthreads = n;
+  if (nthreads > 1) {
+    status = loadparallel(L, filenames, n, nthreads);
+    if (status >= 0) return status;
+    status = 0;
+  }
+#else
+  (void)nthreads;
+#endif
+  inluaL_checkstack(L, n + 1, "too many files");
+  for (i = 0; i < n && status == 0; i++)
+    status = inluaL_loadfile(L, filenames[i]);
+  return (status == 0) ? 0 : loadfailed(L, base, status);
+}
+
+
 
 /* }====================================================== */
 
@@ -646,7 +859,10 @@ static int panic (inlua_State *L) {
 
 INLUALIB_API inlua_State *inluaL_newstate (void) {
   inlua_State *L = inlua_newstate(l_alloc, NULL);
-  if (L) inlua_atpanic(L, &panic);
+  if (L) {
+    inlua_atpanic(L, &panic);
+    inlua_gc(L, INLUA_GCASYNCFREE, 1);  /* `l_alloc' is thread-safe */
+  }
   return L;
 }
 
@@ -190,14 +190,66 @@ static int luaB_gcinfo (inlua_State *L) {
 }
 
 
+static void setcounts (inlua_State *L, const char *field,
+                       const unsigned long *n, const size_t *b) {
+  static const char *const kinds[INLUA_GCKINDS] = {"string", "table",
+    "function", "userdata", "thread", "proto", "upvalue"};
+  int i;
+  inlua_createtable(L, 0, INLUA_GCKINDS);
+  for (i = 0; i < INLUA_GCKINDS; i++) {
+    inlua_pushnumber(L, n ? (inlua_Number)n[i] : (inlua_Number)b[i]);
+    inlua_setfield(L, -2, kinds[i]);
+  }
+  inlua_setfield(L, -2, field);
+}
+
+
+static int gcstats (inlua_State *L) {
+  static const char *const phases[INLUA_GCPHASES] = {"propagate", "atomic",
+    "sweepstring", "sweep", "finalize"};
+  inlua_GCStats s;
+  int i;
+  inlua_gcstats(L, &s);
+  inlua_createtable(L, 0, 9);
+  inlua_pushnumber(L, (inlua_Number)s.cycles);
+  inlua_setfield(L, -2, "cycles");
+  inlua_pushnumber(L, (inlua_Number)s.pauses);
+  inlua_setfield(L, -2, "pauses");
+  inlua_pushnumber(L, s.pausetotal);
+  inlua_setfield(L, -2, "pausetotal");
+  inlua_pushnumber(L, s.pausemax);
+  inlua_setfield(L, -2, "pausemax");
+  inlua_createtable(L, 0, INLUA_GCPHASES);
+  for (i = 0; i < INLUA_GCPHASES; i++) {
+    inlua_pushnumber(L, s.phasetime[i]);
+    inlua_setfield(L, -2, phases[i]);
+  }
+  inlua_setfield(L, -2, "phases");
+  inlua_createtable(L, INLUA_GCHISTSIZE, 0);
+  for (i = 0; i < INLUA_GCHISTSIZE; i++) {
+    inlua_pushnumber(L, (inlua_Number)s.histogram[i]);
+    inlua_rawseti(L, -2, i + 1);
+  }
+  inlua_setfield(L, -2, "histogram");
+  setcounts(L, "objects", s.objects, NULL);
+  setcounts(L, "bytes", NULL, s.bytes);
+  return 1;
+}
+
+
 static int luaB_collectgarbage (inlua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
-    "count", "step", "setpause", "setstepmul", NULL};
+    "count", "step", "setpause", "setstepmul", "telemetry",
+    "setpausetarget", "setgrowth", "stats", NULL};
   static const int optsnum[] = {INLUA_GCSTOP, INLUA_GCRESTART, INLUA_GCCOLLECT,
-    INLUA_GCCOUNT, INLUA_GCSTEP, INLUA_GCSETPAUSE, INLUA_GCSETSTEPMUL};
+    INLUA_GCCOUNT, INLUA_GCSTEP, INLUA_GCSETPAUSE, INLUA_GCSETSTEPMUL,
+    INLUA_GCTELEMETRY, INLUA_GCSETPAUSETARGET, INLUA_GCSETGROWTH, -1};
   int o = inluaL_checkoption(L, 1, "collect", opts);
   int ex = inluaL_optint(L, 2, 0);
-  int res = inlua_gc(L, optsnum[o], ex);
+  int res;
+  if (optsnum[o] == -1)  /* "stats"? */
+    return gcstats(L);
+  res = inlua_gc(L, optsnum[o], ex);
   switch (optsnum[o]) {
     case INLUA_GCCOUNT: {
       int b = inlua_gc(L, INLUA_GCCOUNTB, 0);
@@ -282,6 +334,14 @@ static int luaB_loadstring (inlua_State *L) {
 }
 
 
+static int luaB_loaddata (inlua_State *L) {
+  size_t l;
+  const char *s = inluaL_checklstring(L, 1, &l);
+  const char *chunkname = inluaL_optstring(L, 2, s);
+  return load_aux(L, inluaL_loaddata(L, s, l, chunkname));
+}
+
+
 static int luaB_loadfile (inlua_State *L) {
   const char *fname = inluaL_optstring(L, 1, NULL);
   return load_aux(L, inluaL_loadfile(L, fname));
@@ -452,6 +512,7 @@ static const inluaL_Reg base_funcs[] = {
   {"gcinfo", luaB_gcinfo},
   {"getfenv", luaB_getfenv},
   {"getmetatable", luaB_getmetatable},
+  {"loaddata", luaB_loaddata},
   {"loadfile", luaB_loadfile},
   {"load", luaB_load},
   {"loadstring", luaB_loadstring},
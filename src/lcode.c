@@ -5,6 +5,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 
 #define lcode_c
 #define INLUA_CORE
@@ -14,6 +15,7 @@
 #include "lcode.h"
 #include "ldebug.h"
 #include "ldo.h"
+#include "lfunc.h"
 #include "lgc.h"
 #include "llex.h"
 #include "lmem.h"
@@ -35,8 +37,11 @@ void luaK_nil (FuncState *fs, int from, int n) {
   Instruction *previous;
   if (fs->pc > fs->lasttarget) {  /* no jumps to current position? */
     if (fs->pc == 0) {  /* function start? */
-      if (from >= fs->nactvar)
+      if (from >= fs->nactvar) {
+        if (from+n > fs->f->nilregs)  /* remember it (see luaK_inline) */
+          fs->f->nilregs = cast_byte(from+n);
         return;  /* positions are already clean */
+      }
     }
     else {
       previous = &fs->f->code[fs->pc-1];
@@ -681,11 +686,9 @@ void luaK_indexed (FuncState *fs, expdesc *t, expdesc *k) {
 }
 
 
-static int constfolding (OpCode op, expdesc *e1, expdesc *e2) {
-  inlua_Number v1, v2, r;
-  if (!isnumeral(e1) || !isnumeral(e2)) return 0;
-  v1 = e1->u.nval;
-  v2 = e2->u.nval;
+static int foldnum (OpCode op, inlua_Number v1, inlua_Number v2,
+                    inlua_Number *res) {
+  inlua_Number r;
   switch (op) {
     case OP_ADD: r = inluai_numadd(v1, v2); break;
     case OP_SUB: r = inluai_numsub(v1, v2); break;
@@ -702,11 +705,17 @@ static int constfolding (OpCode op, expdesc *e1, expdesc *e2) {
     default: inlua_assert(0); r = 0; break;
   }
   if (inluai_numisnan(r)) return 0;  /* do not attempt to produce NaN */
-  e1->u.nval = r;
+  *res = r;
   return 1;
 }
 
 
+static int constfolding (OpCode op, expdesc *e1, expdesc *e2) {
+  if (!isnumeral(e1) || !isnumeral(e2)) return 0;
+  return foldnum(op, e1->u.nval, e2->u.nval, &e1->u.nval);
+}
+
+
 static void codearith (FuncState *fs, OpCode op, expdesc *e1, expdesc *e2) {
   if (constfolding(op, e1, e2))
     return;
@@ -886,3 +895,1172 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** next instruction after `pc', skipping the extra word of an OP_SETLIST
+*/
+static int nextinstr (const Instruction *code, int pc) {
+  Instruction i = code[pc];
+  if (GET_OPCODE(i) == OP_SETLIST && GETARG_C(i) == 0)
+    return pc + 2;
+  return pc + 1;
+}
+
+
+/*
+** replace instruction pairs that dominate loop bodies by superinstructions
+** (see lopcodes.h); the second instruction of each pair stays in place
+*/
+void luaK_fuse (FuncState *fs) {
+  Instruction *code = fs->f->code;
+  int pc;
+  for (pc = 0; pc + 1 < fs->pc; pc = nextinstr(code, pc)) {
+    if (GET_OPCODE(code[pc + 1]) != OP_FORLOOP) continue;
+    switch (GET_OPCODE(code[pc])) {
+      case OP_ADD: SET_OPCODE(code[pc], OP_ADDLOOP); break;
+      case OP_SETTABLE: SET_OPCODE(code[pc], OP_SETTABLELOOP); break;
+      default: break;
+    }
+  }
+  for (pc = 0; pc + 1 < fs->pc; pc = nextinstr(code, pc)) {
+    if (GET_OPCODE(code[pc]) != OP_GETTABLE) continue;
+    switch (GET_OPCODE(code[pc + 1])) {
+      case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+      case OP_LT: case OP_LE: case OP_ADDLOOP:
+        SET_OPCODE(code[pc], OP_GETTABLEOP);
+        break;
+      default: break;
+    }
+  }
+}
+
+
+
+/*
+** {======================================================================
+** Inlining
+** =======================================================================
+*/
+
+/* does `i' skip the next instruction (a jump) when its test fails? */
+static int skips (Instruction i) {
+  return testTMode(GET_OPCODE(i)) ||
+         (GET_OPCODE(i) == OP_LOADBOOL && GETARG_C(i));
+}
+
+
+/* can the final return of `p' (added by close_func) be reached? */
+static int reachesend (const Proto *p) {
+  int last = p->sizecode - 1;
+  int pc;
+  for (pc = 0; pc < last; pc++) {
+    Instruction i = p->code[pc];
+    if (getOpMode(GET_OPCODE(i)) == iAsBx && pc + 1 + GETARG_sBx(i) == last)
+      return 1;
+    if (skips(i) && pc + 2 == last)
+      return 1;
+  }
+  if (last == 0) return 1;
+  switch (GET_OPCODE(p->code[last - 1])) {
+    case OP_RETURN: return 0;
+    case OP_JMP: return (last >= 2 && skips(p->code[last - 2]));
+    default: return 1;
+  }
+}
+
+
+/* number of values every return of `p' gives, or -1 if they differ */
+static int nresults (const Proto *p) {
+  int end = reachesend(p) ? p->sizecode : p->sizecode - 1;
+  int n = -1, pc;
+  for (pc = 0; pc < end; pc++) {
+    Instruction i = p->code[pc];
+    if (GET_OPCODE(i) == OP_RETURN) {
+      if (n >= 0 && n != GETARG_B(i) - 1) return -1;
+      n = GETARG_B(i) - 1;
+    }
+  }
+  return n;
+}
+
+
+static int inlinable (const Proto *p) {
+  int pc;
+  if (p->nups > 0 || p->is_vararg || p->sizecode - 1 > INLUAI_INLINESIZE ||
+      p->sizeinlined > 0)
+    return 0;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction i = p->code[pc];
+    switch (GET_OPCODE(i)) {
+      case OP_GETUPVAL: case OP_SETUPVAL: case OP_CLOSE: case OP_CLOSURE:
+      case OP_VARARG: case OP_TAILCALL:
+      case OP_GETGLOBAL: case OP_SETGLOBAL:  /* setfenv may change its env */
+        return 0;
+      case OP_RETURN: case OP_SETLIST:  /* open return; extra word */
+        if ((GET_OPCODE(i) == OP_RETURN ? GETARG_B(i) : GETARG_C(i)) == 0)
+          return 0;
+        break;
+      default:  /* a skipped instruction must stay a single one */
+        if (skips(i) && GET_OPCODE(p->code[pc + 1]) == OP_RETURN)
+          return 0;
+        break;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** make the open instruction `i', which follows an open call, use `top'
+** (the register after the last result) instead; 0 if it cannot
+*/
+static int settop (Instruction *i, int top) {
+  int a = GETARG_A(*i);
+  switch (GET_OPCODE(*i)) {
+    case OP_CALL: case OP_TAILCALL: top -= a; break;
+    case OP_RETURN: top -= a - 1; break;
+    case OP_SETLIST: top -= a + 1; break;
+    default: return 0;
+  }
+  if (GETARG_B(*i) != 0 || top <= 0 || top > MAXARG_B) return 0;
+  SETARG_B(*i, top);
+  return 1;
+}
+
+
+static int copyk (FuncState *fs, const TValue *v) {
+  switch (ttype(v)) {
+    case INLUA_TNIL: return nilK(fs);
+    case INLUA_TBOOLEAN: return boolK(fs, bvalue(v));
+    case INLUA_TNUMBER: return luaK_numberK(fs, nvalue(v));
+    default: return luaK_stringK(fs, rawtsvalue(v));
+  }
+}
+
+
+static int relocarg (FuncState *fs, const Proto *p, enum OpArgMask m,
+                     int x, int base) {
+  switch (m) {
+    case OpArgR: return x + base;
+    case OpArgK: return ISK(x) ? RKASK(copyk(fs, &p->k[INDEXK(x)])) : x + base;
+    default: return x;
+  }
+}
+
+
+/* instruction `i' of `p' with its registers moved up by `base' */
+static Instruction reloc (FuncState *fs, const Proto *p, Instruction i,
+                         int base) {
+  OpCode op = GET_OPCODE(i);
+  switch (op) {  /* the caller fuses its own code again */
+    case OP_GETTABLEOP: op = OP_GETTABLE; break;
+    case OP_ADDLOOP: op = OP_ADD; break;
+    case OP_SETTABLELOOP: op = OP_SETTABLE; break;
+    default: break;
+  }
+  SET_OPCODE(i, op);
+  switch (getOpMode(op)) {
+    case iABC: {
+      if (op != OP_EQ && op != OP_LT && op != OP_LE)  /* A is a register? */
+        SETARG_A(i, GETARG_A(i) + base);
+      SETARG_B(i, relocarg(fs, p, getBMode(op), GETARG_B(i), base));
+      SETARG_C(i, relocarg(fs, p, getCMode(op), GETARG_C(i), base));
+      break;
+    }
+    case iABx: {  /* OP_LOADK, OP_GETGLOBAL, OP_SETGLOBAL */
+      SETARG_A(i, GETARG_A(i) + base);
+      SETARG_Bx(i, copyk(fs, &p->k[GETARG_Bx(i)]));
+      break;
+    }
+    case iAsBx: {  /* jumps are patched by `expand' */
+      if (op != OP_JMP)
+        SETARG_A(i, GETARG_A(i) + base);
+      break;
+    }
+  }
+  return i;
+}
+
+
+/*
+** write the code of `p' that replaces `call' into `code' and `lineinfo',
+** or only count it if `code' is NULL; returns its size and leaves the
+** new position of each instruction of `p' in `map'. The arguments are
+** already in place as the registers of `p', moved up to just above the
+** function register, and each return moves its values down to where the
+** call leaves its results
+*/
+static int expand (FuncState *fs, const Proto *p, Instruction call,
+                   Instruction *code, int *lineinfo, int *map) {
+  int func = GETARG_A(call);
+  int base = func + 1;
+  int nargs = GETARG_B(call) - 1;
+  int want = (GETARG_C(call) == 0) ? nresults(p) : GETARG_C(call) - 1;
+  int end = reachesend(p) ? p->sizecode : p->sizecode - 1;
+  int clean = (p->nilregs > p->numparams) ? p->nilregs : p->numparams;
+  int given = (nargs < p->numparams) ? nargs : p->numparams;
+  int n = 0;
+  int pc;
+#define emit(i,l)	{ if (code) { code[n] = (i); lineinfo[n] = (l); } n++; }
+  if (given < clean)  /* missing arguments and registers assumed nil */
+    emit(CREATE_ABC(OP_LOADNIL, base + given, base + clean - 1, 0),
+         p->lineinfo[0]);
+  for (pc = 0; pc < end; pc++) {
+    Instruction i = p->code[pc];
+    map[pc] = n;
+    if (GET_OPCODE(i) == OP_RETURN) {
+      int a = base + GETARG_A(i);
+      int nret = GETARG_B(i) - 1;
+      int line = p->lineinfo[pc];
+      int k;
+      for (k = 0; k < nret && k < want; k++)
+        emit(CREATE_ABC(OP_MOVE, func + k, a + k, 0), line);
+      if (nret < want)
+        emit(CREATE_ABC(OP_LOADNIL, func + nret, func + want - 1, 0), line);
+      if (pc + 1 < end)
+        emit(CREATE_ABx(OP_JMP, 0, end + MAXARG_sBx), line);  /* patched below */
+    }
+    else if (code == NULL)
+      n++;
+    else {
+      Instruction r = reloc(fs, p, i, base);
+      if (getOpMode(GET_OPCODE(r)) == iAsBx)
+        SETARG_sBx(r, pc + 1 + GETARG_sBx(i));  /* patched below */
+      emit(r, p->lineinfo[pc]);
+    }
+  }
+  map[end] = n;
+#undef emit
+  if (code) {  /* jumps hold the target in `p'; make them relative */
+    for (pc = 0; pc < n; pc++) {
+      if (getOpMode(GET_OPCODE(code[pc])) == iAsBx)
+        SETARG_sBx(code[pc], map[GETARG_sBx(code[pc])] - (pc + 1));
+    }
+  }
+  return n;
+}
+
+
+/* move the ranges of local variables and of inlined calls to `newpc' */
+static void movedebug (FuncState *fs, const int *newpc) {
+  Proto *f = fs->f;
+  int i;
+  for (i = 0; i < fs->nlocvars; i++) {
+    f->locvars[i].startpc = newpc[f->locvars[i].startpc];
+    f->locvars[i].endpc = newpc[f->locvars[i].endpc];
+  }
+  for (i = 0; i < f->sizeinlined; i++) {
+    f->inlined[i].startpc = newpc[f->inlined[i].startpc];
+    f->inlined[i].endpc = newpc[f->inlined[i].endpc];
+  }
+}
+
+
+static void addvar (FuncState *fs, TString *name, int startpc, int endpc) {
+  Proto *f = fs->f;
+  int oldsize = f->sizelocvars;
+  luaM_growvector(fs->L, f->locvars, fs->nlocvars, f->sizelocvars,
+                  LocVar, SHRT_MAX, "too many local variables");
+  while (oldsize < f->sizelocvars) f->locvars[oldsize++].varname = NULL;
+  f->locvars[fs->nlocvars].varname = name;
+  f->locvars[fs->nlocvars].startpc = startpc;
+  f->locvars[fs->nlocvars].endpc = endpc;
+  luaC_objbarrier(fs->L, f, name);
+  fs->nlocvars++;
+}
+
+
+/*
+** record the `ns' calls in `fs->sites', now inlined at `newpc', for the
+** debug interface: each keeps its call line and registers, and the locals
+** of its body are appended to those of `fs' at their new positions
+*/
+static void addinlined (FuncState *fs, const Instruction *old,
+                        const int *newpc, const int *oldline, int ns) {
+  Proto *f = fs->f;
+  int map[INLUAI_INLINESIZE + 2];
+  int i, v;
+  f->inlined = luaM_newvector(fs->L, ns, InlineCall);
+  f->sizeinlined = ns;
+  for (i = 0; i < ns; i++) {
+    Inlinesite *s = &fs->sites[i];
+    InlineCall *ic = &f->inlined[i];
+    Proto *p = f->p[s->proto];
+    int end = reachesend(p) ? p->sizecode : p->sizecode - 1;
+    ic->startpc = newpc[s->pc];
+    ic->endpc = newpc[s->pc + 1];
+    ic->line = oldline[s->pc];
+    ic->func = GETARG_A(old[s->pc]);
+    ic->closure = (s->move >= 0) ? GETARG_B(old[s->move]) : ic->func;
+    ic->firstvar = fs->nlocvars;
+    expand(fs, p, old[s->pc], NULL, NULL, map);
+    for (v = 0; v < p->sizelocvars; v++) {  /* parameters from the start */
+      const LocVar *lv = &p->locvars[v];
+      int startpc = (lv->startpc == 0) ? 0 : map[(lv->startpc < end) ?
+                                                 lv->startpc : end];
+      int endpc = map[(lv->endpc < end) ? lv->endpc : end];
+      addvar(fs, lv->varname, ic->startpc + startpc, ic->startpc + endpc);
+    }
+    ic->nvars = fs->nlocvars - ic->firstvar;
+  }
+}
+
+
+/*
+** Replace the calls in `fs->sites' by copies of the code of the functions
+** they call, where this is possible. The function register is not loaded
+** anymore; the arguments become the registers of the copy, which work
+** like those of the call frame (all above the function register are free
+** once the call starts). Jumps, line information and the ranges of local
+** variables are moved to the new positions, and the calls are recorded
+** with `addinlined'.
+*/
+void luaK_inline (FuncState *fs) {
+  inlua_State *L = fs->L;
+  Proto *f = fs->f;
+  int n = fs->pc;
+  int size = n;
+  int nk = fs->nk;
+  int ns = 0;
+  int i, pc, out;
+  int map[INLUAI_INLINESIZE + 2];
+  Instruction *old;
+  int *oldline, *newpc;
+  for (i = 0; i < fs->nsites; i++) {  /* keep the calls that can be inlined */
+    Inlinesite *s = &fs->sites[i];
+    Instruction call = f->code[s->pc];
+    Proto *p = f->p[s->proto];
+    int j, top = GETARG_A(call) + 1 + p->maxstacksize;
+    if (GETARG_B(call) == 0 || top > MAXSTACK || !inlinable(p))
+      continue;
+    if (GETARG_C(call) == 0) {  /* open call: next instruction reads `top' */
+      Instruction next = f->code[s->pc + 1];
+      if (nresults(p) < 0 || !settop(&next, GETARG_A(call) + nresults(p)))
+        continue;
+    }
+    for (j = 0; j < ns && fs->sites[j].proto != s->proto; j++) ;
+    if (j == ns) {  /* constants of a function not inlined yet */
+      if (nk + p->sizek > MAXINDEXRK + 1) continue;
+      nk += p->sizek;
+    }
+    if (s->move >= 0 && (GET_OPCODE(f->code[s->move]) != OP_MOVE ||
+                         GETARG_A(f->code[s->move]) != GETARG_A(call)))
+      s->move = -1;
+    if (top > f->maxstacksize)
+      f->maxstacksize = cast_byte(top);
+    size += expand(fs, p, call, NULL, NULL, map) - 1 - (s->move >= 0);
+    fs->sites[ns++] = *s;
+  }
+  fs->nsites = 0;
+  if (ns == 0) return;
+  /* the old code, its lines and its new positions, in the lexer buffer */
+  old = cast(Instruction *, luaZ_openspace(L, fs->ls->buff,
+                  n * sizeof(Instruction) + (2 * n + 1) * sizeof(int)));
+  oldline = cast(int *, old + n);
+  newpc = oldline + n;
+  memcpy(old, f->code, n * sizeof(Instruction));
+  memcpy(oldline, f->lineinfo, n * sizeof(int));
+  for (pc = 0; pc < n; pc++) newpc[pc] = -1;
+  for (i = 0; i < ns; i++) {
+    newpc[fs->sites[i].pc] = i;
+    if (fs->sites[i].move >= 0) newpc[fs->sites[i].move] = -2;
+  }
+  if (size > f->sizecode) {
+    luaM_reallocvector(L, f->code, f->sizecode, size, Instruction);
+    f->sizecode = size;
+  }
+  if (size > f->sizelineinfo) {
+    luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, size, int);
+    f->sizelineinfo = size;
+  }
+  out = 0;
+  for (pc = 0; pc < n; pc++) {
+    int site = newpc[pc];
+    newpc[pc] = out;
+    if (site >= 0) {
+      Instruction call = old[pc];
+      Proto *p = f->p[fs->sites[site].proto];
+      if (GETARG_C(call) == 0)
+        settop(&old[pc + 1], GETARG_A(call) + nresults(p));
+      out += expand(fs, p, call, f->code + out, f->lineinfo + out, map);
+    }
+    else if (site == -1) {  /* not the load of an inlined function */
+      f->code[out] = old[pc];
+      f->lineinfo[out++] = oldline[pc];
+    }
+  }
+  newpc[n] = out;
+  inlua_assert(out == size);
+  for (pc = 0; pc < n; pc = nextinstr(old, pc)) {  /* move the jumps */
+    Instruction i = old[pc];
+    if (getOpMode(GET_OPCODE(i)) == iAsBx && newpc[pc + 1] > newpc[pc]) {
+      int target = newpc[pc + 1 + GETARG_sBx(i)];
+      SETARG_sBx(f->code[newpc[pc]], target - (newpc[pc] + 1));
+    }
+  }
+  movedebug(fs, newpc);
+  addinlined(fs, old, newpc, oldline, ns);
+  fs->pc = out;
+}
+
+/* }====================================================================== */
+
+
+
+/*
+** {======================================================================
+** Jump optimization
+** =======================================================================
+*/
+
+#define TARGET		1	/* reached by a jump or a skip */
+#define REACHED		2
+
+
+static int jumptarget (const Instruction *code, int pc) {
+  return pc + 1 + GETARG_sBx(code[pc]);
+}
+
+
+/* where a jump to `pc' ends up, following chains of jumps */
+static int finaltarget (const Instruction *code, int pc) {
+  int count;
+  for (count = 0; count < 100 && GET_OPCODE(code[pc]) == OP_JMP; count++)
+    pc = jumptarget(code, pc);
+  return pc;
+}
+
+
+/* truth value that `i' leaves in register `r', or -1 if unknown */
+static int loadedtruth (const Proto *f, Instruction i, int r) {
+  switch (GET_OPCODE(i)) {
+    case OP_LOADK:
+      return (GETARG_A(i) == r) ? !l_isfalse(&f->k[GETARG_Bx(i)]) : -1;
+    case OP_LOADBOOL:
+      return (GETARG_A(i) == r && GETARG_C(i) == 0) ? GETARG_B(i) != 0 : -1;
+    case OP_LOADNIL:
+      return (GETARG_A(i) <= r && r <= GETARG_B(i)) ? 0 : -1;
+    case OP_NEWTABLE: case OP_CLOSURE:
+      return (GETARG_A(i) == r) ? 1 : -1;
+    default:
+      return -1;
+  }
+}
+
+
+/* is register `r' kept open by a closure made in `f'? */
+static int captured (const Proto *f, int n, int r) {
+  int pc;
+  for (pc = 0; pc < n; pc = nextinstr(f->code, pc)) {
+    Instruction i = f->code[pc];
+    if (GET_OPCODE(i) == OP_CLOSURE) {
+      int nup = f->p[GETARG_Bx(i)]->nups;
+      for (; nup > 0; nup--) {
+        i = f->code[++pc];
+        if (GET_OPCODE(i) == OP_MOVE && GETARG_B(i) == r) return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+static int readsreg (enum OpArgMask m, int x, int r) {
+  return (m == OpArgR || (m == OpArgK && !ISK(x))) && x == r;
+}
+
+
+/*
+** is the value in register `r' dead at `pc', that is, written before it
+** is read on every path from there? Only straight code without calls is
+** followed; anything else counts as a read
+*/
+static int deadat (const Proto *f, int pc, int r) {
+  int steps;
+  for (steps = 0; steps < 16; steps++) {
+    Instruction i = f->code[pc];
+    OpCode op = GET_OPCODE(i);
+    int a = GETARG_A(i);
+    switch (op) {
+      case OP_JMP:
+        pc = jumptarget(f->code, pc);
+        continue;
+      case OP_RETURN:
+        return !(r >= a && (GETARG_B(i) == 0 || r < a + GETARG_B(i) - 1));
+      case OP_MOVE: case OP_UNM: case OP_NOT: case OP_LEN:
+      case OP_GETTABLE: case OP_ADD: case OP_SUB: case OP_MUL:
+      case OP_DIV: case OP_MOD: case OP_POW:
+      case OP_SETTABLE: case OP_SETGLOBAL: case OP_SETUPVAL:
+        if (readsreg(getBMode(op), GETARG_B(i), r) ||
+            readsreg(getCMode(op), GETARG_C(i), r))
+          return 0;
+        if (!testAMode(op)) {  /* stores R(A) */
+          if (a == r) return 0;
+          pc++;
+          continue;
+        }
+        break;
+      case OP_CONCAT:
+        if (GETARG_B(i) <= r && r <= GETARG_C(i)) return 0;
+        break;
+      case OP_LOADK: case OP_GETUPVAL: case OP_GETGLOBAL: case OP_NEWTABLE:
+        break;
+      case OP_LOADBOOL:
+        if (GETARG_C(i)) return 0;
+        break;
+      case OP_LOADNIL:
+        if (a <= r && r <= GETARG_B(i)) return 1;
+        pc++;
+        continue;
+      default:
+        return 0;
+    }
+    if (a == r) return 1;  /* written */
+    pc++;
+  }
+  return 0;
+}
+
+
+/* rewrite tests of values loaded just before them, whose outcome is known */
+static void foldtests (FuncState *fs, int *mark) {
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int pc, prev = -1;
+  for (pc = 0; pc < fs->pc; prev = pc, pc = nextinstr(code, pc)) {
+    Instruction i = code[pc];
+    OpCode op = GET_OPCODE(i);
+    int truth;
+    if ((op != OP_TEST && op != OP_TESTSET) || prev < 0 || (mark[pc] & TARGET))
+      continue;
+    truth = loadedtruth(f, code[prev],
+                        (op == OP_TEST) ? GETARG_A(i) : GETARG_B(i));
+    if (truth < 0) continue;
+    if (truth != GETARG_C(i))  /* never jumps */
+      code[pc] = CREATE_ABx(OP_JMP, 0, 1 + MAXARG_sBx);
+    else if (op == OP_TEST)  /* always jumps */
+      code[pc] = CREATE_ABx(OP_JMP, 0, MAXARG_sBx);
+    else
+      code[pc] = CREATE_ABC(OP_MOVE, GETARG_A(i), GETARG_B(i), 0);
+  }
+}
+
+
+/*
+** retarget jumps to jumps, and make jumps to a return that one; turn
+** OP_TESTSET into OP_TEST where the value it sets is not used
+*/
+static void threadjumps (FuncState *fs) {
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int pc, prev = -1;
+  for (pc = 0; pc < fs->pc; prev = pc, pc = nextinstr(code, pc)) {
+    Instruction i = code[pc];
+    if (GET_OPCODE(i) == OP_JMP) {
+      int t = finaltarget(code, pc);
+      if (GET_OPCODE(code[t]) == OP_RETURN && GETARG_B(code[t]) != 0 &&
+          (prev < 0 || !skips(code[prev])))
+        code[pc] = code[t];
+      else
+        SETARG_sBx(code[pc], t - (pc + 1));
+    }
+  }
+  for (pc = 0; pc < fs->pc; pc = nextinstr(code, pc)) {
+    Instruction i = code[pc];
+    if (GET_OPCODE(i) == OP_TESTSET &&
+        deadat(f, finaltarget(code, pc + 1), GETARG_A(i)) &&
+        !captured(f, fs->pc, GETARG_A(i)))
+      code[pc] = CREATE_ABC(OP_TEST, GETARG_B(i), 0, GETARG_C(i));
+  }
+}
+
+
+static void reach (FuncState *fs, int *mark, int *stack) {
+  Instruction *code = fs->f->code;
+  int top = 0;
+  stack[top++] = 0;
+  mark[0] |= REACHED;
+  while (top > 0) {
+    int pc = stack[--top];
+    Instruction i = code[pc];
+    int next[2], nnext = 0, k;
+    switch (GET_OPCODE(i)) {
+      case OP_JMP: case OP_FORPREP:
+        next[nnext++] = jumptarget(code, pc);
+        break;
+      case OP_FORLOOP:
+        next[nnext++] = jumptarget(code, pc);
+        next[nnext++] = pc + 1;
+        break;
+      case OP_RETURN:
+        break;
+      default:
+        next[nnext++] = nextinstr(code, pc);
+        if (skips(i)) next[nnext++] = pc + 2;
+        break;
+    }
+    for (k = 0; k < nnext; k++) {
+      if (next[k] < fs->pc && !(mark[next[k]] & REACHED)) {
+        mark[next[k]] |= REACHED;
+        stack[top++] = next[k];
+      }
+    }
+  }
+}
+
+
+/*
+** Simplify the control flow of the code of `fs': tests of constants are
+** decided, chains of jumps are cut short, and code that cannot be reached
+** (such as after a `^^' or `^^^') and jumps to the next instruction are
+** removed. Line information and the ranges of local variables are moved
+** to the new positions.
+*/
+void luaK_jumps (FuncState *fs) {
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int n = fs->pc;
+  int *mark = cast(int *, luaZ_openspace(fs->L, fs->ls->buff,
+                                         (2 * n + 1) * sizeof(int)));
+  int *newpc = mark;  /* once the marks are used */
+  int pc, prev, out, i;
+  memset(mark, 0, (n + 1) * sizeof(int));
+  for (pc = 0; pc < n; pc = nextinstr(code, pc)) {
+    if (getOpMode(GET_OPCODE(code[pc])) == iAsBx)
+      mark[jumptarget(code, pc)] |= TARGET;
+    else if (skips(code[pc]) && pc + 2 < n)
+      mark[pc + 2] |= TARGET;
+  }
+  foldtests(fs, mark);
+  threadjumps(fs);
+  reach(fs, mark, mark + n + 1);
+  mark[n - 1] |= REACHED;  /* the final return always stays */
+  for (pc = 0, prev = -1; pc < n; prev = pc, pc = nextinstr(code, pc)) {
+    if (GET_OPCODE(code[pc]) == OP_JMP && (mark[pc] & REACHED) &&
+        (prev < 0 || !skips(code[prev]))) {
+      int t = jumptarget(code, pc);
+      int k;
+      for (k = pc + 1; k < t && !(mark[k] & REACHED); k++) ;
+      if (k == t && t > pc)  /* jump to the next instruction left */
+        mark[pc] &= ~REACHED;
+    }
+  }
+  out = 0;
+  for (pc = 0; pc < n; pc = nextinstr(code, pc)) {
+    int keep = mark[pc] & REACHED;
+    int size = nextinstr(code, pc) - pc;
+    for (i = 0; i < size; i++)
+      newpc[pc + i] = out + (keep ? i : 0);
+    if (keep) out += size;
+  }
+  newpc[n] = out;
+  if (out == n) return;
+  for (pc = 0; pc < n; pc = nextinstr(code, pc)) {
+    if (newpc[pc] == newpc[nextinstr(code, pc)]) continue;  /* removed */
+    if (getOpMode(GET_OPCODE(code[pc])) == iAsBx)
+      SETARG_sBx(code[pc], newpc[jumptarget(code, pc)] - (newpc[pc] + 1));
+    for (i = pc; i < nextinstr(code, pc); i++) {
+      code[newpc[i]] = code[i];
+      f->lineinfo[newpc[i]] = f->lineinfo[i];
+    }
+  }
+  movedebug(fs, newpc);
+  fs->pc = out;
+}
+
+/* }====================================================================== */
+
+
+
+/*
+** {======================================================================
+** Switches
+** =======================================================================
+*/
+
+/* number of arms of the chain of equality tests at `pc' (see OP_SWITCH) */
+static int countarms (FuncState *fs, int pc) {
+  int reg = -1, n = 0;
+  int match, miss;
+  while (n < MAXARG_B &&
+         luaF_switcharm(fs->f, fs->pc, pc, &reg, &match, &miss) >= 0 &&
+         miss > pc) {
+    n++;
+    pc = miss;
+  }
+  return n;
+}
+
+
+/*
+** Put an OP_SWITCH before each chain of at least INLUAI_SWITCHMIN equality
+** tests of the same register against constants, as `x == 1 & (...) |
+** x == 2 & (...) | ...' gives. Jumps to the chain go to the OP_SWITCH
+** instead. Line information and the ranges of local variables are moved
+** to the new positions.
+*/
+void luaK_switches (FuncState *fs) {
+  Proto *f = fs->f;
+  int n = fs->pc;
+  int nsw = 0;
+  int pc, prev, out;
+  Instruction *old;
+  int *oldline, *arms, *newpc;
+  old = cast(Instruction *, luaZ_openspace(fs->L, fs->ls->buff,
+                  n * sizeof(Instruction) + (3 * n + 2) * sizeof(int)));
+  oldline = cast(int *, old + n);
+  arms = oldline + n;  /* number of arms of the chain at each head */
+  newpc = arms + n + 1;
+  for (pc = 0; pc <= n; pc++) arms[pc] = 0;
+  for (pc = 0, prev = -1; pc < n; prev = pc, pc = nextinstr(f->code, pc)) {
+    int m, k, next, reg = -1;
+    if (nsw > MAXARG_C || arms[pc] < 0 ||
+        (prev >= 0 && (skips(f->code[prev]) ||
+                       GET_OPCODE(f->code[prev]) == OP_SWITCH)) ||
+        (m = countarms(fs, pc)) < INLUAI_SWITCHMIN)
+      continue;
+    arms[pc] = m;
+    nsw++;
+    for (k = 1, next = pc; k < m; k++) {  /* the other arms are no heads */
+      int match;
+      luaF_switcharm(f, n, next, &reg, &match, &next);
+      arms[next] = -1;
+    }
+  }
+  if (nsw == 0) return;
+  memcpy(old, f->code, n * sizeof(Instruction));
+  memcpy(oldline, f->lineinfo, n * sizeof(int));
+  if (n + nsw > f->sizecode) {
+    luaM_reallocvector(fs->L, f->code, f->sizecode, n + nsw, Instruction);
+    f->sizecode = n + nsw;
+  }
+  if (n + nsw > f->sizelineinfo) {
+    luaM_reallocvector(fs->L, f->lineinfo, f->sizelineinfo, n + nsw, int);
+    f->sizelineinfo = n + nsw;
+  }
+  out = 0;
+  for (pc = 0; pc < n; pc++) {
+    if (arms[pc] > 0) {
+      int b = GETARG_B(old[pc]);
+      int reg = ISK(b) ? GETARG_C(old[pc]) : b;
+      f->code[out] = CREATE_ABC(OP_SWITCH, reg, arms[pc], 0);
+      f->lineinfo[out++] = oldline[pc];
+    }
+    newpc[pc] = out;
+    f->code[out] = old[pc];
+    f->lineinfo[out++] = oldline[pc];
+  }
+  newpc[n] = out;
+  for (pc = 0; pc <= n; pc++)  /* jumps to a head go to its OP_SWITCH */
+    if (arms[pc] > 0) newpc[pc]--;
+  for (pc = 0; pc < n; pc = nextinstr(old, pc)) {
+    Instruction ins = old[pc];
+    if (getOpMode(GET_OPCODE(ins)) == iAsBx) {
+      int at = newpc[pc] + (arms[pc] > 0);
+      SETARG_sBx(f->code[at], newpc[pc + 1 + GETARG_sBx(ins)] - (at + 1));
+    }
+  }
+  movedebug(fs, newpc);
+  fs->pc = out;
+}
+
+/* }====================================================================== */
+
+
+
+/*
+** {======================================================================
+** Constant variables
+** =======================================================================
+*/
+
+/* put in `v' the constant that `i' loads into register `r'; 0 if none */
+static int loadsk (FuncState *fs, Instruction i, int r, TValue *v) {
+  if (GETARG_A(i) != r) return 0;
+  switch (GET_OPCODE(i)) {
+    case OP_LOADK:
+      setobj(fs->L, v, &fs->f->k[GETARG_Bx(i)]);
+      return 1;
+    case OP_LOADBOOL:
+      if (GETARG_C(i)) return 0;
+      setbvalue(v, GETARG_B(i) != 0);
+      return 1;
+    case OP_LOADNIL:
+      if (GETARG_B(i) != r) return 0;
+      setnilvalue(v);
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+
+/* may `i' write register `r'? */
+static int writesreg (Instruction i, int r) {
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_TEST: return 0;
+    case OP_LOADNIL: return a <= r && r <= GETARG_B(i);
+    case OP_SELF: return r == a || r == a + 1;
+    case OP_CALL: case OP_VARARG: case OP_TFORLOOP: return r >= a;
+    case OP_FORLOOP: case OP_FORPREP: return a <= r && r <= a + 3;
+    default: return testAMode(GET_OPCODE(i)) && a == r;
+  }
+}
+
+
+/* may `i' read register `r'? (the values a closure takes are apart) */
+static int usesreg (Instruction i, int r) {
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i), b = GETARG_B(i);
+  switch (op) {
+    case OP_SETGLOBAL: case OP_SETUPVAL: case OP_TEST:
+      return a == r;
+    case OP_SETTABLE:
+      return a == r || readsreg(OpArgK, b, r) ||
+             readsreg(OpArgK, GETARG_C(i), r);
+    case OP_CONCAT:
+      return b <= r && r <= GETARG_C(i);
+    case OP_CALL: case OP_TAILCALL:
+      return r >= a && (b == 0 || r < a + b);
+    case OP_RETURN:
+      return r >= a && (b == 0 || r < a + b - 1);
+    case OP_SETLIST:
+      return r >= a && (b == 0 || r <= a + b);
+    case OP_FORLOOP: case OP_FORPREP: case OP_TFORLOOP:
+      return a <= r && r <= a + 2;
+    case OP_LOADNIL: case OP_CLOSURE:
+      return 0;
+    default:
+      return getOpMode(op) == iABC &&
+             (readsreg(getBMode(op), b, r) ||
+              readsreg(getCMode(op), GETARG_C(i), r));
+  }
+}
+
+
+/* may the closures made from `p' write their upvalue `n'? */
+static int setsupval (const Proto *p, int n) {
+  int pc;
+  for (pc = 0; pc < p->sizecode; pc = nextinstr(p->code, pc)) {
+    Instruction i = p->code[pc];
+    if (GET_OPCODE(i) == OP_SETUPVAL && GETARG_B(i) == n) return 1;
+    if (GET_OPCODE(i) == OP_CLOSURE) {  /* passed on to a closure? */
+      const Proto *inner = p->p[GETARG_Bx(i)];
+      int j;
+      for (j = 0; j < inner->nups; j++) {
+        i = p->code[++pc];
+        if (GET_OPCODE(i) == OP_GETUPVAL && GETARG_B(i) == n &&
+            setsupval(inner, j))
+          return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/* may register `r' be written in [start, end), here or by a closure? */
+static int written (const Proto *f, int start, int end, int r) {
+  int pc;
+  for (pc = start; pc < end; pc = nextinstr(f->code, pc)) {
+    Instruction i = f->code[pc];
+    if (writesreg(i, r)) return 1;
+    if (GET_OPCODE(i) == OP_CLOSURE) {
+      const Proto *p = f->p[GETARG_Bx(i)];
+      int n;
+      for (n = 0; n < p->nups; n++) {
+        i = f->code[++pc];
+        if (GET_OPCODE(i) == OP_MOVE && GETARG_B(i) == r && setsupval(p, n))
+          return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/* may code outside [start - 1, end) jump into [start, end)? */
+static int jumpsinto (const Instruction *code, int n, int start, int end) {
+  int pc;
+  for (pc = 0; pc < n; pc = nextinstr(code, pc)) {
+    int t;
+    if (start - 1 <= pc && pc < end) continue;
+    if (getOpMode(GET_OPCODE(code[pc])) == iAsBx) t = jumptarget(code, pc);
+    else if (skips(code[pc])) t = pc + 2;
+    else continue;
+    if (start <= t && t < end) return 1;
+  }
+  return 0;
+}
+
+
+/* fold instruction `pc' if its operands are all constants */
+static void foldk (FuncState *fs, int pc) {
+  Proto *f = fs->f;
+  Instruction i = f->code[pc];
+  OpCode op = GET_OPCODE(i);
+  const TValue *x, *y;
+  if (getOpMode(op) != iABC || getBMode(op) != OpArgK ||
+      getCMode(op) != OpArgK || !ISK(GETARG_B(i)) || !ISK(GETARG_C(i)))
+    return;
+  x = &f->k[INDEXK(GETARG_B(i))];
+  y = &f->k[INDEXK(GETARG_C(i))];
+  switch (op) {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_MOD: case OP_POW: {
+      inlua_Number r;  /* 0 and -0 would share a constant: no zeros */
+      if (ttisnumber(x) && ttisnumber(y) &&
+          foldnum(op, nvalue(x), nvalue(y), &r) && r != 0)
+        f->code[pc] = CREATE_ABx(OP_LOADK, GETARG_A(i), luaK_numberK(fs, r));
+      break;
+    }
+    case OP_EQ: case OP_LT: case OP_LE: {
+      int res;
+      if (op == OP_EQ)
+        res = luaO_rawequalObj(x, y);
+      else if (ttisnumber(x) && ttisnumber(y))
+        res = (op == OP_LT) ? inluai_numlt(nvalue(x), nvalue(y))
+                            : inluai_numle(nvalue(x), nvalue(y));
+      else break;
+      /* jump to the next instruction (the jump) or over it */
+      f->code[pc] = CREATE_ABx(OP_JMP, 0,
+                               MAXARG_sBx + (res != GETARG_A(i)));
+      break;
+    }
+    default: break;
+  }
+}
+
+
+/*
+** make instruction `pc' use the constant `v' (index `k') instead of
+** register `r', folding it if it can; returns whether it still reads `r'
+*/
+static int putk (FuncState *fs, int pc, int r, const TValue *v, int k) {
+  Instruction *i = &fs->f->code[pc];
+  OpCode op = GET_OPCODE(*i);
+  int a = GETARG_A(*i);
+  switch (op) {
+    case OP_MOVE:  /* a nil or boolean moved is named in error messages */
+      if (!ttisnumber(v) && !ttisstring(v)) return 1;
+      *i = CREATE_ABx(OP_LOADK, a, k);
+      return 0;
+    case OP_UNM:
+      if (!ttisnumber(v) || nvalue(v) == 0) return 1;
+      *i = CREATE_ABx(OP_LOADK, a,
+                      luaK_numberK(fs, inluai_numunm(nvalue(v))));
+      return 0;
+    case OP_NOT:
+      *i = CREATE_ABC(OP_LOADBOOL, a, l_isfalse(v), 0);
+      return 0;
+    case OP_LEN:
+      if (!ttisstring(v) || tsvalue(v)->len == 0) return 1;
+      *i = CREATE_ABx(OP_LOADK, a,
+                      luaK_numberK(fs, cast_num(tsvalue(v)->len)));
+      return 0;
+    case OP_TEST: case OP_TESTSET:  /* as foldtests does */
+      if (l_isfalse(v) == GETARG_C(*i))  /* never jumps */
+        *i = CREATE_ABx(OP_JMP, 0, 1 + MAXARG_sBx);
+      else if (op == OP_TEST)  /* always jumps */
+        *i = CREATE_ABx(OP_JMP, 0, MAXARG_sBx);
+      else
+        *i = CREATE_ABx(OP_LOADK, a, k);
+      return 0;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_MOD: case OP_POW:  /* keep the name for the error message */
+      if (!ttisnumber(v)) return 1;
+      /* else go through */
+    default:
+      if (getOpMode(op) == iABC && k <= MAXINDEXRK) {
+        if (getBMode(op) == OpArgK && GETARG_B(*i) == r)
+          SETARG_B(*i, RKASK(k));
+        if (getCMode(op) == OpArgK && GETARG_C(*i) == r)
+          SETARG_C(*i, RKASK(k));
+        foldk(fs, pc);
+      }
+      return usesreg(*i, r);
+  }
+}
+
+
+/*
+** instruction `pc' loads a constant now: let the next one use it too, and
+** drop the load if that one overwrites its register (a temporary, most
+** often, which the next instruction was the only one to read)
+*/
+static void forward (FuncState *fs, const int *mark, int pc) {
+  Instruction *code = fs->f->code;
+  TValue v;
+  while (pc + 1 < fs->pc && !(mark[pc + 1] & TARGET) &&
+         loadsk(fs, code[pc], GETARG_A(code[pc]), &v)) {
+    int t = GETARG_A(code[pc]);
+    int k = (GET_OPCODE(code[pc]) == OP_LOADK) ? GETARG_Bx(code[pc])
+                                                : copyk(fs, &v);
+    if (!usesreg(code[pc + 1], t)) break;
+    if (!putk(fs, pc + 1, t, &v, k) && writesreg(code[pc + 1], t))
+      code[pc] = CREATE_ABx(OP_JMP, 0, MAXARG_sBx);  /* not needed */
+    pc++;
+  }
+}
+
+
+/*
+** Compile the variables of `fs->consts' that hold a constant as that
+** constant. Such a variable is loaded with it just before its scope
+** starts, where no jump leads, and is never written in its scope, not
+** even by a closure. Its reads take the constant as an operand instead
+** and instructions whose operands are all constants are folded. The load
+** stays, so that the debug interface still finds the value in the
+** register (though `debug.setlocal' does not reach the folded reads).
+** A variable declared with arithmetic on such variables gets its value
+** folded in time to be one too. Runs after inlining; luaK_jumps removes
+** the jumps left behind.
+*/
+void luaK_constants (FuncState *fs) {
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int n = fs->pc;
+  int *mark;
+  int c, pc;
+  if (fs->nconsts == 0) return;
+  mark = cast(int *, luaZ_openspace(fs->L, fs->ls->buff,
+                                    (n + 1) * sizeof(int)));
+  memset(mark, 0, (n + 1) * sizeof(int));
+  for (pc = 0; pc < n; pc = nextinstr(code, pc)) {
+    if (getOpMode(GET_OPCODE(code[pc])) == iAsBx)
+      mark[jumptarget(code, pc)] |= TARGET;
+    else if (skips(code[pc]) && pc + 2 < n)
+      mark[pc + 2] |= TARGET;
+  }
+  for (c = 0; c < fs->nconsts; c++) {
+    int r = fs->consts[c].reg;
+    int start = f->locvars[fs->consts[c].var].startpc;
+    int end = f->locvars[fs->consts[c].var].endpc;
+    int k;
+    TValue v;
+    if (start == 0 || !loadsk(fs, code[start - 1], r, &v) ||
+        jumpsinto(code, n, start, end) || written(f, start, end, r))
+      continue;
+    k = (GET_OPCODE(code[start - 1]) == OP_LOADK) ?
+        GETARG_Bx(code[start - 1]) : copyk(fs, &v);
+    for (pc = start; pc < end; pc = nextinstr(code, pc)) {
+      Instruction i = code[pc];
+      if (GET_OPCODE(i) == OP_CLOSURE)  /* a closure reads the register */
+        pc += f->p[GETARG_Bx(i)]->nups;
+      else if (usesreg(i, r)) {
+        putk(fs, pc, r, &v, k);
+        if (GET_OPCODE(code[pc]) != GET_OPCODE(i))
+          forward(fs, mark, pc);
+      }
+    }
+  }
+  fs->nconsts = 0;
+}
+
+/* }====================================================================== */
+
+
+/*
+** {======================================================================
+** Captured variables
+** =======================================================================
+*/
+
+/*
+** is `pc' the move of the value of a break out of [start, end)? It comes
+** after the OP_CLOSE of the variables of the loop, so writing register
+** `r' there does not change a variable that a closure shares
+*/
+static int breakmove (const Instruction *code, int pc, int end, int r) {
+  return pc > 0 && GET_OPCODE(code[pc - 1]) == OP_CLOSE &&
+         GETARG_A(code[pc - 1]) <= r && GET_OPCODE(code[pc]) == OP_MOVE &&
+         GET_OPCODE(code[pc + 1]) == OP_JMP &&
+         jumptarget(code, pc + 1) >= end;
+}
+
+
+/* may variable `r' active in [start, end) be written, here or by a closure? */
+static int changed (const Proto *f, int start, int end, int r) {
+  int pc, from = start;
+  for (pc = start; pc < end; pc = nextinstr(f->code, pc)) {
+    if (breakmove(f->code, pc, end, r)) {
+      if (written(f, from, pc, r)) return 1;
+      from = pc + 1;
+    }
+  }
+  return written(f, from, end, r);
+}
+
+
+/* is register `r' at `pc' a variable in `captures'? */
+static int listed (FuncState *fs, int pc, int r) {
+  int c;
+  for (c = 0; c < fs->ncaptures; c++) {
+    LocVar *v = &fs->f->locvars[fs->captures[c].var];
+    if (fs->captures[c].reg == r && v->startpc <= pc && pc < v->endpc)
+      return 1;
+  }
+  return 0;
+}
+
+
+/*
+** a variable that is never written while it is active, here or by a
+** closure, has the same value in every closure that captures it: they
+** get copies of the value (their OP_MOVE pseudo-instructions get A = 1)
+** instead of upvalues shared with the stack. An OP_CLOSE is then dropped
+** if no variable it may close is still shared
+*/
+void luaK_captures (FuncState *fs) {
+  Proto *f = fs->f;
+  Instruction *code = f->code;
+  int n = fs->pc;
+  int c, pc, high = -1;  /* highest register shared but not listed */
+  lu_byte shared[INLUAI_MAXCAPTURES];
+  for (c = 0; c < fs->ncaptures; c++) {
+    int r = fs->captures[c].reg;
+    int start = f->locvars[fs->captures[c].var].startpc;
+    int end = f->locvars[fs->captures[c].var].endpc;
+    shared[c] = jumpsinto(code, n, start + 1, end) ||
+                changed(f, start, end, r);
+    if (shared[c]) continue;
+    for (pc = start; pc < end; pc = nextinstr(code, pc)) {
+      if (GET_OPCODE(code[pc]) == OP_CLOSURE) {
+        int nup = f->p[GETARG_Bx(code[pc])]->nups;
+        for (; nup > 0; nup--) {
+          Instruction *i = &code[++pc];
+          if (GET_OPCODE(*i) == OP_MOVE && GETARG_B(*i) == r)
+            SETARG_A(*i, 1);
+        }
+      }
+    }
+  }
+  for (pc = 0; pc < n; pc = nextinstr(code, pc)) {
+    if (GET_OPCODE(code[pc]) == OP_CLOSURE) {
+      int nup = f->p[GETARG_Bx(code[pc])]->nups;
+      for (; nup > 0; nup--) {
+        Instruction i = code[++pc];
+        if (GET_OPCODE(i) == OP_MOVE && GETARG_A(i) == 0 &&
+            GETARG_B(i) > high && !listed(fs, pc, GETARG_B(i)))
+          high = GETARG_B(i);
+      }
+    }
+  }
+  for (pc = 0; pc < n; pc = nextinstr(code, pc)) {
+    int a = GETARG_A(code[pc]);
+    if (GET_OPCODE(code[pc]) != OP_CLOSE || a <= high) continue;
+    for (c = 0; c < fs->ncaptures; c++) {  /* a shared variable open here? */
+      LocVar *v = &f->locvars[fs->captures[c].var];
+      if (shared[c] && fs->captures[c].reg >= a &&
+          v->startpc <= pc && pc <= v->endpc)
+        break;
+    }
+    if (c == fs->ncaptures)
+      code[pc] = CREATE_ABx(OP_JMP, 0, MAXARG_sBx);
+  }
+  fs->ncaptures = 0;
+}
+
+/* }====================================================================== */
@@ -72,6 +72,12 @@ INLUAI_FUNC void luaK_prefix (FuncState *fs, UnOpr op, expdesc *v);
 INLUAI_FUNC void luaK_infix (FuncState *fs, BinOpr op, expdesc *v);
 INLUAI_FUNC void luaK_posfix (FuncState *fs, BinOpr op, expdesc *v1, expdesc *v2);
 INLUAI_FUNC void luaK_setlist (FuncState *fs, int base, int nelems, int tostore);
+INLUAI_FUNC void luaK_fuse (FuncState *fs);
+INLUAI_FUNC void luaK_inline (FuncState *fs);
+INLUAI_FUNC void luaK_constants (FuncState *fs);
+INLUAI_FUNC void luaK_captures (FuncState *fs);
+INLUAI_FUNC void luaK_jumps (FuncState *fs);
+INLUAI_FUNC void luaK_switches (FuncState *fs);
 
 
 #endif
@@ -372,6 +372,34 @@ static int db_errorfb (inlua_State *L) {
 }
 
 
+static int db_hotspots (inlua_State *L) {
+  inlua_gethotspots(L, inluaL_optint(L, 1, 10));
+  return 1;
+}
+
+
+static int writesnapshot (inlua_State *L, const void *p, size_t sz,
+                          void *f) {
+  (void)L;
+  return fwrite(p, 1, sz, (FILE *)f) != sz;
+}
+
+
+static int db_heapsnapshot (inlua_State *L) {
+  const char *filename = inluaL_checkstring(L, 1);
+  FILE *f;
+  int status;
+  inlua_gc(L, INLUA_GCCOLLECT, 0);  /* leave only live objects */
+  f = fopen(filename, "w");
+  if (f == NULL)
+    return inluaL_error(L, "cannot open %s", filename);
+  status = inlua_heapsnapshot(L, writesnapshot, f);
+  if (fclose(f) != 0 || status != 0)
+    return inluaL_error(L, "cannot write %s", filename);
+  return 0;
+}
+
+
 static const inluaL_Reg dblib[] = {
   {"debug", db_debug},
   {"getfenv", db_getfenv},
@@ -381,6 +409,8 @@ static const inluaL_Reg dblib[] = {
   {"getregistry", db_getregistry},
   {"getmetatable", db_getmetatable},
   {"getupvalue", db_getupvalue},
+  {"heapsnapshot", db_heapsnapshot},
+  {"hotspots", db_hotspots},
   {"setfenv", db_setfenv},
   {"sethook", db_sethook},
   {"setlocal", db_setlocal},
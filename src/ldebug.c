@@ -7,6 +7,7 @@
 
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
 
@@ -20,6 +21,7 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lgc.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -50,6 +52,21 @@ static int currentline (inlua_State *L, CallInfo *ci) {
 }
 
 
+/* the inlined call (see luaK_inline) that `ci' is running, or NULL */
+static const InlineCall *inlinedcall (inlua_State *L, CallInfo *ci) {
+  Proto *p;
+  if (!isLua(ci)) return NULL;
+  p = ci_func(ci)->l.p;
+  return (p->sizeinlined > 0) ? luaF_getinlined(p, currentpc(L, ci)) : NULL;
+}
+
+
+int luaG_inlined (inlua_State *L, CallInfo *ci) {
+  const InlineCall *ic = inlinedcall(L, ci);
+  return (ic) ? cast_int(ic - ci_func(ci)->l.p->inlined) : -1;
+}
+
+
 /*
 ** this function can be called asynchronous (e.g. during a signal)
 */
@@ -81,24 +98,37 @@ INLUA_API int inlua_gethookcount (inlua_State *L) {
 }
 
 
+/*
+** a Lua function running an inlined call takes two levels: the call
+** (with `i_inl' set) and then the function itself
+*/
 INLUA_API int inlua_getstack (inlua_State *L, int level, inlua_Debug *ar) {
-  int status;
+  int status = 0;  /* no such level */
   CallInfo *ci;
   lua_lock(L);
-  for (ci = L->ci; level > 0 && ci > L->base_ci; ci--) {
-    level--;
+  for (ci = L->ci; ci > L->base_ci; ci--) {
+    int inl = luaG_inlined(L, ci);
+    if (inl >= 0 && level-- == 0) {  /* level of the inlined call? */
+      status = 1;
+      ar->i_ci = cast_int(ci - L->base_ci);
+      ar->i_inl = inl;
+      break;
+    }
+    if (level-- == 0) {  /* level found? */
+      status = 1;
+      ar->i_ci = cast_int(ci - L->base_ci);
+      ar->i_inl = -1;
+      break;
+    }
     if (f_isLua(ci))  /* Lua function? */
       level -= ci->tailcalls;  /* skip lost tail calls */
+    if (level < 0) {  /* level is of a lost tail call? */
+      status = 1;
+      ar->i_ci = 0;
+      ar->i_inl = -1;
+      break;
+    }
   }
-  if (level == 0 && ci > L->base_ci) {  /* level found? */
-    status = 1;
-    ar->i_ci = cast_int(ci - L->base_ci);
-  }
-  else if (level < 0) {  /* level is of a lost tail call? */
-    status = 1;
-    ar->i_ci = 0;
-  }
-  else status = 0;  /* no such level */
   lua_unlock(L);
   return status;
 }
@@ -109,27 +139,47 @@ static Proto *getluaproto (CallInfo *ci) {
 }
 
 
-static const char *findlocal (inlua_State *L, CallInfo *ci, int n) {
-  const char *name;
+/*
+** name of local `n' of the frame `inl' of `ci' (see inlua_getstack), and
+** in `pos' its register; an inlined call has its registers above its
+** function register, which end those of `ci'
+*/
+static const char *findlocal (inlua_State *L, CallInfo *ci, int inl, int n,
+                              StkId *pos) {
+  const char *name = NULL;
   Proto *fp = getluaproto(ci);
-  if (fp && (name = luaF_getlocalname(fp, n, currentpc(L, ci))) != NULL)
-    return name;  /* is a local variable in a Lua function */
-  else {
-    StkId limit = (ci == L->ci) ? L->top : (ci+1)->func;
-    if (limit - ci->base >= n && n > 0)  /* is 'n' inside 'ci' stack? */
-      return "(*temporary)";
-    else
-      return NULL;
+  StkId base = ci->base;
+  StkId limit = (ci == L->ci) ? L->top : (ci+1)->func;
+  if (fp) {
+    int pc = currentpc(L, ci);
+    const InlineCall *ic = (fp->sizeinlined > 0) ? luaF_getinlined(fp, pc)
+                                                 : NULL;
+    if (ic && inl >= 0) {
+      base += ic->func + 1;
+      name = luaF_getinlinedname(fp, ic, n, pc);
+    }
+    else {
+      if (ic) limit = base + ic->func + 1;
+      name = luaF_getlocalname(fp, n, pc);
+    }
   }
+  *pos = base + (n - 1);
+  if (name)
+    return name;  /* is a local variable in a Lua function */
+  else if (limit - base >= n && n > 0)  /* is 'n' inside 'ci' stack? */
+    return "(*temporary)";
+  else
+    return NULL;
 }
 
 
 INLUA_API const char *inlua_getlocal (inlua_State *L, const inlua_Debug *ar, int n) {
   CallInfo *ci = L->base_ci + ar->i_ci;
-  const char *name = findlocal(L, ci, n);
+  StkId pos;
+  const char *name = findlocal(L, ci, ar->i_inl, n, &pos);
   lua_lock(L);
   if (name)
-      luaA_pushobject(L, ci->base + (n - 1));
+      luaA_pushobject(L, pos);
   lua_unlock(L);
   return name;
 }
@@ -137,10 +187,11 @@ INLUA_API const char *inlua_getlocal (inlua_State *L, const inlua_Debug *ar, int
 
 INLUA_API const char *inlua_setlocal (inlua_State *L, const inlua_Debug *ar, int n) {
   CallInfo *ci = L->base_ci + ar->i_ci;
-  const char *name = findlocal(L, ci, n);
+  StkId pos;
+  const char *name = findlocal(L, ci, ar->i_inl, n, &pos);
   lua_lock(L);
   if (name)
-      setobjs2s(L, ci->base + (n - 1), L->top - 1);
+      setobjs2s(L, pos, L->top - 1);
   L->top--;  /* pop value */
   lua_unlock(L);
   return name;
@@ -191,7 +242,7 @@ static void collectvalidlines (inlua_State *L, Closure *f) {
 
 
 static int auxgetinfo (inlua_State *L, const char *what, inlua_Debug *ar,
-                    Closure *f, CallInfo *ci) {
+                    Closure *f, CallInfo *ci, const InlineCall *ic) {
   int status = 1;
   if (f == NULL) {
     info_tailcall(ar);
@@ -203,8 +254,10 @@ static int auxgetinfo (inlua_State *L, const char *what, inlua_Debug *ar,
         funcinfo(ar, f);
         break;
       }
-      case 'l': {
-        ar->currentline = (ci) ? currentline(L, ci) : -1;
+      case 'l': {  /* a function running an inlined call is at the call */
+        ar->currentline = (ci == NULL) ? -1 :
+                          (ic && ar->i_inl < 0) ? ic->line :
+                          currentline(L, ci);
         break;
       }
       case 'u': {
@@ -212,7 +265,13 @@ static int auxgetinfo (inlua_State *L, const char *what, inlua_Debug *ar,
         break;
       }
       case 'n': {
-        ar->namewhat = (ci) ? getfuncname(L, ci, &ar->name) : NULL;
+        if (ic && ar->i_inl >= 0) {  /* named by the register it is in */
+          ar->name = luaF_getlocalname(ci_func(ci)->l.p, ic->closure + 1,
+                                       currentpc(L, ci));
+          ar->namewhat = (ar->name) ? "local" : NULL;
+        }
+        else
+          ar->namewhat = (ci) ? getfuncname(L, ci, &ar->name) : NULL;
         if (ar->namewhat == NULL) {
           ar->namewhat = "";  /* not found */
           ar->name = NULL;
@@ -233,6 +292,7 @@ INLUA_API int inlua_getinfo (inlua_State *L, const char *what, inlua_Debug *ar)
   int status;
   Closure *f = NULL;
   CallInfo *ci = NULL;
+  const InlineCall *ic = NULL;
   lua_lock(L);
   if (*what == '>') {
     StkId func = L->top - 1;
@@ -245,8 +305,13 @@ INLUA_API int inlua_getinfo (inlua_State *L, const char *what, inlua_Debug *ar)
     ci = L->base_ci + ar->i_ci;
     inlua_assert(ttisfunction(ci->func));
     f = clvalue(ci->func);
+    ic = inlinedcall(L, ci);
+    if (ic && ar->i_inl >= 0) {  /* the inlined call? */
+      StkId o = ci->base + ic->closure;
+      f = ttisfunction(o) ? clvalue(o) : NULL;
+    }
   }
-  status = auxgetinfo(L, what, ar, f, ci);
+  status = auxgetinfo(L, what, ar, f, ci, ic);
   if (strchr(what, 'f')) {
     if (f == NULL) setnilvalue(L->top);
     else setclvalue(L, L->top, f);
@@ -259,6 +324,425 @@ INLUA_API int inlua_getinfo (inlua_State *L, const char *what, inlua_Debug *ar)
 }
 
 
+/*
+** {======================================================
+** Hot spots (see `ncalls' and `loopcount' in Proto)
+** =======================================================
+*/
+
+typedef struct HotSpot {
+  Proto *p;
+  int pc;  /* back-edge instruction of a loop, or -1 for the function */
+  lu_int32 count;
+} HotSpot;
+
+
+/* insert a candidate into the `n' hottest spots found so far */
+static void addhotspot (HotSpot *h, int n, Proto *p, int pc, lu_int32 count) {
+  int i;
+  if (count == 0 || (h[n-1].p != NULL && h[n-1].count >= count)) return;
+  for (i = n - 1; i > 0 && (h[i-1].p == NULL || h[i-1].count < count); i--)
+    h[i] = h[i-1];
+  h[i].p = p;
+  h[i].pc = pc;
+  h[i].count = count;
+}
+
+
+/* first instruction of the loop closed by the back edge at `pc' */
+static int looptarget (const Proto *p, int pc) {
+  Instruction i = p->code[pc];
+  if (GET_OPCODE(i) == OP_TFORLOOP)
+    return pc + 2 + GETARG_sBx(p->code[pc + 1]);
+  return pc + 1 + GETARG_sBx(i);
+}
+
+
+static void sethotfield (inlua_State *L, Table *t, const char *k, TValue *v) {
+  setobj2t(L, luaH_setstr(L, t, luaS_new(L, k)), v);
+}
+
+
+INLUA_API int inlua_gethotspots (inlua_State *L, int n) {
+  GCObject *o;
+  Udata *u;
+  HotSpot *h;
+  Table *res;
+  int i;
+  lua_lock(L);
+  if (n < 1) n = 1;
+  /* keep candidates in a userdata, so that errors do not leak them */
+  u = luaS_newudata(L, n * sizeof(HotSpot), NULL);
+  setuvalue(L, L->top, u);
+  incr_top(L);
+  h = cast(HotSpot *, u + 1);
+  for (i = 0; i < n; i++) h[i].p = NULL;
+  for (o = G(L)->rootgc; o != NULL; o = o->gch.next) {
+    if (o->gch.tt == LUA_TPROTO) {
+      Proto *p = gco2p(o);
+      int pc;
+      addhotspot(h, n, p, -1, p->ncalls);
+      for (pc = 0; pc < p->sizeloopcount; pc++)
+        addhotspot(h, n, p, pc, p->loopcount[pc]);
+    }
+  }
+  res = luaH_new(L, n, 0);
+  sethvalue(L, L->top, res);
+  incr_top(L);
+  for (i = 0; i < n && h[i].p != NULL; i++) {
+    Proto *p = h[i].p;
+    Table *e = luaH_new(L, 0, 5);
+    char buff[INLUA_IDSIZE];
+    TValue v;
+    sethvalue(L, luaH_setnum(L, res, i + 1), e);
+    luaO_chunkid(buff, (p->source) ? getstr(p->source) : "=?", INLUA_IDSIZE);
+    setsvalue(L, &v, luaS_new(L, buff));
+    sethotfield(L, e, "source", &v);
+    setsvalue(L, &v, luaS_new(L, (h[i].pc < 0) ? "function" : "loop"));
+    sethotfield(L, e, "kind", &v);
+    setnvalue(&v, cast_num(h[i].count));
+    sethotfield(L, e, "count", &v);
+    setnvalue(&v, cast_num(p->linedefined));
+    sethotfield(L, e, "linedefined", &v);
+    setnvalue(&v, cast_num((h[i].pc < 0) ? p->linedefined :
+                           lgetline(p, looptarget(p, h[i].pc))));
+    sethotfield(L, e, "line", &v);
+  }
+  setobjs2s(L, L->top - 2, L->top - 1);  /* replace the userdata */
+  L->top--;
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return i;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Heap snapshots: every object in the heap, with its type, size, a short
+** description and the objects it refers to, written as JSON (one object
+** per line). Identifiers are object addresses, so objects that survive
+** between two snapshots of the same state keep their identifier. The
+** text is built in a buffer and given to the writer after the walk, so
+** that the writer cannot change the heap (or the string table) under it.
+** =======================================================
+*/
+
+#define SNAPNAME	40  /* longest string written as a name or label */
+
+typedef struct Snapshot {
+  inlua_State *L;
+  Mbuffer b;  /* the text so far */
+  int edges;  /* edges written for the current object */
+} Snapshot;
+
+
+static void snapput (Snapshot *S, const char *s, size_t l) {
+  Mbuffer *b = &S->b;
+  if (l > luaZ_sizebuffer(b) - luaZ_bufflen(b))
+    luaZ_resizebuffer(S->L, b, 2 * luaZ_sizebuffer(b) + l);
+  memcpy(luaZ_buffer(b) + luaZ_bufflen(b), s, l);
+  luaZ_bufflen(b) += l;
+}
+
+static void snapputs (Snapshot *S, const char *s) {
+  snapput(S, s, strlen(s));
+}
+
+
+/* writes `s' as a JSON string, cut at SNAPNAME bytes */
+static void snapstring (Snapshot *S, const char *s, size_t l) {
+  char buff[SNAPNAME * 6 + 8];
+  size_t n = 0, i;
+  buff[n++] = '"';
+  for (i = 0; i < l && i < SNAPNAME; i++) {
+    unsigned char c = cast(unsigned char, s[i]);
+    if (c == '"' || c == '\\') {
+      buff[n++] = '\\';
+      buff[n++] = c;
+    }
+    else if (c < 32 || c >= 127) {
+      sprintf(buff + n, "\\u%04x", c);
+      n += 6;
+    }
+    else buff[n++] = c;
+  }
+  if (i < l) {  /* cut? */
+    memcpy(buff + n, "...", 3);
+    n += 3;
+  }
+  buff[n++] = '"';
+  snapput(S, buff, n);
+}
+
+
+/* the address of an object, in decimal; `long' may be shorter than it */
+static void snapid (Snapshot *S, const void *p) {
+  char buff[3 * sizeof(size_t)];
+  size_t id = cast(size_t, p);
+  size_t n = sizeof(buff);
+  do {
+    buff[--n] = cast(char, '0' + id % 10);
+    id /= 10;
+  } while (id != 0);
+  snapput(S, buff + n, sizeof(buff) - n);
+}
+
+
+static void snapref (Snapshot *S, GCObject *o, const char *label, size_t l) {
+  if (o == NULL) return;
+  snapputs(S, S->edges++ ? ", [" : "[");
+  snapid(S, o);
+  snapputs(S, ", ");
+  snapstring(S, label, l);
+  snapputs(S, "]");
+}
+
+#define snapobjedge(S,o,label)	snapref(S, o, label, strlen(label))
+
+static void snapedge (Snapshot *S, const TValue *o, const char *label,
+                      size_t l) {
+  if (iscollectable(o)) snapref(S, gcvalue(o), label, l);
+}
+
+#define snapedgec(S,o,label)	snapedge(S, o, label, strlen(label))
+
+
+/* the label of the edge to a table value with key `k' */
+static void snapkeyedge (Snapshot *S, const TValue *k, const TValue *v) {
+  char buff[INLUAI_MAXNUMBER2STR + 2];
+  if (ttisstring(k))
+    snapedge(S, v, svalue(k), tsvalue(k)->len);
+  else if (ttisnumber(k)) {
+    buff[0] = '[';
+    inlua_number2str(buff + 1, nvalue(k));
+    strcat(buff, "]");
+    snapedgec(S, v, buff);
+  }
+  else
+    snapedgec(S, v, (ttisboolean(k)) ? "[boolean]" : "[object]");
+}
+
+
+static void snapname (Snapshot *S, GCObject *o) {
+  char buff[INLUA_IDSIZE + 24];
+  const char *name = "";
+  Proto *p = NULL;
+  switch (o->gch.tt) {
+    case INLUA_TSTRING: {
+      snapstring(S, getstr(rawgco2ts(o)), gco2ts(o)->len);
+      return;
+    }
+    case INLUA_TTABLE: {
+      Table *h = gco2h(o);
+      const TValue *mode = gfasttm(G(S->L), h->metatable, TM_MODE);
+      if (mode && ttisstring(mode)) {  /* weak table? */
+        sprintf(buff, "__mode=%.8s", svalue(mode));
+        name = buff;
+      }
+      break;
+    }
+    case INLUA_TFUNCTION: {
+      if (gco2cl(o)->c.isC) name = "[C]";
+      else p = gco2cl(o)->l.p;
+      break;
+    }
+    case LUA_TPROTO: p = gco2p(o); break;
+    case INLUA_TUSERDATA: {
+      if (gco2u(o)->array) name = "array";
+      break;
+    }
+    default: break;
+  }
+  if (p != NULL) {
+    char src[INLUA_IDSIZE];
+    luaO_chunkid(src, (p->source) ? getstr(p->source) : "=?", INLUA_IDSIZE);
+    sprintf(buff, "%s:%d", src, p->linedefined);
+    name = buff;
+  }
+  snapstring(S, name, strlen(name));
+}
+
+
+static void snapedges (Snapshot *S, GCObject *o) {
+  char buff[32];
+  int i;
+  switch (o->gch.tt) {
+    case INLUA_TTABLE: {
+      Table *h = gco2h(o);
+      snapobjedge(S, obj2gco(h->metatable), "metatable");
+      for (i = 0; i < h->sizearray; i++) {
+        if (iscollectable(&h->array[i])) {
+          sprintf(buff, "[%d]", i + 1);
+          snapedgec(S, &h->array[i], buff);
+        }
+      }
+      for (i = 0; i < sizenode(h); i++) {
+        Node *n = gnode(h, i);
+        if (ttisnil(gval(n))) continue;
+        snapedgec(S, key2tval(n), "key");
+        snapkeyedge(S, key2tval(n), gval(n));
+      }
+      break;
+    }
+    case INLUA_TFUNCTION: {
+      Closure *cl = gco2cl(o);
+      snapobjedge(S, obj2gco(cl->c.env), "env");
+      if (cl->c.isC) {
+        for (i = 0; i < cl->c.nupvalues; i++)
+          snapedgec(S, &cl->c.upvalue[i], "upvalue");
+      }
+      else {
+        Proto *p = cl->l.p;
+        snapobjedge(S, obj2gco(p), "proto");
+        for (i = 0; i < cl->l.nupvalues; i++) {
+          TString *name = (i < p->sizeupvalues) ? p->upvalues[i] : NULL;
+          UpVal *uv = cl->l.upvals[i];
+          if (iscopy(&cl->l, uv)) {  /* a value kept in the closure */
+            if (name) snapedge(S, uv->v, getstr(name), name->tsv.len);
+            else snapedgec(S, uv->v, "upvalue");
+          }
+          else if (name)
+            snapref(S, obj2gco(uv), getstr(name), name->tsv.len);
+          else
+            snapobjedge(S, obj2gco(uv), "upvalue");
+        }
+      }
+      break;
+    }
+    case LUA_TUPVAL: {
+      snapedgec(S, gco2uv(o)->v, "value");
+      break;
+    }
+    case INLUA_TUSERDATA: {
+      snapobjedge(S, obj2gco(gco2u(o)->metatable), "metatable");
+      snapobjedge(S, obj2gco(gco2u(o)->env), "env");
+      break;
+    }
+    case INLUA_TTHREAD: {
+      inlua_State *th = gco2th(o);
+      StkId s;
+      GCObject *uv;
+      snapedgec(S, gt(th), "globals");
+      for (s = th->stack; s < th->top; s++)
+        snapedgec(S, s, "stack");
+      for (uv = th->openupval; uv != NULL; uv = uv->gch.next)
+        snapobjedge(S, uv, "upvalue");
+      break;
+    }
+    case LUA_TPROTO: {
+      Proto *p = gco2p(o);
+      snapobjedge(S, obj2gco(p->source), "source");
+      for (i = 0; i < p->sizek; i++)
+        snapedgec(S, &p->k[i], "constant");
+      for (i = 0; i < p->sizep; i++)
+        snapobjedge(S, obj2gco(p->p[i]), "proto");
+      for (i = 0; i < p->sizeupvalues; i++)
+        snapobjedge(S, obj2gco(p->upvalues[i]), "name");
+      for (i = 0; i < p->sizelocvars; i++)
+        snapobjedge(S, obj2gco(p->locvars[i].varname), "name");
+      for (i = 0; i < p->sizeswitches; i++)
+        snapobjedge(S, obj2gco(p->switches[i]), "switch");
+      break;
+    }
+    default: break;  /* strings refer to nothing */
+  }
+}
+
+
+static void snapobject (Snapshot *S, GCObject *o, int *first) {
+  char buff[64];
+  snapputs(S, *first ? "  [" : ",\n  [");
+  *first = 0;
+  snapid(S, o);
+  sprintf(buff, ", \"%s\", %lu, ", (o->gch.tt == LUA_TPROTO) ? "proto" :
+          (o->gch.tt == LUA_TUPVAL) ? "upvalue" : luaT_typenames[o->gch.tt],
+          cast(unsigned long, luaC_objsize(o)));
+  snapputs(S, buff);
+  snapname(S, o);
+  snapputs(S, ", [");
+  S->edges = 0;
+  snapedges(S, o);
+  snapputs(S, "]]");
+}
+
+
+static void snaproot (Snapshot *S, const char *name, const TValue *o) {
+  if (!iscollectable(o)) return;
+  snapputs(S, S->edges++ ? ", [" : "[");
+  snapstring(S, name, strlen(name));
+  snapputs(S, ", ");
+  snapid(S, gcvalue(o));
+  snapputs(S, "]");
+}
+
+
+static void f_snapshot (inlua_State *L, void *ud) {
+  global_State *g = G(L);
+  Snapshot *S = cast(Snapshot *, ud);
+  GCObject *o;
+  UpVal *uv;
+  TValue v;
+  int i, first = 1;
+  snapputs(S, "{\"version\": 1,\n \"roots\": [");
+  snaproot(S, "registry", registry(L));
+  setthvalue(L, &v, g->mainthread);
+  snaproot(S, "mainthread", &v);
+  for (i = 0; i < NUM_TAGS; i++) {
+    if (g->mt[i]) {
+      char name[32];
+      sprintf(name, "metatable.%s", luaT_typenames[i]);
+      sethvalue(L, &v, g->mt[i]);
+      snaproot(S, name, &v);
+    }
+  }
+  snapputs(S, "],\n \"objects\": [\n");
+  for (o = g->rootgc; o != NULL; o = o->gch.next)
+    snapobject(S, o, &first);
+  for (i = 0; i < g->strt.size; i++)
+    for (o = g->strt.hash[i]; o != NULL; o = o->gch.next)
+      snapobject(S, o, &first);
+  if (g->tmudata) {  /* userdata waiting for their finalizers */
+    o = g->tmudata;
+    do {
+      o = o->gch.next;
+      snapobject(S, o, &first);
+    } while (o != g->tmudata);
+  }
+  for (uv = g->uvhead.u.l.next; uv != &g->uvhead; uv = uv->u.l.next)
+    snapobject(S, obj2gco(uv), &first);
+  snapputs(S, "\n]}\n");
+}
+
+
+INLUA_API int inlua_heapsnapshot (inlua_State *L, inlua_Writer writer,
+                                  void *data) {
+  Snapshot S;
+  int status;
+  lua_lock(L);
+  S.L = L;
+  S.edges = 0;
+  luaZ_initbuffer(L, &S.b);
+  luaZ_resetbuffer(&S.b);
+  status = luaD_pcall(L, f_snapshot, &S, savestack(L, L->top), L->errfunc);
+  if (status == 0) {
+    lua_unlock(L);
+    status = (*writer)(L, luaZ_buffer(&S.b), luaZ_bufflen(&S.b), data);
+    lua_lock(L);
+  }
+  else
+    L->top--;  /* remove the error message */
+  luaZ_freebuffer(L, &S.b);
+  lua_unlock(L);
+  return status;
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** Symbolic Execution and code checker
@@ -273,6 +757,25 @@ INLUA_API int inlua_getinfo (inlua_State *L, const char *what, inlua_Debug *ar)
 
 
 
+/* inlined calls cover code and locals of `pt', the latter in order */
+static int checkinlined (const Proto *pt) {
+  int var = (pt->sizeinlined > 0) ? pt->inlined[0].firstvar : 0;
+  int i;
+  check(var >= 0);
+  for (i = 0; i < pt->sizeinlined; i++) {
+    const InlineCall *ic = &pt->inlined[i];
+    check(0 <= ic->startpc && ic->startpc <= ic->endpc &&
+          ic->endpc <= pt->sizecode);
+    check(0 <= ic->closure && ic->closure <= ic->func &&
+          ic->func < pt->maxstacksize);
+    check(ic->firstvar == var && ic->nvars >= 0);
+    var += ic->nvars;
+  }
+  check(var <= pt->sizelocvars);
+  return 1;
+}
+
+
 static int precheck (const Proto *pt) {
   check(pt->maxstacksize <= MAXSTACK);
   check(pt->numparams+(pt->is_vararg & VARARG_HASARG) <= pt->maxstacksize);
@@ -281,6 +784,7 @@ static int precheck (const Proto *pt) {
   check(pt->sizeupvalues <= pt->nups);
   check(pt->sizelineinfo == pt->sizecode || pt->sizelineinfo == 0);
   check(pt->sizecode > 0 && GET_OPCODE(pt->code[pt->sizecode-1]) == OP_RETURN);
+  check(checkinlined(pt));
   return 1;
 }
 
@@ -460,6 +964,26 @@ static Instruction symbexec (const Proto *pt, int lastpc, int reg) {
           pc += nup;  /* do not 'execute' these pseudo-instructions */
         break;
       }
+      case OP_GETTABLEOP: {
+        OpCode op1;
+        check(pc + 1 < pt->sizecode);
+        op1 = GET_OPCODE(pt->code[pc + 1]);
+        check(op1 == OP_ADD || op1 == OP_SUB || op1 == OP_MUL ||
+              op1 == OP_DIV || op1 == OP_LT || op1 == OP_LE ||
+              op1 == OP_ADDLOOP);
+        break;
+      }
+      case OP_ADDLOOP:
+      case OP_SETTABLELOOP: {
+        check(pc + 1 < pt->sizecode);
+        check(GET_OPCODE(pt->code[pc + 1]) == OP_FORLOOP);
+        break;
+      }
+      case OP_SWITCH: {
+        check(pc + 1 < pt->sizecode);
+        check(GET_OPCODE(pt->code[pc + 1]) == OP_EQ);
+        break;
+      }
       case OP_VARARG: {
         check((pt->is_vararg & VARARG_ISVARARG) &&
              !(pt->is_vararg & VARARG_NEEDSARG));
@@ -499,8 +1023,13 @@ static const char *getobjname (inlua_State *L, CallInfo *ci, int stackpos,
   if (isLua(ci)) {  /* a Lua function? */
     Proto *p = ci_func(ci)->l.p;
     int pc = currentpc(L, ci);
+    const InlineCall *ic = (p->sizeinlined > 0) ? luaF_getinlined(p, pc)
+                                                : NULL;
     Instruction i;
-    *name = luaF_getlocalname(p, stackpos+1, pc);
+    if (ic && stackpos > ic->func)  /* a register of an inlined call? */
+      *name = luaF_getinlinedname(p, ic, stackpos - ic->func, pc);
+    else
+      *name = luaF_getlocalname(p, stackpos+1, pc);
     if (*name)  /* is a local? */
       return "local";
     i = symbexec(p, pc, stackpos);  /* try symbolic execution */
@@ -519,7 +1048,8 @@ static const char *getobjname (inlua_State *L, CallInfo *ci, int stackpos,
           return getobjname(L, ci, b, name);  /* get name for `b' */
         break;
       }
-      case OP_GETTABLE: {
+      case OP_GETTABLE:
+      case OP_GETTABLEOP: {
         int k = GETARG_C(i);  /* key index */
         *name = kname(p, k);
         return "field";
@@ -17,6 +17,10 @@
 
 #define resethookcount(L)	(L->hookcount = L->basehookcount)
 
+/* hooks that must see each instruction of `p' (see `traceexec') */
+#define tracedhooks(p)	(INLUA_MASKLINE | INLUA_MASKCOUNT | \
+			 ((p)->sizeinlined > 0 ? INLUA_MASKCALL | INLUA_MASKRET : 0))
+
 
 INLUAI_FUNC void luaG_typeerror (inlua_State *L, const TValue *o,
                                              const char *opname);
@@ -29,5 +33,6 @@ INLUAI_FUNC void luaG_runerror (inlua_State *L, const char *fmt, ...);
 INLUAI_FUNC void luaG_errormsg (inlua_State *L);
 INLUAI_FUNC int luaG_checkcode (const Proto *pt);
 INLUAI_FUNC int luaG_checkopenop (Instruction i);
+INLUAI_FUNC int luaG_inlined (inlua_State *L, CallInfo *ci);
 
 #endif
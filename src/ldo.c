@@ -18,6 +18,7 @@
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lopcodes.h"
@@ -186,10 +187,13 @@ void luaD_callhook (inlua_State *L, int event, int line) {
     inlua_Debug ar;
     ar.event = event;
     ar.currentline = line;
+    ar.i_inl = -1;
     if (event == INLUA_HOOKTAILRET)
       ar.i_ci = 0;  /* tail call; no debug information about it */
-    else
+    else {
       ar.i_ci = cast_int(L->ci - L->base_ci);
+      ar.i_inl = luaG_inlined(L, L->ci);
+    }
     luaD_checkstack(L, INLUA_MINSTACK);  /* ensure minimum stack size */
     L->ci->top = L->top + INLUA_MINSTACK;
     inlua_assert(L->ci->top <= L->stack_last);
@@ -297,6 +301,11 @@ int luaD_precall (inlua_State *L, StkId func, int nresults) {
     for (st = L->top; st < ci->top; st++)
       setnilvalue(st);
     L->top = ci->top;
+    p->ncalls++;
+#if defined(INLUA_USE_JIT)
+    if (luaJ_hot(p))  /* called often enough? */
+      luaJ_compile(L, p);
+#endif
     if (L->hookmask & INLUA_MASKCALL) {
       L->savedpc++;  /* hooks assume 'pc' is already incremented */
       luaD_callhook(L, INLUA_HOOKCALL, -1);
@@ -497,7 +506,7 @@ static void f_parser (inlua_State *L, void *ud) {
   luaC_checkGC(L);
   tf = ((c == INLUA_SIGNATURE[0]) ? luaU_undump : luaY_parser)(L, p->z,
                                                              &p->buff, p->name);
-  cl = luaF_newLclosure(L, tf->nups, hvalue(gt(L)));
+  cl = luaF_newLclosure(L, tf->nups, 0, hvalue(gt(L)));
   cl->l.p = tf;
   for (i = 0; i < tf->nups; i++)  /* initialize eventual upvalues */
     cl->l.upvals[i] = luaF_newupval(L);
@@ -506,14 +515,33 @@ static void f_parser (inlua_State *L, void *ud) {
 }
 
 
-int luaD_protectedparser (inlua_State *L, ZIO *z, const char *name) {
+static void f_data (inlua_State *L, void *ud) {
+  struct SParser *p = cast(struct SParser *, ud);
+  luaC_checkGC(L);
+  luaY_data(L, p->z, &p->buff, p->name);
+  luaC_checkGC(L);
+}
+
+
+static int protectedload (inlua_State *L, ZIO *z, const char *name,
+                          Pfunc f) {
   struct SParser p;
   int status;
   p.z = z; p.name = name;
   luaZ_initbuffer(L, &p.buff);
-  status = luaD_pcall(L, f_parser, &p, savestack(L, L->top), L->errfunc);
+  status = luaD_pcall(L, f, &p, savestack(L, L->top), L->errfunc);
   luaZ_freebuffer(L, &p.buff);
   return status;
 }
 
 
+int luaD_protectedparser (inlua_State *L, ZIO *z, const char *name) {
+  return protectedload(L, z, name, f_parser);
+}
+
+
+int luaD_protecteddata (inlua_State *L, ZIO *z, const char *name) {
+  return protectedload(L, z, name, f_data);
+}
+
+
@@ -38,6 +38,7 @@
 typedef void (*Pfunc) (inlua_State *L, void *ud);
 
 INLUAI_FUNC int luaD_protectedparser (inlua_State *L, ZIO *z, const char *name);
+INLUAI_FUNC int luaD_protecteddata (inlua_State *L, ZIO *z, const char *name);
 INLUAI_FUNC void luaD_callhook (inlua_State *L, int event, int line);
 INLUAI_FUNC int luaD_precall (inlua_State *L, StkId func, int nresults);
 INLUAI_FUNC void luaD_call (inlua_State *L, StkId func, int nResults);
@@ -124,6 +124,19 @@ static void DumpDebug(const Proto* f, DumpState* D)
  n= (D->strip) ? 0 : f->sizeupvalues;
  DumpInt(n,D);
  for (i=0; i<n; i++) DumpString(f->upvalues[i],D);
+ n= (D->strip) ? 0 : f->sizeinlined;
+ DumpInt(n,D);
+ for (i=0; i<n; i++)
+ {
+  const InlineCall* ic=&f->inlined[i];
+  DumpInt(ic->startpc,D);
+  DumpInt(ic->endpc,D);
+  DumpInt(ic->line,D);
+  DumpInt(ic->func,D);
+  DumpInt(ic->closure,D);
+  DumpInt(ic->firstvar,D);
+  DumpInt(ic->nvars,D);
+ }
 }
 
 static void DumpFunction(const Proto* f, const TString* p, DumpState* D)
@@ -14,35 +14,70 @@
 
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
+#include "ltable.h"
 
 
 
 Closure *luaF_newCclosure (inlua_State *L, int nelems, Table *e) {
-  Closure *c = cast(Closure *, luaM_malloc(L, sizeCclosure(nelems)));
+  Closure *c;
+  luaM_tag(L, INLUA_TFUNCTION);
+  c = cast(Closure *, luaM_malloc(L, sizeCclosure(nelems)));
   luaC_link(L, obj2gco(c), INLUA_TFUNCTION);
   c->c.isC = 1;
   c->c.env = e;
   c->c.nupvalues = cast_byte(nelems);
+  c->c.ncopies = 0;
   return c;
 }
 
 
-Closure *luaF_newLclosure (inlua_State *L, int nelems, Table *e) {
-  Closure *c = cast(Closure *, luaM_malloc(L, sizeLclosure(nelems)));
+Closure *luaF_newLclosure (inlua_State *L, int nelems, int ncopies,
+                           Table *e) {
+  Closure *c;
+  UpVal *uv;
+  luaM_tag(L, INLUA_TFUNCTION);
+  c = cast(Closure *, luaM_malloc(L, sizeLclosure(nelems, ncopies)));
   luaC_link(L, obj2gco(c), INLUA_TFUNCTION);
   c->l.isC = 0;
   c->l.env = e;
   c->l.nupvalues = cast_byte(nelems);
+  c->l.ncopies = cast_byte(ncopies);
   while (nelems--) c->l.upvals[nelems] = NULL;
+  for (uv = getcopies(&c->l); ncopies--; uv++) {
+    uv->tt = LUA_TUPVAL;
+    uv->marked = 0;  /* never white: marked with the closure */
+    uv->v = &uv->u.value;
+    setnilvalue(uv->v);
+  }
   return c;
 }
 
 
+/*
+** number of the upvalues given by the pseudo-instructions at `pc' (after
+** an OP_CLOSURE of `cl') that the new closure copies in: variables marked
+** to be copied, and upvalues that are copies in `cl'
+*/
+int luaF_ncopies (const LClosure *cl, const Instruction *pc, int nup) {
+  int n = 0;
+  for (; nup > 0; nup--, pc++) {
+    if (GET_OPCODE(*pc) == OP_MOVE ? GETARG_A(*pc) != 0 :
+                                     iscopy(cl, cl->upvals[GETARG_B(*pc)]))
+      n++;
+  }
+  return n;
+}
+
+
 UpVal *luaF_newupval (inlua_State *L) {
-  UpVal *uv = luaM_new(L, UpVal);
+  UpVal *uv;
+  luaM_tag(L, LUA_TUPVAL);
+  uv = luaM_new(L, UpVal);
   luaC_link(L, obj2gco(uv), LUA_TUPVAL);
   uv->v = &uv->u.value;
   setnilvalue(uv->v);
@@ -64,6 +99,7 @@ UpVal *luaF_findupval (inlua_State *L, StkId level) {
     }
     pp = &p->next;
   }
+  luaM_tag(L, LUA_TUPVAL);
   uv = luaM_new(L, UpVal);  /* not found: create a new one */
   uv->tt = LUA_TUPVAL;
   uv->marked = luaC_white(g);
@@ -113,7 +149,9 @@ void luaF_close (inlua_State *L, StkId level) {
 
 
 Proto *luaF_newproto (inlua_State *L) {
-  Proto *f = luaM_new(L, Proto);
+  Proto *f;
+  luaM_tag(L, LUA_TPROTO);
+  f = luaM_new(L, Proto);
   luaC_link(L, obj2gco(f), LUA_TPROTO);
   f->k = NULL;
   f->sizek = 0;
@@ -128,47 +166,177 @@ Proto *luaF_newproto (inlua_State *L) {
   f->numparams = 0;
   f->is_vararg = 0;
   f->maxstacksize = 0;
+  f->nilregs = 0;
   f->lineinfo = NULL;
   f->sizelocvars = 0;
   f->locvars = NULL;
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+  f->jit = NULL;
+  f->ncalls = 0;
+  f->loopcount = NULL;
+  f->sizeloopcount = 0;
+  f->switches = NULL;
+  f->sizeswitches = 0;
+  f->inlined = NULL;
+  f->sizeinlined = 0;
   return f;
 }
 
 
+/*
+** create the loop counters of a function; done on its first taken back
+** edge (or when it is compiled), so that functions without loops or whose
+** loops never run do not pay for them
+*/
+void luaF_initcounts (inlua_State *L, Proto *f) {
+  int i;
+  luaM_tag(L, LUA_TPROTO);
+  f->loopcount = luaM_newvector(L, f->sizecode, lu_int32);
+  f->sizeloopcount = f->sizecode;
+  for (i = 0; i < f->sizecode; i++) f->loopcount[i] = 0;
+}
+
+
+/*
+** the arm of a chain of equality tests at `pc' (see OP_SWITCH): an OP_EQ
+** of register `*reg' (of any register if it is -1; it is set then)
+** against a number or string constant, followed by its jump. Returns the
+** index of the constant and where the arm goes when the test passes and
+** when it fails, or -1 if there is no such arm at `pc'
+*/
+int luaF_switcharm (const Proto *f, int n, int pc, int *reg,
+                    int *match, int *miss) {
+  Instruction i, j;
+  int b, c, k, skip;
+  if (pc + 1 >= n) return -1;
+  i = f->code[pc];
+  j = f->code[pc + 1];
+  if (GET_OPCODE(i) != OP_EQ || GET_OPCODE(j) != OP_JMP) return -1;
+  b = GETARG_B(i);
+  c = GETARG_C(i);
+  if (ISK(b) == ISK(c)) return -1;  /* not a register and a constant */
+  k = ISK(b) ? INDEXK(b) : INDEXK(c);
+  if (!ttisnumber(&f->k[k]) && !ttisstring(&f->k[k])) return -1;
+  if (*reg == -1) *reg = ISK(b) ? c : b;
+  else if (*reg != (ISK(b) ? c : b)) return -1;
+  skip = pc + 2;  /* where a skipped jump goes */
+  *match = GETARG_A(i) ? pc + 2 + GETARG_sBx(j) : skip;
+  *miss = GETARG_A(i) ? skip : pc + 2 + GETARG_sBx(j);
+  if (*match < 0 || *match >= n || *miss < 0 || *miss >= n) return -1;
+  return k;
+}
+
+
+/*
+** build the table of each OP_SWITCH of `f' (once its code and constants
+** are complete), which maps the constant of each arm to where the arm
+** goes, and `true' to where the chain ends. The first arm of a constant
+** wins, as in the chain. If the code does not have the arms the
+** instruction says, the table stops at the last one found
+*/
+void luaF_initswitches (inlua_State *L, Proto *f) {
+  int pc, n = 0, s = 0;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    if (GET_OPCODE(i) == OP_SWITCH) n++;
+    else if (GET_OPCODE(i) == OP_SETLIST && GETARG_C(i) == 0) pc++;
+  }
+  if (n == 0) return;
+  luaM_tag(L, LUA_TPROTO);
+  f->switches = luaM_newvector(L, n, Table *);
+  for (s = 0; s < n; s++) f->switches[s] = NULL;
+  f->sizeswitches = n;
+  for (pc = 0, s = 0; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    if (GET_OPCODE(i) == OP_SWITCH) {
+      Table *t = luaH_new(L, 0, GETARG_B(i) + 1);
+      int arm, reg = GETARG_A(i), next = pc + 1;
+      TValue key;
+      f->switches[s] = t;
+      luaC_objbarrier(L, f, t);
+      SETARG_C(f->code[pc], s++);
+      for (arm = 0; arm < GETARG_B(i); arm++) {
+        int match, miss;
+        int k = luaF_switcharm(f, f->sizecode, next, &reg, &match, &miss);
+        if (k < 0 || miss <= next) break;
+        if (ttisnil(luaH_get(t, &f->k[k])))
+          setnvalue(luaH_set(L, t, &f->k[k]), cast_num(match));
+        next = miss;
+      }
+      setbvalue(&key, 1);
+      setnvalue(luaH_set(L, t, &key), cast_num(next));
+    }
+    else if (GET_OPCODE(i) == OP_SETLIST && GETARG_C(i) == 0) pc++;
+  }
+}
+
+
 void luaF_freeproto (inlua_State *L, Proto *f) {
+  luaJ_free(L, f);
   luaM_freearray(L, f->code, f->sizecode, Instruction);
   luaM_freearray(L, f->p, f->sizep, Proto *);
   luaM_freearray(L, f->k, f->sizek, TValue);
   luaM_freearray(L, f->lineinfo, f->sizelineinfo, int);
   luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar);
   luaM_freearray(L, f->upvalues, f->sizeupvalues, TString *);
+  luaM_freearray(L, f->loopcount, f->sizeloopcount, lu_int32);
+  luaM_freearray(L, f->switches, f->sizeswitches, Table *);
+  luaM_freearray(L, f->inlined, f->sizeinlined, InlineCall);
   luaM_free(L, f);
 }
 
 
 void luaF_freeclosure (inlua_State *L, Closure *c) {
   int size = (c->c.isC) ? sizeCclosure(c->c.nupvalues) :
-                          sizeLclosure(c->l.nupvalues);
+                          sizeLclosure(c->l.nupvalues, c->l.ncopies);
   luaM_freemem(L, c, size);
 }
 
 
+static const char *localname (const LocVar *v, int nvars, int local_number,
+                               int pc) {
+  int i;
+  for (i = 0; i<nvars && v[i].startpc <= pc; i++) {
+    if (pc < v[i].endpc) {  /* is variable active? */
+      local_number--;
+      if (local_number == 0)
+        return getstr(v[i].varname);
+    }
+  }
+  return NULL;  /* not found */
+}
+
+
 /*
 ** Look for n-th local variable at line `line' in function `func'.
 ** Returns NULL if not found.
 */
 const char *luaF_getlocalname (const Proto *f, int local_number, int pc) {
+  int nvars = (f->sizeinlined > 0) ? f->inlined[0].firstvar : f->sizelocvars;
+  return localname(f->locvars, nvars, local_number, pc);
+}
+
+
+/*
+** Look for n-th local variable of the inlined call `ic' at `pc'
+*/
+const char *luaF_getinlinedname (const Proto *f, const InlineCall *ic,
+                                 int local_number, int pc) {
+  return localname(f->locvars + ic->firstvar, ic->nvars, local_number, pc);
+}
+
+
+/*
+** inlined call whose copy holds instruction `pc', or NULL
+*/
+const InlineCall *luaF_getinlined (const Proto *f, int pc) {
   int i;
-  for (i = 0; i<f->sizelocvars && f->locvars[i].startpc <= pc; i++) {
-    if (pc < f->locvars[i].endpc) {  /* is variable active? */
-      local_number--;
-      if (local_number == 0)
-        return getstr(f->locvars[i].varname);
-    }
+  for (i = 0; i < f->sizeinlined; i++) {
+    if (f->inlined[i].startpc <= pc && pc < f->inlined[i].endpc)
+      return &f->inlined[i];
   }
-  return NULL;  /* not found */
+  return NULL;
 }
 
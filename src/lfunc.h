@@ -14,13 +14,36 @@
 #define sizeCclosure(n)	(cast(int, sizeof(CClosure)) + \
                          cast(int, sizeof(TValue)*((n)-1)))
 
-#define sizeLclosure(n)	(cast(int, sizeof(LClosure)) + \
+#define sizeLclosure(n,k)	((k) == 0 ? upvalsLclosure(n) : \
+                         copiesLclosure(n) + cast(int, sizeof(UpVal)*(k)))
+
+#define upvalsLclosure(n)	(cast(int, sizeof(LClosure)) + \
                          cast(int, sizeof(TValue *)*((n)-1)))
 
+/* where the values copied into a Lua closure start (aligned) */
+#define copiesLclosure(n)	((upvalsLclosure(n) + ALIGNLCLOSURE) & \
+                         ~ALIGNLCLOSURE)
+#define ALIGNLCLOSURE	(cast(int, sizeof(L_Umaxalign)) - 1)
+
+#define getcopies(cl)	cast(UpVal *, cast(lu_byte *, (cl)) + \
+                         copiesLclosure((cl)->nupvalues))
+
+/* is upvalue `uv' of Lua closure `cl' a copied value? */
+#define iscopy(cl,uv)	(cast(lu_mem, cast(lu_byte *, (uv)) - \
+                          cast(lu_byte *, getcopies(cl))) < \
+                         cast(lu_mem, sizeof(UpVal)*(cl)->ncopies))
+
 
 INLUAI_FUNC Proto *luaF_newproto (inlua_State *L);
+INLUAI_FUNC void luaF_initcounts (inlua_State *L, Proto *f);
+INLUAI_FUNC int luaF_switcharm (const Proto *f, int n, int pc, int *reg,
+                              int *match, int *miss);
+INLUAI_FUNC void luaF_initswitches (inlua_State *L, Proto *f);
 INLUAI_FUNC Closure *luaF_newCclosure (inlua_State *L, int nelems, Table *e);
-INLUAI_FUNC Closure *luaF_newLclosure (inlua_State *L, int nelems, Table *e);
+INLUAI_FUNC Closure *luaF_newLclosure (inlua_State *L, int nelems, int ncopies,
+                                      Table *e);
+INLUAI_FUNC int luaF_ncopies (const LClosure *cl, const Instruction *pc,
+                            int nup);
 INLUAI_FUNC UpVal *luaF_newupval (inlua_State *L);
 INLUAI_FUNC UpVal *luaF_findupval (inlua_State *L, StkId level);
 INLUAI_FUNC void luaF_close (inlua_State *L, StkId level);
@@ -29,6 +52,10 @@ INLUAI_FUNC void luaF_freeclosure (inlua_State *L, Closure *c);
 INLUAI_FUNC void luaF_freeupval (inlua_State *L, UpVal *uv);
 INLUAI_FUNC const char *luaF_getlocalname (const Proto *func, int local_number,
                                          int pc);
+INLUAI_FUNC const char *luaF_getinlinedname (const Proto *f,
+                                           const InlineCall *ic,
+                                           int local_number, int pc);
+INLUAI_FUNC const InlineCall *luaF_getinlined (const Proto *f, int pc);
 
 
 #endif
@@ -5,6 +5,7 @@
 */
 
 #include <string.h>
+#include <time.h>
 
 #define lgc_c
 #define INLUA_CORE
@@ -28,6 +29,9 @@
 #define GCSWEEPCOST	10
 #define GCFINALIZECOST	100
 
+/* least cost per unit of work (seconds), so that step sizes stay finite */
+#define GCMINUNITCOST	1e-12
+
 
 #define maskmarks	cast_byte(~(bitmask(BLACKBIT)|WHITEBITS))
 
@@ -56,7 +60,9 @@
 		reallymarkobject(g, obj2gco(t)); }
 
 
-#define setthreshold(g)  (g->GCthreshold = (g->estimate/100) * g->gcpause)
+/* in pause-target mode, start halfway to the growth budget */
+#define setthreshold(g)  (g->GCthreshold = (g->gctarget) ? \
+	(g->estimate/200) * (100 + g->gcgrowth) : (g->estimate/100) * g->gcpause)
 
 
 static void removeentry (Node *n) {
@@ -155,6 +161,237 @@ size_t luaC_separateudata (inlua_State *L, int all) {
 }
 
 
+#if defined(INLUA_USE_PARALLELGC)
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+** {======================================================
+** Freeing in parallel. If the allocator is thread-safe, a helper thread
+** frees the blocks of dead objects: sweep steps collect them in a batch,
+** handed over when it is full and at the end of the sweep, so freeing
+** overlaps with the program.
+** =======================================================
+*/
+
+typedef struct FreeBatch {
+  int n;
+  struct {
+    void *block;
+    size_t size;
+  } b[INLUAI_GCFREEBATCH];
+} FreeBatch;
+
+
+enum { HIDLE, HWORK, HQUIT };
+
+typedef struct GCHelper {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int state;
+  FreeBatch *pending;  /* blocks freed by the current sweep step */
+  FreeBatch *freeing;  /* blocks being freed by the helper */
+  inlua_Alloc frealloc;
+  void *ud;
+  FreeBatch batch[2];
+} GCHelper;
+
+
+static void freeblocks (GCHelper *h) {
+  FreeBatch *b = h->freeing;
+  int i;
+  for (i = 0; i < b->n; i++)
+    (*h->frealloc)(h->ud, b->b[i].block, b->b[i].size, 0);
+  b->n = 0;
+}
+
+
+static void *helpermain (void *ud) {
+  GCHelper *h = cast(GCHelper *, ud);
+  pthread_mutex_lock(&h->lock);
+  for (;;) {
+    while (h->state == HIDLE)
+      pthread_cond_wait(&h->cond, &h->lock);
+    if (h->state == HQUIT) break;
+    pthread_mutex_unlock(&h->lock);
+    freeblocks(h);
+    pthread_mutex_lock(&h->lock);
+    h->state = HIDLE;
+    pthread_cond_broadcast(&h->cond);
+  }
+  pthread_mutex_unlock(&h->lock);
+  return NULL;
+}
+
+
+/* the helper, started if needed; NULL if it is off or cannot run */
+static GCHelper *gethelper (global_State *g) {
+  GCHelper *h = g->helper;
+  if (!g->gcusehelper) return NULL;
+  if (h == NULL) {
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {  /* nothing to gain? */
+      g->gcusehelper = 0;
+      return NULL;
+    }
+    h = cast(GCHelper *, malloc(sizeof(GCHelper)));
+    if (h == NULL) {
+      g->gcusehelper = 0;
+      return NULL;
+    }
+    pthread_mutex_init(&h->lock, NULL);
+    pthread_cond_init(&h->cond, NULL);
+    h->state = HIDLE;
+    h->pending = &h->batch[0];
+    h->freeing = &h->batch[1];
+    h->pending->n = h->freeing->n = 0;
+    if (pthread_create(&h->thread, NULL, helpermain, h) != 0) {
+      pthread_cond_destroy(&h->cond);
+      pthread_mutex_destroy(&h->lock);
+      free(h);
+      g->gcusehelper = 0;  /* do not try again */
+      return NULL;
+    }
+    g->helper = h;
+  }
+  return h;
+}
+
+
+/* waits until the helper has finished its job */
+static void waithelper (GCHelper *h) {
+  pthread_mutex_lock(&h->lock);
+  while (h->state == HWORK)
+    pthread_cond_wait(&h->cond, &h->lock);
+  pthread_mutex_unlock(&h->lock);
+}
+
+
+/* wakes up the helper; it must be idle */
+static void runhelper (GCHelper *h) {
+  pthread_mutex_lock(&h->lock);
+  h->state = HWORK;
+  pthread_cond_broadcast(&h->cond);
+  pthread_mutex_unlock(&h->lock);
+}
+
+
+/* frees the blocks still pending, with the current allocator, and stops */
+void luaC_stophelper (inlua_State *L) {
+  global_State *g = G(L);
+  GCHelper *h = g->helper;
+  if (h == NULL) return;
+  waithelper(h);
+  h->freeing = h->pending;  /* blocks of an unfinished sweep */
+  h->frealloc = g->frealloc;
+  h->ud = g->ud;
+  freeblocks(h);
+  pthread_mutex_lock(&h->lock);
+  h->state = HQUIT;
+  pthread_cond_broadcast(&h->cond);
+  pthread_mutex_unlock(&h->lock);
+  pthread_join(h->thread, NULL);
+  pthread_cond_destroy(&h->cond);
+  pthread_mutex_destroy(&h->lock);
+  free(h);
+  g->helper = NULL;
+}
+
+
+/* hands the blocks freed by sweep steps to the helper */
+static void flushfrees (global_State *g) {
+  GCHelper *h = g->helper;
+  FreeBatch *b = h->pending;
+  if (b->n == 0) return;
+  waithelper(h);
+  h->pending = h->freeing;
+  h->freeing = b;
+  h->frealloc = g->frealloc;
+  h->ud = g->ud;
+  runhelper(h);
+}
+
+
+/*
+** Called by `luaM_realloc_' instead of `frealloc' for the blocks freed
+** by a sweep step; they are freed later, by the helper.
+*/
+void *luaC_batchfree (inlua_State *L, void *block, size_t size) {
+  global_State *g = G(L);
+  FreeBatch *b = g->helper->pending;
+  if (block == NULL) return NULL;
+  if (b->n == INLUAI_GCFREEBATCH) {
+    flushfrees(g);
+    b = g->helper->pending;
+  }
+  b->b[b->n].block = block;
+  b->b[b->n].size = size;
+  b->n++;
+  return NULL;
+}
+
+
+#define startbatch(g) \
+	((g)->gcbatching = ((g)->gcasyncfree && gethelper(g) != NULL))
+
+#define endbatch(g)	((g)->gcbatching = 0)
+
+#define endsweep(g)	{ if ((g)->helper) flushfrees(g); }
+
+/* runs `s' with batching off; if `s' raises an error, it stays off */
+#define unbatched(g,s) { lu_byte wasbatching = (g)->gcbatching; \
+	(g)->gcbatching = 0; s; (g)->gcbatching = wasbatching; }
+
+/* }====================================================== */
+
+#else
+
+#define startbatch(g)	((void)0)
+#define endbatch(g)	((void)0)
+#define endsweep(g)	((void)0)
+#define unbatched(g,s)	{ s; }
+
+#endif
+
+
+/*
+** Is the key of an ephemeron entry alive? Strings are values, so they
+** always are (and get marked here).
+*/
+static int keyalive (const TValue *k) {
+  if (!iscollectable(k)) return 1;
+  if (ttisstring(k)) {
+    stringmark(rawtsvalue(k));
+    return 1;
+  }
+  return !iswhite(gcvalue(k));
+}
+
+
+/*
+** Marks the values of the entries of a weak-key table whose keys are
+** alive; a value is kept only by its key, so a value that refers to its
+** own key does not keep the entry. Returns whether it marked anything.
+*/
+static int traverseephemeron (global_State *g, Table *h) {
+  int marked = 0;
+  int i = sizenode(h);
+  while (i--) {
+    Node *n = gnode(h, i);
+    if (ttisnil(gval(n)))
+      removeentry(n);  /* remove empty entries */
+    else if (iscollectable(gval(n)) && iswhite(gcvalue(gval(n))) &&
+             keyalive(key2tval(n))) {
+      reallymarkobject(g, gcvalue(gval(n)));
+      marked = 1;
+    }
+  }
+  return marked;
+}
+
+
 static int traversetable (global_State *g, Table *h) {
   int i;
   int weakkey = 0;
@@ -180,6 +417,10 @@ static int traversetable (global_State *g, Table *h) {
     while (i--)
       markvalue(g, &h->array[i]);
   }
+  if (weakkey && !weakvalue) {  /* ephemeron table? */
+    traverseephemeron(g, h);
+    return 1;
+  }
   i = sizenode(h);
   while (i--) {
     Node *n = gnode(h, i);
@@ -217,6 +458,10 @@ static void traverseproto (global_State *g, Proto *f) {
     if (f->locvars[i].varname)
       stringmark(f->locvars[i].varname);
   }
+  for (i=0; i<f->sizeswitches; i++) {  /* mark tables of OP_SWITCH */
+    if (f->switches[i])
+      markobject(g, f->switches[i]);
+  }
 }
 
 
@@ -230,10 +475,13 @@ static void traverseclosure (global_State *g, Closure *cl) {
   }
   else {
     int i;
+    UpVal *copies = getcopies(&cl->l);
     inlua_assert(cl->l.nupvalues == cl->l.p->nups);
     markobject(g, cl->l.p);
-    for (i=0; i<cl->l.nupvalues; i++)  /* mark its upvalues */
+    for (i=0; i<cl->l.nupvalues; i++)  /* mark its upvalues (not copies) */
       markobject(g, cl->l.upvals[i]);
+    for (i=0; i<cl->l.ncopies; i++)  /* mark the values copied in */
+      markvalue(g, copies[i].v);
   }
 }
 
@@ -292,7 +540,7 @@ static l_mem propagatemark (global_State *g) {
       g->gray = cl->c.gclist;
       traverseclosure(g, cl);
       return (cl->c.isC) ? sizeCclosure(cl->c.nupvalues) :
-                           sizeLclosure(cl->l.nupvalues);
+                           sizeLclosure(cl->l.nupvalues, cl->l.ncopies);
     }
     case INLUA_TTHREAD: {
       inlua_State *th = gco2th(o);
@@ -313,7 +561,9 @@ static l_mem propagatemark (global_State *g) {
                              sizeof(TValue) * p->sizek + 
                              sizeof(int) * p->sizelineinfo +
                              sizeof(LocVar) * p->sizelocvars +
-                             sizeof(TString *) * p->sizeupvalues;
+                             sizeof(TString *) * p->sizeupvalues +
+                             sizeof(Table *) * p->sizeswitches +
+                             sizeof(InlineCall) * p->sizeinlined;
     }
     default: inlua_assert(0); return 0;
   }
@@ -387,6 +637,12 @@ static void freeobj (inlua_State *L, GCObject *o) {
       break;
     }
     case INLUA_TSTRING: {
+      TString *ts = rawgco2ts(o);
+      if (ts->tsv.external) {  /* give the bytes back to their owner */
+        const TExtern *e = cast(const TExtern *, ts+1);
+        if (e->release)
+          unbatched(G(L), e->release(e->ud, e->data, ts->tsv.len));
+      }
       G(L)->strt.nuse--;
       luaM_freemem(L, o, sizestring(gco2ts(o)));
       break;
@@ -483,6 +739,9 @@ void luaC_callGCTM (inlua_State *L) {
 void luaC_freeall (inlua_State *L) {
   global_State *g = G(L);
   int i;
+#if defined(INLUA_USE_PARALLELGC)
+  luaC_stophelper(L);
+#endif
   g->currentwhite = WHITEBITS | bitmask(SFIXEDBIT);  /* mask to collect all elements */
   sweepwholelist(L, &g->rootgc);
   for (i = 0; i < g->strt.size; i++)  /* free all string lists */
@@ -522,6 +781,29 @@ static void remarkupvals (global_State *g) {
 }
 
 
+/*
+** Marking a value of an ephemeron table can make keys of other entries
+** (or tables) alive, so they are traversed again until nothing changes.
+*/
+static size_t convergeephemerons (global_State *g) {
+  size_t m = 0;
+  int changed;
+  do {
+    GCObject *w;
+    changed = 0;
+    for (w = g->weak; w != NULL; w = gco2h(w)->gclist) {
+      Table *h = gco2h(w);
+      if (testbit(h->marked, KEYWEAKBIT) &&
+          !testbit(h->marked, VALUEWEAKBIT) && traverseephemeron(g, h)) {
+        m += propagateall(g);
+        changed = 1;
+      }
+    }
+  } while (changed);
+  return m;
+}
+
+
 static void atomic (inlua_State *L) {
   global_State *g = G(L);
   size_t udsize;  /* total size of userdata to be finalized */
@@ -540,9 +822,11 @@ static void atomic (inlua_State *L) {
   g->gray = g->grayagain;
   g->grayagain = NULL;
   propagateall(g);
+  convergeephemerons(g);
   udsize = luaC_separateudata(L, 0);  /* separate userdata to be finalized */
   marktmu(g);  /* mark `preserved' userdata */
   udsize += propagateall(g);  /* remark, to propagate `preserveness' */
+  udsize += convergeephemerons(g);
   cleartable(g->weak);  /* remove collected objects from weak tables */
   /* flip current white */
   g->currentwhite = cast_byte(otherwhite(g));
@@ -571,7 +855,9 @@ static l_mem singlestep (inlua_State *L) {
     }
     case GCSsweepstring: {
       lu_mem old = g->totalbytes;
+      startbatch(g);
       sweepwholelist(L, &g->strt.hash[g->sweepstrgc++]);
+      endbatch(g);
       if (g->sweepstrgc >= g->strt.size)  /* nothing more to sweep? */
         g->gcstate = GCSsweep;  /* end sweep-string phase */
       inlua_assert(old >= g->totalbytes);
@@ -580,9 +866,12 @@ static l_mem singlestep (inlua_State *L) {
     }
     case GCSsweep: {
       lu_mem old = g->totalbytes;
+      startbatch(g);
       g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
+      endbatch(g);
       if (*g->sweepgc == NULL) {  /* nothing more to sweep? */
         checkSizes(L);
+        endsweep(g);
         g->gcstate = GCSfinalize;  /* end sweep phase */
       }
       inlua_assert(old >= g->totalbytes);
@@ -607,14 +896,191 @@ static l_mem singlestep (inlua_State *L) {
 }
 
 
+/*
+** {======================================================
+** Telemetry: with `gctelemetry' on, each step is timed and its time is
+** added to the phase it ran in, and each call of `luaC_step' or
+** `luaC_fullgc' is recorded as a pause. Objects are counted on demand.
+** =======================================================
+*/
+
+static double gcclock (void) {
+#if defined(INLUA_USE_POSIX)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+
+/* phase of the next step (ORDER INLUA_GCP) */
+static int gcphase (global_State *g) {
+  switch (g->gcstate) {
+    case GCSpause: return 0;  /* markroot: counted with propagate */
+    case GCSpropagate: return (g->gray == NULL) ? 1 : 0;
+    default: return g->gcstate;  /* GCSsweepstring..GCSfinalize */
+  }
+}
+
+
+static l_mem timedstep (inlua_State *L) {
+  global_State *g = G(L);
+  int phase = gcphase(g);
+  double t = gcclock();
+  l_mem work = singlestep(L);
+  g->gcstats.phasetime[phase] += gcclock() - t;
+  if (phase == GCSfinalize && g->gcstate == GCSpause)
+    g->gcstats.cycles++;
+  return work;
+}
+
+
+static void recordpause (global_State *g, double t) {
+  inlua_GCStats *s = &g->gcstats;
+  double us = t * 1e6;
+  int i = 0;
+  while (i < INLUA_GCHISTSIZE - 1 && us >= (1 << i))
+    i++;
+  s->histogram[i]++;
+  s->pauses++;
+  s->pausetotal += t;
+  if (t > s->pausemax) s->pausemax = t;
+}
+
+
+#define runstep(L)	(G(L)->gctelemetry ? timedstep(L) : singlestep(L))
+
+
+size_t luaC_objsize (GCObject *o) {
+  switch (o->gch.tt) {
+    case INLUA_TSTRING: return sizestring(gco2ts(o));
+    case INLUA_TUSERDATA: return sizeudata(gco2u(o));
+    case INLUA_TTABLE: {
+      Table *h = gco2h(o);
+      return sizeof(Table) + sizeof(TValue) * h->sizearray +
+             (luaH_isdummy(h->node) ? 0 : sizeof(Node) * sizenode(h));
+    }
+    case INLUA_TFUNCTION: {
+      Closure *cl = gco2cl(o);
+      return cl->c.isC ? sizeCclosure(cl->c.nupvalues) :
+                         sizeLclosure(cl->l.nupvalues, cl->l.ncopies);
+    }
+    case INLUA_TTHREAD: {
+      inlua_State *th = gco2th(o);
+      return sizeof(inlua_State) + sizeof(TValue) * th->stacksize +
+             sizeof(CallInfo) * th->size_ci;
+    }
+    case LUA_TPROTO: {
+      Proto *p = gco2p(o);
+      return sizeof(Proto) + sizeof(Instruction) * p->sizecode +
+             sizeof(Proto *) * p->sizep + sizeof(TValue) * p->sizek +
+             sizeof(int) * p->sizelineinfo +
+             sizeof(struct LocVar) * p->sizelocvars +
+             sizeof(TString *) * p->sizeupvalues +
+             sizeof(lu_int32) * p->sizeloopcount +
+             sizeof(Table *) * p->sizeswitches +
+             sizeof(InlineCall) * p->sizeinlined;
+    }
+    default: inlua_assert(o->gch.tt == LUA_TUPVAL); return sizeof(UpVal);
+  }
+}
+
+
+static void countobject (inlua_GCStats *s, GCObject *o) {
+  static const int kind[] = {0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6};
+  int k = kind[o->gch.tt];  /* ORDER INLUA_T */
+  s->objects[k]++;
+  s->bytes[k] += luaC_objsize(o);
+}
+
+
+static void countlist (inlua_GCStats *s, GCObject *o) {
+  for (; o != NULL; o = o->gch.next)
+    countobject(s, o);
+}
+
+
+void luaC_countobjects (inlua_State *L, inlua_GCStats *s) {
+  global_State *g = G(L);
+  UpVal *uv;
+  int i;
+  for (i = 0; i < INLUA_GCKINDS; i++) {
+    s->objects[i] = 0;
+    s->bytes[i] = 0;
+  }
+  countlist(s, g->rootgc);  /* starts with the main thread */
+  for (i = 0; i < g->strt.size; i++)
+    countlist(s, g->strt.hash[i]);
+  if (g->tmudata) {  /* userdata waiting for their finalizers */
+    GCObject *u = g->tmudata;
+    do {
+      u = u->gch.next;
+      countobject(s, u);
+    } while (u != g->tmudata);
+  }
+  for (uv = g->uvhead.u.l.next; uv != &g->uvhead; uv = uv->u.l.next) {
+    s->objects[INLUA_GCKINDS - 1]++;  /* open upvalues */
+    s->bytes[INLUA_GCKINDS - 1] += sizeof(UpVal);
+  }
+}
+
+/* }====================================================== */
+
+
+/*
+** A step of pause-target mode: as much work as the measured cost per
+** unit allows in `gctarget' microseconds. The next step comes after the
+** program allocates this step's share of what is left of the budget.
+*/
+static void targetstep (inlua_State *L, double start) {
+  global_State *g = G(L);
+  double units = g->gctarget * 1e-6 / g->gcunitcost;
+  l_mem lim = (units < cast(double, MAX_LMEM)) ? cast(l_mem, units) : MAX_LMEM;
+  l_mem work = 0;
+  double t;
+  if (lim < 1) lim = 1;
+  do {
+    work += runstep(L);
+    if (g->gcstate == GCSpause)
+      break;
+  } while (work < lim);
+  t = gcclock() - start;
+  if (work > 0) {
+    g->gcunitcost = (3 * g->gcunitcost + t / work) / 4;
+    if (g->gcunitcost < GCMINUNITCOST)  /* clock too coarse? */
+      g->gcunitcost = GCMINUNITCOST;
+  }
+  if (g->gcstate == GCSpause)
+    setthreshold(g);
+  else {
+    lu_mem budget = (g->estimate/100) * g->gcgrowth;
+    lu_mem room = (budget > g->totalbytes) ? budget - g->totalbytes : 0;
+    lu_mem live = (g->estimate > GCSTEPSIZE) ? g->estimate : GCSTEPSIZE;
+    if (cast(lu_mem, work) < live)  /* else the whole room */
+      room = cast(lu_mem, cast_num(room) * cast_num(work) / live);
+    g->GCthreshold = g->totalbytes + room;
+  }
+  if (g->gctelemetry)
+    recordpause(g, t);
+}
+
+
 void luaC_step (inlua_State *L) {
   global_State *g = G(L);
   l_mem lim = (GCSTEPSIZE/100) * g->gcstepmul;
+  double t;
+  if (g->gctarget) {
+    targetstep(L, gcclock());
+    return;
+  }
+  t = g->gctelemetry ? gcclock() : 0;
   if (lim == 0)
     lim = (MAX_LUMEM-1)/2;  /* no limit */
   g->gcdept += g->totalbytes - g->GCthreshold;
   do {
-    lim -= singlestep(L);
+    lim -= runstep(L);
     if (g->gcstate == GCSpause)
       break;
   } while (lim > 0);
@@ -629,11 +1095,33 @@ void luaC_step (inlua_State *L) {
   else {
     setthreshold(g);
   }
+  if (g->gctelemetry)
+    recordpause(g, gcclock() - t);
+}
+
+
+/*
+** Switches between pause-target mode (`target' microseconds) and the
+** default mode (0). The debt of one mode means nothing to the other, so
+** it is dropped and the next step is scheduled by the new mode.
+*/
+void luaC_settarget (inlua_State *L, int target) {
+  global_State *g = G(L);
+  int switching = ((g->gctarget == 0) != (target == 0));
+  g->gctarget = target;
+  if (switching) {
+    g->gcdept = 0;
+    if (g->gcstate == GCSpause)
+      setthreshold(g);
+    else
+      g->GCthreshold = g->totalbytes;  /* step at the next allocation */
+  }
 }
 
 
 void luaC_fullgc (inlua_State *L) {
   global_State *g = G(L);
+  double t = g->gctelemetry ? gcclock() : 0;
   if (g->gcstate <= GCSpropagate) {
     /* reset sweep marks to sweep all elements (returning them to white) */
     g->sweepstrgc = 0;
@@ -648,13 +1136,15 @@ void luaC_fullgc (inlua_State *L) {
   /* finish any pending sweep phase */
   while (g->gcstate != GCSfinalize) {
     inlua_assert(g->gcstate == GCSsweepstring || g->gcstate == GCSsweep);
-    singlestep(L);
+    runstep(L);
   }
   markroot(L);
   while (g->gcstate != GCSpause) {
-    singlestep(L);
+    runstep(L);
   }
   setthreshold(g);
+  if (g->gctelemetry)
+    recordpause(g, gcclock() - t);
 }
 
 
@@ -101,10 +101,17 @@ INLUAI_FUNC void luaC_callGCTM (inlua_State *L);
 INLUAI_FUNC void luaC_freeall (inlua_State *L);
 INLUAI_FUNC void luaC_step (inlua_State *L);
 INLUAI_FUNC void luaC_fullgc (inlua_State *L);
+INLUAI_FUNC void luaC_settarget (inlua_State *L, int target);
 INLUAI_FUNC void luaC_link (inlua_State *L, GCObject *o, lu_byte tt);
 INLUAI_FUNC void luaC_linkupval (inlua_State *L, UpVal *uv);
 INLUAI_FUNC void luaC_barrierf (inlua_State *L, GCObject *o, GCObject *v);
 INLUAI_FUNC void luaC_barrierback (inlua_State *L, Table *t);
+INLUAI_FUNC void luaC_countobjects (inlua_State *L, inlua_GCStats *s);
+INLUAI_FUNC size_t luaC_objsize (GCObject *o);
+#if defined(INLUA_USE_PARALLELGC)
+INLUAI_FUNC void *luaC_batchfree (inlua_State *L, void *block, size_t size);
+INLUAI_FUNC void luaC_stophelper (inlua_State *L);
+#endif
 
 
 #endif
@@ -22,6 +22,7 @@ static const inluaL_Reg lualibs[] = {
   {INLUA_OSLIBNAME, inluaopen_os},
   {INLUA_STRLIBNAME, inluaopen_string},
   {INLUA_MATHLIBNAME, inluaopen_math},
+  {INLUA_ARRAYLIBNAME, inluaopen_array},
   {INLUA_DBLIBNAME, inluaopen_debug},
   {NULL, NULL}
 };
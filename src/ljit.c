@@ -0,0 +1,992 @@
+/*
+** $Id: ljit.c $
+** Baseline JIT compiler for x86-64
+** See Copyright Notice in inlua.h
+*/
+
+
+#include <stddef.h>
+#include <string.h>
+
+#define ljit_c
+#define INLUA_CORE
+
+#include "inlua.h"
+
+#if defined(INLUA_USE_JIT)
+
+#include <sys/mman.h>
+
+#include "ldebug.h"
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "ljit.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lopcodes.h"
+#include "lstate.h"
+#include "ltable.h"
+#include "ltm.h"
+#include "lvm.h"
+
+
+/*
+** The JIT translates a whole Proto, one template per instruction, into
+** a function with the System V signature
+**   int f (inlua_State *L, StkId base, TValue *k, LClosure *cl, void *entry)
+** that jumps to `entry' (the code of any instruction) and runs until it
+** meets an instruction it does not translate (calls, returns, closures,
+** etc.). It then returns the index of that instruction, and luaV_execute
+** interprets it and comes back. Slow paths call the same functions the
+** interpreter uses (luaV_gettable, luaV_arith, ...) through small helpers.
+*/
+
+
+/* x86-64 registers */
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+       R8, R9, R10, R11, R12, R13, R14, R15 };
+
+#define RL	RBX	/* inlua_State *L */
+#define RBASE	R12	/* L->base; reloaded after each helper */
+#define RKST	R13	/* constants of the function */
+#define RCL	R14	/* the running closure */
+
+/* condition codes */
+#define CC_B	0x2
+#define CC_AE	0x3
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_BE	0x6
+#define CC_A	0x7
+#define CC_P	0xA
+#define CC_JMP	(-1)
+
+/* SSE2 scalar double opcodes (prefix F2) */
+#define SD_LOAD	0x10
+#define SD_STORE	0x11
+#define SD_ADD	0x58
+#define SD_MUL	0x59
+#define SD_SUB	0x5C
+#define SD_DIV	0x5E
+
+#define TT		cast_int(offsetof(TValue, tt))
+#define slot(r)		(cast_int(sizeof(TValue)) * (r))
+
+/* helper results */
+#define JIT_JUMP	1  /* test succeeded: take the jump */
+#define JIT_EXIT	2  /* a hook was set: go back to the interpreter */
+
+/* upper bound for the code of one instruction */
+#define MAXINSTRSIZE	256
+
+
+typedef int (*JitFunction) (inlua_State *L, StkId base, const TValue *k,
+                            LClosure *cl, const unsigned char *entry);
+
+typedef int (*Helper) (inlua_State *L, const Instruction *pc);
+
+
+typedef struct JitState {
+  unsigned char *code;
+  size_t n;  /* number of bytes emitted */
+  Proto *p;
+  unsigned int *entry;
+  int *fixup;  /* pairs (position of a rel32, target instruction) */
+  int nfixup;
+  size_t epilogue;
+} JitState;
+
+
+
+/*
+** {======================================================
+** Helpers (called from machine code; `pc' points to the next instruction)
+** =======================================================
+*/
+
+#define hookexit(L)	(((L)->hookmask & tracedhooks(curr_cl(L)->p)) \
+				? JIT_EXIT : 0)
+
+#undef RA
+#undef RB
+#undef RKB
+#undef RKC
+#undef KBx
+
+#define curr_cl(L)	(&clvalue((L)->ci->func)->l)
+
+#define RA(i)	(base+GETARG_A(i))
+#define RB(i)	(base+GETARG_B(i))
+#define RKB(i)	(ISK(GETARG_B(i)) ? k+INDEXK(GETARG_B(i)) : base+GETARG_B(i))
+#define RKC(i)	(ISK(GETARG_C(i)) ? k+INDEXK(GETARG_C(i)) : base+GETARG_C(i))
+#define KBx(i)	(k+GETARG_Bx(i))
+
+
+static int h_getglobal (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  LClosure *cl = curr_cl(L);
+  StkId base = L->base;
+  TValue *k = cl->p->k;
+  TValue g;
+  sethvalue(L, &g, cl->env);
+  L->savedpc = pc;
+  luaV_gettable(L, &g, KBx(i), RA(i));
+  return hookexit(L);
+}
+
+
+static int h_setglobal (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  LClosure *cl = curr_cl(L);
+  StkId base = L->base;
+  TValue *k = cl->p->k;
+  TValue g;
+  sethvalue(L, &g, cl->env);
+  L->savedpc = pc;
+  luaV_settable(L, &g, KBx(i), RA(i));
+  return hookexit(L);
+}
+
+
+static int h_gettable (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  TValue *k = curr_cl(L)->p->k;
+  L->savedpc = pc;
+  luaV_gettable(L, RB(i), RKC(i), RA(i));
+  return hookexit(L);
+}
+
+
+static int h_settable (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  TValue *k = curr_cl(L)->p->k;
+  L->savedpc = pc;
+  luaV_settable(L, RA(i), RKB(i), RKC(i));
+  return hookexit(L);
+}
+
+
+static int h_self (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  TValue *k = curr_cl(L)->p->k;
+  StkId rb = RB(i);
+  setobjs2s(L, RA(i) + 1, rb);
+  L->savedpc = pc;
+  luaV_gettable(L, rb, RKC(i), RA(i));
+  return hookexit(L);
+}
+
+
+static int h_setupval (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  UpVal *uv = curr_cl(L)->upvals[GETARG_B(i)];
+  setobj(L, uv->v, RA(i));
+  luaC_barrier(L, uv, RA(i));
+  return 0;
+}
+
+
+static int h_newtable (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  sethvalue(L, RA(i), luaH_new(L, luaO_fb2int(b), luaO_fb2int(c)));
+  L->savedpc = pc;
+  luaC_checkGC(L);
+  return hookexit(L);
+}
+
+
+static int h_arith (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  TValue *k = curr_cl(L)->p->k;
+  L->savedpc = pc;
+  switch (GET_OPCODE(i)) {
+    case OP_ADD: case OP_ADDLOOP:
+      luaV_arith(L, RA(i), RKB(i), RKC(i), TM_ADD); break;
+    case OP_SUB: luaV_arith(L, RA(i), RKB(i), RKC(i), TM_SUB); break;
+    case OP_MUL: luaV_arith(L, RA(i), RKB(i), RKC(i), TM_MUL); break;
+    case OP_DIV: luaV_arith(L, RA(i), RKB(i), RKC(i), TM_DIV); break;
+    case OP_MOD: luaV_arith(L, RA(i), RKB(i), RKC(i), TM_MOD); break;
+    case OP_POW: luaV_arith(L, RA(i), RKB(i), RKC(i), TM_POW); break;
+    case OP_UNM: luaV_arith(L, RA(i), RB(i), RB(i), TM_UNM); break;
+    default: inlua_assert(0); break;
+  }
+  return hookexit(L);
+}
+
+
+/* only for tables and strings; metamethods are left to the interpreter */
+static int h_len (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  const TValue *rb = RB(i);
+  if (ttistable(rb)) {
+    setnvalue(RA(i), cast_num(luaH_getn(hvalue(rb))));
+  }
+  else {
+    setnvalue(RA(i), cast_num(tsvalue(rb)->len));
+  }
+  return 0;
+}
+
+
+static int h_close (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  luaF_close(L, RA(i));
+  return 0;
+}
+
+
+static int h_eq (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  TValue *k = curr_cl(L)->p->k;
+  int res;
+  L->savedpc = pc;
+  res = (equalobj(L, RKB(i), RKC(i)) == GETARG_A(i));
+  return (res ? JIT_JUMP : 0) | hookexit(L);
+}
+
+
+static int h_lt (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  TValue *k = curr_cl(L)->p->k;
+  int res;
+  L->savedpc = pc;
+  res = (luaV_lessthan(L, RKB(i), RKC(i)) == GETARG_A(i));
+  return (res ? JIT_JUMP : 0) | hookexit(L);
+}
+
+
+static int h_le (inlua_State *L, const Instruction *pc) {
+  Instruction i = pc[-1];
+  StkId base = L->base;
+  TValue *k = curr_cl(L)->p->k;
+  int res;
+  L->savedpc = pc;
+  res = (luaV_lessequal(L, RKB(i), RKC(i)) == GETARG_A(i));
+  return (res ? JIT_JUMP : 0) | hookexit(L);
+}
+
+#undef RA
+#undef RB
+#undef RKB
+#undef RKC
+#undef KBx
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Machine code emission
+** =======================================================
+*/
+
+static void emit (JitState *J, int b) {
+  J->code[J->n++] = cast(unsigned char, b);
+}
+
+
+static void emit32 (JitState *J, int v) {
+  memcpy(J->code + J->n, &v, 4);
+  J->n += 4;
+}
+
+
+static void rex (JitState *J, int w, int reg, int rm) {
+  int r = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+  if (r != 0x40) emit(J, r);
+}
+
+
+/* ModRM for [base+disp32] */
+static void modrm_mem (JitState *J, int reg, int base, int disp) {
+  emit(J, 0x80 | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == RSP) emit(J, 0x24);  /* SIB: no index */
+  emit32(J, disp);
+}
+
+
+static void modrm_reg (JitState *J, int reg, int rm) {
+  emit(J, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+
+/* mov r64, [base+disp] */
+static void load64 (JitState *J, int r, int base, int disp) {
+  rex(J, 1, r, base); emit(J, 0x8B); modrm_mem(J, r, base, disp);
+}
+
+
+/* mov [base+disp], r64 */
+static void store64 (JitState *J, int base, int disp, int r) {
+  rex(J, 1, r, base); emit(J, 0x89); modrm_mem(J, r, base, disp);
+}
+
+
+/* mov dword [base+disp], imm32 */
+static void store32i (JitState *J, int base, int disp, int imm) {
+  rex(J, 0, 0, base); emit(J, 0xC7); modrm_mem(J, 0, base, disp);
+  emit32(J, imm);
+}
+
+
+/* cmp dword [base+disp], imm8 */
+static void cmp32i (JitState *J, int base, int disp, int imm) {
+  rex(J, 0, 0, base); emit(J, 0x83); modrm_mem(J, 7, base, disp);
+  emit(J, imm);
+}
+
+
+/* cmp r32, [base+disp] */
+static void cmp32 (JitState *J, int r, int base, int disp) {
+  rex(J, 0, r, base); emit(J, 0x3B); modrm_mem(J, r, base, disp);
+}
+
+
+/* mov r64, imm64 */
+static void movimm (JitState *J, int r, size_t v) {
+  rex(J, 1, 0, r); emit(J, 0xB8 + (r & 7));
+  memcpy(J->code + J->n, &v, 8);
+  J->n += 8;
+}
+
+
+/* mov dst, src (64 bits) */
+static void movreg (JitState *J, int dst, int src) {
+  rex(J, 1, src, dst); emit(J, 0x89); modrm_reg(J, src, dst);
+}
+
+
+/* movups xmm, [base+disp] (copies a whole TValue) */
+static void loadtv (JitState *J, int x, int base, int disp) {
+  rex(J, 0, x, base); emit(J, 0x0F); emit(J, 0x10); modrm_mem(J, x, base, disp);
+}
+
+
+/* movups [base+disp], xmm */
+static void storetv (JitState *J, int base, int disp, int x) {
+  rex(J, 0, x, base); emit(J, 0x0F); emit(J, 0x11); modrm_mem(J, x, base, disp);
+}
+
+
+/* scalar double operation with a memory operand */
+static void sdmem (JitState *J, int op, int x, int base, int disp) {
+  emit(J, 0xF2); rex(J, 0, x, base); emit(J, 0x0F); emit(J, op);
+  modrm_mem(J, x, base, disp);
+}
+
+
+/* ucomisd x1, x2 */
+static void ucomisd (JitState *J, int x1, int x2) {
+  emit(J, 0x66); emit(J, 0x0F); emit(J, 0x2E); modrm_reg(J, x1, x2);
+}
+
+
+/* jump (or conditional jump) with a rel32 to be patched; returns its position */
+static size_t jumpfwd (JitState *J, int cc) {
+  if (cc == CC_JMP) emit(J, 0xE9);
+  else { emit(J, 0x0F); emit(J, 0x80 + cc); }
+  emit32(J, 0);
+  return J->n - 4;
+}
+
+
+static void patchto (JitState *J, size_t pos, size_t target) {
+  int rel = cast_int(target) - cast_int(pos + 4);
+  memcpy(J->code + pos, &rel, 4);
+}
+
+
+#define here(J,pos)	patchto(J, pos, (J)->n)
+
+
+/* jump to the code of instruction `pc' */
+static void jumppc (JitState *J, int cc, int pc) {
+  size_t pos = jumpfwd(J, cc);
+  J->fixup[2*J->nfixup] = cast_int(pos);
+  J->fixup[2*J->nfixup + 1] = pc;
+  J->nfixup++;
+}
+
+
+/* leave the machine code; the interpreter goes on from instruction `pc' */
+static void exitto (JitState *J, int pc) {
+  emit(J, 0xB8); emit32(J, pc);  /* mov eax, pc */
+  patchto(J, jumpfwd(J, CC_JMP), J->epilogue);
+}
+
+
+/* go back to the interpreter at back edges if a hook was set meanwhile */
+static void checkhook (JitState *J, int pc) {
+  size_t skip;
+  rex(J, 0, 0, RL); emit(J, 0xF6);  /* test byte [L->hookmask], mask */
+  modrm_mem(J, 0, RL, cast_int(offsetof(inlua_State, hookmask)));
+  emit(J, tracedhooks(J->p));
+  skip = jumpfwd(J, CC_E);
+  exitto(J, pc);
+  here(J, skip);
+}
+
+
+/* count a taken back edge, as luaV_execute does */
+static void countloop (JitState *J, int pc) {
+  if (pc >= J->p->sizeloopcount) return;
+  movimm(J, RAX, cast(size_t, J->p->loopcount + pc));
+  emit(J, 0x83); modrm_mem(J, 0, RAX, 0); emit(J, 1);  /* add dword [rax], 1 */
+}
+
+
+/* call helper `f' for instruction `pc'; leaves its result in eax */
+static void callhelper (JitState *J, int pc, Helper f) {
+  movreg(J, RDI, RL);
+  movimm(J, RSI, cast(size_t, J->p->code + pc + 1));
+  movimm(J, RAX, cast(size_t, f));
+  emit(J, 0xFF); emit(J, 0xD0);  /* call rax */
+  load64(J, RBASE, RL, cast_int(offsetof(inlua_State, base)));
+}
+
+
+/* call a helper for a plain instruction, leaving if it asks to */
+static void helper (JitState *J, int pc, Helper f) {
+  size_t skip;
+  callhelper(J, pc, f);
+  emit(J, 0xA9); emit32(J, JIT_EXIT);  /* test eax, JIT_EXIT */
+  skip = jumpfwd(J, CC_E);
+  exitto(J, pc + 1);
+  here(J, skip);
+}
+
+
+/* call a helper for a test: jump to `dest' or skip to `pc+2' */
+static void testhelper (JitState *J, int pc, int dest, Helper f) {
+  size_t stay, nojump;
+  callhelper(J, pc, f);
+  emit(J, 0xA9); emit32(J, JIT_EXIT);  /* test eax, JIT_EXIT */
+  stay = jumpfwd(J, CC_E);
+  emit(J, 0xA9); emit32(J, JIT_JUMP);
+  nojump = jumpfwd(J, CC_E);
+  exitto(J, dest);
+  here(J, nojump);
+  exitto(J, pc + 2);
+  here(J, stay);
+  emit(J, 0xA9); emit32(J, JIT_JUMP);
+  jumppc(J, CC_NE, dest);
+  jumppc(J, CC_JMP, pc + 2);
+}
+
+
+/* base register and displacement of an RK operand */
+static int rkbase (int x) { return ISK(x) ? RKST : RBASE; }
+static int rkdisp (int x) { return ISK(x) ? slot(INDEXK(x)) : slot(x); }
+
+
+/*
+** check that RK operand `x' is a number, jumping to `slow' otherwise;
+** returns 0 if it is a constant that is not a number
+*/
+static int checknum (JitState *J, Proto *p, int x, size_t *slow, int *nslow) {
+  if (ISK(x))
+    return ttisnumber(&p->k[INDEXK(x)]);
+  cmp32i(J, RBASE, slot(x) + TT, INLUA_TNUMBER);
+  slow[(*nslow)++] = jumpfwd(J, CC_NE);
+  return 1;
+}
+
+
+static void arith (JitState *J, int pc, Instruction i, int op) {
+  Proto *p = J->p;
+  size_t slow[2], done;
+  int nslow = 0, k;
+  int b = GETARG_B(i), c = GETARG_C(i);
+  if (!checknum(J, p, b, slow, &nslow) || !checknum(J, p, c, slow, &nslow)) {
+    for (k = 0; k < nslow; k++) here(J, slow[k]);
+    helper(J, pc, h_arith);
+    return;
+  }
+  sdmem(J, SD_LOAD, 0, rkbase(b), rkdisp(b));
+  sdmem(J, op, 0, rkbase(c), rkdisp(c));
+  sdmem(J, SD_STORE, 0, RBASE, slot(GETARG_A(i)));
+  store32i(J, RBASE, slot(GETARG_A(i)) + TT, INLUA_TNUMBER);
+  done = jumpfwd(J, CC_JMP);
+  for (k = 0; k < nslow; k++) here(J, slow[k]);
+  helper(J, pc, h_arith);
+  here(J, done);
+}
+
+
+/* OP_LT and OP_LE: numbers inline, anything else through the helper */
+static void compare (JitState *J, int pc, Instruction i, Helper f) {
+  Proto *p = J->p;
+  size_t slow[2];
+  int nslow = 0, k;
+  int b = GETARG_B(i), c = GETARG_C(i);
+  int dest = pc + 2 + GETARG_sBx(p->code[pc + 1]);
+  int cond = GETARG_A(i);
+  if (checknum(J, p, b, slow, &nslow) && checknum(J, p, c, slow, &nslow)) {
+    /* compute `c > b' (OP_LT) or `c >= b' (OP_LE); NaN gives false */
+    sdmem(J, SD_LOAD, 0, rkbase(c), rkdisp(c));
+    emit(J, 0x66); rex(J, 0, 0, rkbase(b)); emit(J, 0x0F); emit(J, 0x2E);
+    modrm_mem(J, 0, rkbase(b), rkdisp(b));  /* ucomisd xmm0, RK(B) */
+    if (f == h_lt)
+      jumppc(J, cond ? CC_A : CC_BE, dest);
+    else
+      jumppc(J, cond ? CC_AE : CC_B, dest);
+    jumppc(J, CC_JMP, pc + 2);
+  }
+  for (k = 0; k < nslow; k++) here(J, slow[k]);
+  testhelper(J, pc, dest, f);
+}
+
+
+/* OP_EQ: inline against constants and between numbers */
+static void equal (JitState *J, int pc, Instruction i) {
+  Proto *p = J->p;
+  int b = GETARG_B(i), c = GETARG_C(i);
+  int dest = pc + 2 + GETARG_sBx(p->code[pc + 1]);
+  int cond = GETARG_A(i);
+  int yes = cond ? dest : pc + 2;  /* where to go when equal */
+  int no = cond ? pc + 2 : dest;
+  if (ISK(b) && !ISK(c)) { int t = b; b = c; c = t; }
+  if (!ISK(b) && ISK(c)) {
+    /* against a constant: different types are never equal */
+    const TValue *kv = &p->k[INDEXK(c)];
+    cmp32i(J, RBASE, slot(b) + TT, ttype(kv));
+    jumppc(J, CC_NE, no);
+    switch (ttype(kv)) {
+      case INLUA_TNIL: break;
+      case INLUA_TBOOLEAN: {
+        cmp32i(J, RBASE, slot(b), bvalue(kv));
+        jumppc(J, CC_NE, no);
+        break;
+      }
+      case INLUA_TNUMBER: {
+        sdmem(J, SD_LOAD, 0, RBASE, slot(b));
+        emit(J, 0x66); rex(J, 0, 0, RKST); emit(J, 0x0F); emit(J, 0x2E);
+        modrm_mem(J, 0, RKST, slot(INDEXK(c)));  /* ucomisd xmm0, K(C) */
+        jumppc(J, CC_P, no);
+        jumppc(J, CC_NE, no);
+        break;
+      }
+      default: {  /* strings are interned: compare pointers */
+        load64(J, RAX, RBASE, slot(b));
+        rex(J, 1, RAX, RKST); emit(J, 0x3B);  /* cmp rax, K(C) */
+        modrm_mem(J, RAX, RKST, slot(INDEXK(c)));
+        jumppc(J, CC_NE, no);
+        break;
+      }
+    }
+    jumppc(J, CC_JMP, yes);
+  }
+  else if (!ISK(b) && !ISK(c)) {
+    size_t slow[2];
+    cmp32i(J, RBASE, slot(b) + TT, INLUA_TNUMBER);
+    slow[0] = jumpfwd(J, CC_NE);
+    cmp32i(J, RBASE, slot(c) + TT, INLUA_TNUMBER);
+    slow[1] = jumpfwd(J, CC_NE);
+    sdmem(J, SD_LOAD, 0, RBASE, slot(b));
+    emit(J, 0x66); rex(J, 0, 0, RBASE); emit(J, 0x0F); emit(J, 0x2E);
+    modrm_mem(J, 0, RBASE, slot(c));  /* ucomisd xmm0, R(C) */
+    jumppc(J, CC_P, no);
+    jumppc(J, CC_NE, no);
+    jumppc(J, CC_JMP, yes);
+    here(J, slow[0]);
+    here(J, slow[1]);
+    testhelper(J, pc, dest, h_eq);
+  }
+  else  /* two constants */
+    testhelper(J, pc, dest, h_eq);
+}
+
+
+/*
+** jumps to `isfalse' when R(r) is false or nil; falls through when true
+*/
+static void testfalse (JitState *J, int r, size_t *isfalse) {
+  size_t istrue;
+  cmp32i(J, RBASE, slot(r) + TT, INLUA_TNIL);
+  isfalse[0] = jumpfwd(J, CC_E);
+  cmp32i(J, RBASE, slot(r) + TT, INLUA_TBOOLEAN);
+  istrue = jumpfwd(J, CC_NE);
+  cmp32i(J, RBASE, slot(r), 0);
+  isfalse[1] = jumpfwd(J, CC_E);
+  here(J, istrue);
+}
+
+
+/* R(A) := R(B)[RK(C)], with arrays and integer keys inline */
+static void gettable (JitState *J, int pc, Instruction i) {
+  Proto *p = J->p;
+  int a = GETARG_A(i), b = GETARG_B(i), c = GETARG_C(i);
+  size_t slow[6], done;
+  int nslow = 0, k;
+  if (ISK(c) && !ttisnumber(&p->k[INDEXK(c)])) {
+    helper(J, pc, h_gettable);
+    return;
+  }
+  cmp32i(J, RBASE, slot(b) + TT, INLUA_TTABLE);
+  slow[nslow++] = jumpfwd(J, CC_NE);
+  checknum(J, p, c, slow, &nslow);
+  load64(J, RAX, RBASE, slot(b));  /* rax = Table * */
+  sdmem(J, SD_LOAD, 0, rkbase(c), rkdisp(c));
+  emit(J, 0xF2); emit(J, 0x0F); emit(J, 0x2C); modrm_reg(J, RCX, 0);
+  /* cvttsd2si ecx, xmm0; the key must be an integer */
+  emit(J, 0xF2); emit(J, 0x0F); emit(J, 0x2A); modrm_reg(J, 1, RCX);
+  /* cvtsi2sd xmm1, ecx */
+  ucomisd(J, 0, 1);
+  slow[nslow++] = jumpfwd(J, CC_P);
+  slow[nslow++] = jumpfwd(J, CC_NE);
+  emit(J, 0x83); modrm_reg(J, 5, RCX); emit(J, 1);  /* sub ecx, 1 */
+  cmp32(J, RCX, RAX, cast_int(offsetof(Table, sizearray)));
+  slow[nslow++] = jumpfwd(J, CC_AE);  /* unsigned: also catches key < 1 */
+  load64(J, RDX, RAX, cast_int(offsetof(Table, array)));
+  rex(J, 1, 0, RCX); emit(J, 0xC1); modrm_reg(J, 4, RCX); emit(J, 4);
+  /* shl rcx, 4 */
+  rex(J, 1, RDX, RCX); emit(J, 0x01); modrm_reg(J, RCX, RDX);
+  /* add rdx, rcx */
+  cmp32i(J, RDX, TT, INLUA_TNIL);  /* nil may need __index */
+  slow[nslow++] = jumpfwd(J, CC_E);
+  loadtv(J, 0, RDX, 0);
+  storetv(J, RBASE, slot(a), 0);
+  done = jumpfwd(J, CC_JMP);
+  for (k = 0; k < nslow; k++) here(J, slow[k]);
+  helper(J, pc, h_gettable);
+  here(J, done);
+}
+
+
+/*
+** R(A)[RK(B)] := RK(C), inline when the array slot exists, is not nil
+** and the value needs no barrier
+*/
+static void settable (JitState *J, int pc, Instruction i) {
+  Proto *p = J->p;
+  int a = GETARG_A(i), b = GETARG_B(i), c = GETARG_C(i);
+  size_t slow[7], done;
+  int nslow = 0, k;
+  if ((ISK(b) && !ttisnumber(&p->k[INDEXK(b)])) ||
+      (ISK(c) && iscollectable(&p->k[INDEXK(c)]))) {
+    helper(J, pc, h_settable);
+    return;
+  }
+  cmp32i(J, RBASE, slot(a) + TT, INLUA_TTABLE);
+  slow[nslow++] = jumpfwd(J, CC_NE);
+  checknum(J, p, b, slow, &nslow);
+  if (!ISK(c)) {
+    cmp32i(J, RBASE, slot(c) + TT, INLUA_TSTRING);
+    slow[nslow++] = jumpfwd(J, CC_AE);  /* collectable values need barriers */
+  }
+  load64(J, RAX, RBASE, slot(a));
+  sdmem(J, SD_LOAD, 0, rkbase(b), rkdisp(b));
+  emit(J, 0xF2); emit(J, 0x0F); emit(J, 0x2C); modrm_reg(J, RCX, 0);
+  emit(J, 0xF2); emit(J, 0x0F); emit(J, 0x2A); modrm_reg(J, 1, RCX);
+  ucomisd(J, 0, 1);
+  slow[nslow++] = jumpfwd(J, CC_P);
+  slow[nslow++] = jumpfwd(J, CC_NE);
+  emit(J, 0x83); modrm_reg(J, 5, RCX); emit(J, 1);
+  cmp32(J, RCX, RAX, cast_int(offsetof(Table, sizearray)));
+  slow[nslow++] = jumpfwd(J, CC_AE);
+  load64(J, RDX, RAX, cast_int(offsetof(Table, array)));
+  rex(J, 1, 0, RCX); emit(J, 0xC1); modrm_reg(J, 4, RCX); emit(J, 4);
+  rex(J, 1, RDX, RCX); emit(J, 0x01); modrm_reg(J, RCX, RDX);
+  cmp32i(J, RDX, TT, INLUA_TNIL);  /* nil may need __newindex */
+  slow[nslow++] = jumpfwd(J, CC_E);
+  loadtv(J, 0, rkbase(c), rkdisp(c));
+  storetv(J, RDX, 0, 0);
+  done = jumpfwd(J, CC_JMP);
+  for (k = 0; k < nslow; k++) here(J, slow[k]);
+  helper(J, pc, h_settable);
+  here(J, done);
+}
+
+
+static void forloop (JitState *J, int pc, Instruction i) {
+  int ra = slot(GETARG_A(i));
+  int dest = pc + 1 + GETARG_sBx(i);
+  size_t neg, cont1, cont2, end1, end2;
+  sdmem(J, SD_LOAD, 0, RBASE, ra);
+  sdmem(J, SD_ADD, 0, RBASE, ra + slot(2));  /* xmm0 = idx + step */
+  sdmem(J, SD_LOAD, 1, RBASE, ra + slot(1));  /* xmm1 = limit */
+  sdmem(J, SD_LOAD, 3, RBASE, ra + slot(2));  /* xmm3 = step */
+  emit(J, 0x66); emit(J, 0x0F); emit(J, 0x57); modrm_reg(J, 2, 2);
+  /* xorpd xmm2, xmm2 */
+  ucomisd(J, 3, 2);
+  neg = jumpfwd(J, CC_BE);  /* !(0 < step) */
+  ucomisd(J, 1, 0);
+  cont1 = jumpfwd(J, CC_AE);  /* idx <= limit */
+  end1 = jumpfwd(J, CC_JMP);
+  here(J, neg);
+  ucomisd(J, 0, 1);
+  cont2 = jumpfwd(J, CC_AE);  /* limit <= idx */
+  end2 = jumpfwd(J, CC_JMP);
+  here(J, cont1);
+  here(J, cont2);
+  sdmem(J, SD_STORE, 0, RBASE, ra);
+  sdmem(J, SD_STORE, 0, RBASE, ra + slot(3));
+  store32i(J, RBASE, ra + slot(3) + TT, INLUA_TNUMBER);
+  countloop(J, pc);
+  checkhook(J, dest);
+  jumppc(J, CC_JMP, dest);
+  here(J, end1);
+  here(J, end2);
+}
+
+
+static int translate (JitState *J, int pc) {
+  Proto *p = J->p;
+  Instruction i = p->code[pc];
+  int a = GETARG_A(i);
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: {
+      loadtv(J, 0, RBASE, slot(GETARG_B(i)));
+      storetv(J, RBASE, slot(a), 0);
+      break;
+    }
+    case OP_LOADK: {
+      loadtv(J, 0, RKST, slot(GETARG_Bx(i)));
+      storetv(J, RBASE, slot(a), 0);
+      break;
+    }
+    case OP_LOADBOOL: {
+      store32i(J, RBASE, slot(a), GETARG_B(i));
+      store32i(J, RBASE, slot(a) + TT, INLUA_TBOOLEAN);
+      if (GETARG_C(i)) jumppc(J, CC_JMP, pc + 2);
+      break;
+    }
+    case OP_LOADNIL: {
+      int r;
+      for (r = a; r <= GETARG_B(i); r++)
+        store32i(J, RBASE, slot(r) + TT, INLUA_TNIL);
+      break;
+    }
+    case OP_GETUPVAL: {
+      load64(J, RAX, RCL, cast_int(offsetof(LClosure, upvals)) +
+                         GETARG_B(i) * cast_int(sizeof(UpVal *)));
+      load64(J, RAX, RAX, cast_int(offsetof(UpVal, v)));
+      loadtv(J, 0, RAX, 0);
+      storetv(J, RBASE, slot(a), 0);
+      break;
+    }
+    case OP_GETGLOBAL: helper(J, pc, h_getglobal); break;
+    case OP_GETTABLE: case OP_GETTABLEOP: gettable(J, pc, i); break;
+    case OP_SETGLOBAL: helper(J, pc, h_setglobal); break;
+    case OP_SETUPVAL: helper(J, pc, h_setupval); break;
+    case OP_SETTABLE: case OP_SETTABLELOOP: settable(J, pc, i); break;
+    case OP_NEWTABLE: helper(J, pc, h_newtable); break;
+    case OP_SELF: helper(J, pc, h_self); break;
+    case OP_ADD: case OP_ADDLOOP: arith(J, pc, i, SD_ADD); break;
+    case OP_SUB: arith(J, pc, i, SD_SUB); break;
+    case OP_MUL: arith(J, pc, i, SD_MUL); break;
+    case OP_DIV: arith(J, pc, i, SD_DIV); break;
+    case OP_MOD: case OP_POW: helper(J, pc, h_arith); break;
+    case OP_UNM: {
+      int b = GETARG_B(i);
+      size_t slow, done;
+      cmp32i(J, RBASE, slot(b) + TT, INLUA_TNUMBER);
+      slow = jumpfwd(J, CC_NE);
+      load64(J, RAX, RBASE, slot(b));
+      rex(J, 1, 0, RAX); emit(J, 0x0F); emit(J, 0xBA);  /* btc rax, 63 */
+      modrm_reg(J, 7, RAX); emit(J, 63);
+      store64(J, RBASE, slot(a), RAX);
+      store32i(J, RBASE, slot(a) + TT, INLUA_TNUMBER);
+      done = jumpfwd(J, CC_JMP);
+      here(J, slow);
+      helper(J, pc, h_arith);
+      here(J, done);
+      break;
+    }
+    case OP_NOT: {
+      size_t isfalse[2], done;
+      testfalse(J, GETARG_B(i), isfalse);
+      store32i(J, RBASE, slot(a), 0);
+      done = jumpfwd(J, CC_JMP);
+      here(J, isfalse[0]);
+      here(J, isfalse[1]);
+      store32i(J, RBASE, slot(a), 1);
+      here(J, done);
+      store32i(J, RBASE, slot(a) + TT, INLUA_TBOOLEAN);
+      break;
+    }
+    case OP_LEN: {
+      size_t istable, other;
+      cmp32i(J, RBASE, slot(GETARG_B(i)) + TT, INLUA_TTABLE);
+      istable = jumpfwd(J, CC_E);
+      cmp32i(J, RBASE, slot(GETARG_B(i)) + TT, INLUA_TSTRING);
+      other = jumpfwd(J, CC_NE);
+      here(J, istable);
+      helper(J, pc, h_len);
+      jumppc(J, CC_JMP, pc + 1);
+      here(J, other);
+      exitto(J, pc);
+      break;
+    }
+    case OP_JMP: {
+      int dest = pc + 1 + GETARG_sBx(i);
+      if (dest <= pc) {
+        countloop(J, pc);
+        checkhook(J, dest);
+      }
+      jumppc(J, CC_JMP, dest);
+      break;
+    }
+    case OP_EQ: equal(J, pc, i); break;
+    case OP_LT: compare(J, pc, i, h_lt); break;
+    case OP_LE: compare(J, pc, i, h_le); break;
+    case OP_SWITCH: break;  /* the tests that follow are cheaper here */
+    case OP_TEST: case OP_TESTSET: {
+      /* OP_TEST jumps when `l_isfalse(R(x)) != C' */
+      int dest = pc + 2 + GETARG_sBx(p->code[pc + 1]);
+      int b = (GET_OPCODE(i) == OP_TEST) ? a : GETARG_B(i);
+      size_t isfalse[2];
+      testfalse(J, b, isfalse);
+      if (GETARG_C(i)) {  /* true value jumps */
+        if (GET_OPCODE(i) == OP_TESTSET) {
+          loadtv(J, 0, RBASE, slot(b));
+          storetv(J, RBASE, slot(a), 0);
+        }
+        jumppc(J, CC_JMP, dest);
+        here(J, isfalse[0]);
+        here(J, isfalse[1]);
+        jumppc(J, CC_JMP, pc + 2);
+      }
+      else {  /* false value jumps */
+        jumppc(J, CC_JMP, pc + 2);
+        here(J, isfalse[0]);
+        here(J, isfalse[1]);
+        if (GET_OPCODE(i) == OP_TESTSET) {
+          loadtv(J, 0, RBASE, slot(b));
+          storetv(J, RBASE, slot(a), 0);
+        }
+        jumppc(J, CC_JMP, dest);
+      }
+      break;
+    }
+    case OP_FORLOOP: forloop(J, pc, i); break;
+    case OP_CLOSE: helper(J, pc, h_close); break;
+    case OP_CLOSURE: {
+      exitto(J, pc);
+      return pc + 1 + p->p[GETARG_Bx(i)]->nups;  /* skip pseudo-instructions */
+    }
+    case OP_SETLIST: {
+      exitto(J, pc);
+      return pc + ((GETARG_C(i) == 0) ? 2 : 1);  /* skip extra argument */
+    }
+    default: {  /* calls, returns, etc. are left to the interpreter */
+      exitto(J, pc);
+      break;
+    }
+  }
+  return pc + 1;
+}
+
+/* }====================================================== */
+
+
+static void *mapmem (size_t size) {
+  void *m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (m == MAP_FAILED) ? NULL : m;
+}
+
+
+void luaJ_compile (inlua_State *L, Proto *p) {
+  JitState J;
+  JitCode *jc;
+  size_t cap, fixsize;
+  int pc, k;
+  if (p->jit != NULL || p->sizecode > INLUAI_JITMAXCODE ||
+      sizeof(TValue) != 16)
+    return;
+  if (p->loopcount == NULL)  /* machine code counts loops at fixed addresses */
+    luaF_initcounts(L, p);
+  jc = cast(JitCode *, luaM_malloc(L, sizeof(JitCode) +
+                                      p->sizecode * sizeof(unsigned int)));
+  jc->entry = cast(unsigned int *, jc + 1);
+  jc->sizeentry = p->sizecode;
+  cap = cast(size_t, p->sizecode) * MAXINSTRSIZE + 64;
+  fixsize = cast(size_t, p->sizecode) * 8 * sizeof(int);
+  J.code = cast(unsigned char *, mapmem(cap));
+  J.fixup = cast(int *, mapmem(fixsize));
+  if (J.code == NULL || J.fixup == NULL) {
+    if (J.code) munmap(J.code, cap);
+    if (J.fixup) munmap(J.fixup, fixsize);
+    luaM_freemem(L, jc, sizeof(JitCode) + p->sizecode * sizeof(unsigned int));
+    return;
+  }
+  J.n = 0;
+  J.p = p;
+  J.entry = jc->entry;
+  J.nfixup = 0;
+  /* prologue: save callee-saved registers, load state, jump to entry */
+  emit(&J, 0x55); emit(&J, 0x53);  /* push rbp; push rbx */
+  emit(&J, 0x41); emit(&J, 0x54); emit(&J, 0x41); emit(&J, 0x55);
+  emit(&J, 0x41); emit(&J, 0x56); emit(&J, 0x41); emit(&J, 0x57);
+  emit(&J, 0x48); emit(&J, 0x83); emit(&J, 0xEC); emit(&J, 0x08);
+  /* sub rsp, 8 (keeps the stack aligned for calls) */
+  movreg(&J, RL, RDI);
+  movreg(&J, RBASE, RSI);
+  movreg(&J, RKST, RDX);
+  movreg(&J, RCL, RCX);
+  emit(&J, 0x41); emit(&J, 0xFF); emit(&J, 0xE0);  /* jmp r8 */
+  /* epilogue */
+  J.epilogue = J.n;
+  emit(&J, 0x48); emit(&J, 0x83); emit(&J, 0xC4); emit(&J, 0x08);
+  emit(&J, 0x41); emit(&J, 0x5F); emit(&J, 0x41); emit(&J, 0x5E);
+  emit(&J, 0x41); emit(&J, 0x5D); emit(&J, 0x41); emit(&J, 0x5C);
+  emit(&J, 0x5B); emit(&J, 0x5D); emit(&J, 0xC3);
+  for (pc = 0; pc < p->sizecode; ) {
+    int next;
+    J.entry[pc] = cast(unsigned int, J.n);
+    next = translate(&J, pc);
+    inlua_assert(J.n <= cap - MAXINSTRSIZE * (p->sizecode - next));
+    while (++pc < next)  /* instructions that are not code */
+      J.entry[pc] = cast(unsigned int, J.n);
+  }
+  for (k = 0; k < J.nfixup; k++) {
+    int target = J.fixup[2*k + 1];
+    inlua_assert(0 <= target && target < p->sizecode);
+    patchto(&J, cast(size_t, J.fixup[2*k]), J.entry[target]);
+  }
+  munmap(J.fixup, fixsize);
+  if (mprotect(J.code, cap, PROT_READ | PROT_EXEC) != 0) {
+    munmap(J.code, cap);
+    luaM_freemem(L, jc, sizeof(JitCode) + p->sizecode * sizeof(unsigned int));
+    return;
+  }
+  jc->mcode = J.code;
+  jc->size = cap;
+  p->jit = jc;
+}
+
+
+const Instruction *luaJ_execute (inlua_State *L, const Instruction *pc) {
+  LClosure *cl = &clvalue(L->ci->func)->l;
+  Proto *p = cl->p;
+  JitCode *jc = p->jit;
+  JitFunction f = cast(JitFunction, cast(size_t, jc->mcode));
+  int n = (*f)(L, L->base, p->k, cl, jc->mcode + jc->entry[pc - p->code]);
+  return p->code + n;
+}
+
+
+void luaJ_free (inlua_State *L, Proto *p) {
+  JitCode *jc = p->jit;
+  if (jc == NULL) return;
+  munmap(jc->mcode, jc->size);
+  luaM_freemem(L, jc, sizeof(JitCode) + jc->sizeentry * sizeof(unsigned int));
+  p->jit = NULL;
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+** $Id: ljit.h $
+** Baseline JIT compiler for x86-64
+** See Copyright Notice in inlua.h
+*/
+
+#ifndef ljit_h
+#define ljit_h
+
+
+#include "lobject.h"
+
+
+#if defined(INLUA_USE_JIT)
+
+typedef struct JitCode {
+  unsigned char *mcode;  /* machine code (mapped executable) */
+  size_t size;  /* size of mapped area */
+  unsigned int *entry;  /* offset in `mcode' of each instruction */
+  int sizeentry;
+} JitCode;
+
+
+#define luaJ_hot(p)	((p)->ncalls == INLUAI_JITHOT)
+
+INLUAI_FUNC void luaJ_compile (inlua_State *L, Proto *p);
+INLUAI_FUNC const Instruction *luaJ_execute (inlua_State *L,
+                                             const Instruction *pc);
+INLUAI_FUNC void luaJ_free (inlua_State *L, Proto *p);
+
+#else
+
+#define luaJ_free(L,p)	((void)0)
+
+#endif
+
+#endif
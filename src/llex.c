@@ -66,19 +66,59 @@ const char *const luaX_tokens [] = {
 #define save_and_next(ls) (save(ls, ls->current), next(ls))
 
 
-static void save (LexState *ls, int c) {
+static void growbuffer (LexState *ls, size_t l) {
   Mbuffer *b = ls->buff;
-  if (b->n + 1 > b->buffsize) {
-    size_t newsize;
-    if (b->buffsize >= MAX_SIZET/2)
+  size_t newsize = b->buffsize;
+  do {
+    if (newsize >= MAX_SIZET/2)
       luaX_lexerror(ls, "lexical element too long", 0);
-    newsize = b->buffsize * 2;
-    luaZ_resizebuffer(ls->L, b, newsize);
-  }
+    newsize *= 2;
+  } while (b->n + l > newsize);
+  luaZ_resizebuffer(ls->L, b, newsize);
+}
+
+
+static void save (LexState *ls, int c) {
+  Mbuffer *b = ls->buff;
+  if (b->n + 1 > b->buffsize)
+    growbuffer(ls, 1);
   b->buffer[b->n++] = cast(char, c);
 }
 
 
+/*
+** Scanning in place. The reader gives the source in chunks (a whole
+** buffer for inluaL_loadbuffer or a mapped file), and `current' is always
+** the byte just before z->p, so the chunk holds the source from `current'
+** up to `chunkend'. The lexer scans runs of a token there with plain
+** pointer loops (and memchr, for comments), copies them to the buffer in
+** one go and moves the stream past them with `skipto'. A run that reaches
+** the end of the chunk continues one character at a time. These hold only
+** while `current' is not EOZ.
+*/
+#define chunkpos(ls)	((ls)->z->p - 1)
+#define chunkend(ls)	((ls)->z->p + (ls)->z->n)
+
+
+static void savespan (LexState *ls, const char *s, size_t l) {
+  Mbuffer *b = ls->buff;
+  if (b->n + l > b->buffsize)
+    growbuffer(ls, l);
+  memcpy(b->buffer + b->n, s, l);
+  b->n += l;
+}
+
+
+/* makes `q' (after `current', at most `chunkend') the current character */
+static void skipto (LexState *ls, const char *q) {
+  ZIO *z = ls->z;
+  inlua_assert(z->p <= q && q <= chunkend(ls));
+  z->n -= q - z->p;
+  z->p = q;
+  next(ls);
+}
+
+
 void luaX_init (inlua_State *L) {
   int i;
   for (i=0; i<NUM_RESERVED; i++) {
@@ -135,7 +175,10 @@ void luaX_syntaxerror (LexState *ls, const char *msg) {
 TString *luaX_newstring (LexState *ls, const char *str, size_t l) {
   inlua_State *L = ls->L;
   TString *ts = luaS_newlstr(L, str, l);
-  TValue *o = luaH_setstr(L, ls->fs->h, ts);  /* entry for `str' */
+  TValue *o;
+  if (ls->fs == NULL)  /* data chunk? (`luaY_data' anchors it) */
+    return ts;
+  o = luaH_setstr(L, ls->fs->h, ts);  /* entry for `str' */
   if (ttisnil(o)) {
     setbvalue(o, 1);  /* make sure `str' will not be collected */
     luaC_checkGC(L);
@@ -208,19 +251,44 @@ static void trydecpoint (LexState *ls, SemInfo *seminfo) {
 }
 
 
+/* up to 15 decimal digits are exact in a double: no need for strtod */
+static int shortint (const char *s, size_t l, inlua_Number *r) {
+  double n = 0;
+  if (l > 15) return 0;
+  for (; l > 0; l--, s++) {
+    if (!isdigit(char2int(*s))) return 0;
+    n = n * 10 + (*s - '0');
+  }
+  *r = cast_num(n);
+  return 1;
+}
+
+
 /* INLUA_NUMBER */
 static void read_numeral (LexState *ls, SemInfo *seminfo) {
+  const char *p = chunkpos(ls), *q = p + 1, *end = chunkend(ls);
   inlua_assert(isdigit(ls->current));
-  do {
+  while (q < end && (isdigit(char2int(*q)) || *q == '.')) q++;
+  savespan(ls, p, q - p);
+  skipto(ls, q);
+  while (isdigit(ls->current) || ls->current == '.')
     save_and_next(ls);
-  } while (isdigit(ls->current) || ls->current == '.');
   if (check_next(ls, "Ee"))  /* `E'? */
     check_next(ls, "+-");  /* optional exponent sign */
+  if (isalnum(ls->current) || ls->current == '_') {
+    end = chunkend(ls);  /* `skipto' may have read another chunk */
+    for (q = chunkpos(ls); q < end && (isalnum(char2int(*q)) || *q == '_');
+         q++)
+      if (*q != '_') save(ls, *q);
+    skipto(ls, q);
+  }
   while (isalnum(ls->current) || ls->current == '_') {
     /* skip any underscores */
     if (ls->current != '_') save_and_next(ls);
     else next(ls);
   }
+  if (shortint(luaZ_buffer(ls->buff), luaZ_bufflen(ls->buff), &seminfo->r))
+    return;
   save(ls, '\0');
   buffreplace(ls, '.', ls->decpoint);  /* follow locale for decimal point */
   if (!luaO_str2d(luaZ_buffer(ls->buff), &seminfo->r))  /* format error? */
@@ -285,8 +353,11 @@ static void read_long_string (LexState *ls, SemInfo *seminfo, int sep) {
         break;
       }
       default: {
-        if (seminfo) save_and_next(ls);
-        else next(ls);
+        const char *p = chunkpos(ls), *q = p + 1, *end = chunkend(ls);
+        while (q < end && *q != ']' && *q != '[' && *q != '\n' && *q != '\r')
+          q++;
+        if (seminfo) savespan(ls, p, q - p);
+        skipto(ls, q);
       }
     }
   } endloop:
@@ -342,8 +413,13 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
         next(ls);
         continue;
       }
-      default:
-        save_and_next(ls);
+      default: {
+        const char *p = chunkpos(ls), *q = p + 1, *end = chunkend(ls);
+        while (q < end && *q != del && *q != '\\' && *q != '\n' && *q != '\r')
+          q++;
+        savespan(ls, p, q - p);
+        skipto(ls, q);
+      }
     }
   }
   save_and_next(ls);  /* skip delimiter */
@@ -380,8 +456,12 @@ static int llex (LexState *ls, SemInfo *seminfo) {
           }
         }
         /* else short comment */
-        while (!currIsNewline(ls) && ls->current != EOZ)
-          next(ls);
+        while (!currIsNewline(ls) && ls->current != EOZ) {
+          const char *p = chunkpos(ls), *end = chunkend(ls);
+          const char *q = (const char *)memchr(p, '\n', end - p);
+          const char *r = (const char *)memchr(p, '\r', (q ? q : end) - p);
+          skipto(ls, r ? r : q ? q : end);
+        }
         continue;
       }
       case '[': {
@@ -450,8 +530,10 @@ static int llex (LexState *ls, SemInfo *seminfo) {
       }
       default: {
         if (isspace(ls->current)) {
+          const char *q = chunkpos(ls) + 1, *end = chunkend(ls);
           inlua_assert(!currIsNewline(ls));
-          next(ls);
+          while (q < end && (*q == ' ' || *q == '\t')) q++;
+          skipto(ls, q);
           continue;
         }
         else if (isdigit(ls->current)) {
@@ -461,9 +543,12 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         else if (isalpha(ls->current) || ls->current == '_') {
           /* identifier or reserved word */
           TString *ts;
-          do {
+          const char *p = chunkpos(ls), *q = p + 1, *end = chunkend(ls);
+          while (q < end && (isalnum(char2int(*q)) || *q == '_')) q++;
+          savespan(ls, p, q - p);
+          skipto(ls, q);
+          while (isalnum(ls->current) || ls->current == '_')
             save_and_next(ls);
-          } while (isalnum(ls->current) || ls->current == '_');
           ts = luaX_newstring(ls, luaZ_buffer(ls->buff),
                                   luaZ_bufflen(ls->buff));
           if (ts->tsv.reserved > 0)  /* reserved word? */
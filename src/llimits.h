@@ -31,6 +31,8 @@ typedef unsigned char lu_byte;
 
 #define MAX_LUMEM	((lu_mem)(~(lu_mem)0)-2)
 
+#define MAX_LMEM	((l_mem)(MAX_LUMEM >> 1))
+
 
 #define MAX_INT (INT_MAX-2)  /* maximum value of an int (-2 for safety) */
 
@@ -90,7 +92,7 @@ typedef lu_int32 Instruction;
 
 
 /* maximum stack for a Lua function */
-#define MAXSTACK	250
+#define MAXSTACK	255
 
 
 
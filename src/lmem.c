@@ -14,6 +14,7 @@
 
 #include "ldebug.h"
 #include "ldo.h"
+#include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -48,8 +49,10 @@ void *luaM_growaux_ (inlua_State *L, void *block, int *size, size_t size_elems,
   void *newblock;
   int newsize;
   if (*size >= limit/2) {  /* cannot double it? */
-    if (*size >= limit)  /* cannot grow even a little? */
+    if (*size >= limit) {  /* cannot grow even a little? */
+      luaM_tag(L, 0);
       luaG_runerror(L, errormsg);
+    }
     newsize = limit;  /* still have at least one free place */
   }
   else {
@@ -64,6 +67,7 @@ void *luaM_growaux_ (inlua_State *L, void *block, int *size, size_t size_elems,
 
 
 void *luaM_toobig (inlua_State *L) {
+  luaM_tag(L, 0);
   luaG_runerror(L, "memory allocation error: block too big");
   return NULL;  /* to avoid warnings */
 }
@@ -76,11 +80,23 @@ void *luaM_toobig (inlua_State *L) {
 void *luaM_realloc_ (inlua_State *L, void *block, size_t osize, size_t nsize) {
   global_State *g = G(L);
   inlua_assert((osize == 0) == (block == NULL));
+#if defined(INLUA_USE_PARALLELGC)
+  if (nsize == 0 && g->gcbatching)  /* freed by a sweep step? */
+    block = luaC_batchfree(L, block, osize);
+  else
+#endif
   block = (*g->frealloc)(g->ud, block, osize, nsize);
-  if (block == NULL && nsize > 0)
+  if (block == NULL && nsize > 0) {
+    luaM_tag(L, 0);
     luaD_throw(L, INLUA_ERRMEM);
+  }
   inlua_assert((nsize == 0) == (block == NULL));
   g->totalbytes = (g->totalbytes - osize) + nsize;
+#if defined(INLUA_USE_STATS)
+  if (nsize > osize)
+    g->stats.alloc[g->stats.alloctag] += nsize - osize;
+  g->stats.alloctag = 0;
+#endif
   return block;
 }
 
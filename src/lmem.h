@@ -16,6 +16,13 @@
 #define MEMERRMSG	"not enough memory"
 
 
+/* type of the object the next allocation is for (see Stats) */
+#if defined(INLUA_USE_STATS)
+#define luaM_tag(L,t)	(G(L)->stats.alloctag = (t))
+#else
+#define luaM_tag(L,t)	((void)0)
+#endif
+
 #define luaM_reallocv(L,b,on,n,e) \
 	((cast(size_t, (n)+1) <= MAX_SIZET/(e)) ?  /* +1 to avoid warnings */ \
 		luaM_realloc_(L, (b), (on)*(e), (n)*(e)) : \
@@ -201,13 +201,25 @@ typedef union TString {
   struct {
     CommonHeader;
     lu_byte reserved;
+    lu_byte external;  /* contents are a TExtern, not the bytes themselves */
     unsigned int hash;
     size_t len;
   } tsv;
 } TString;
 
 
-#define getstr(ts)	cast(const char *, (ts) + 1)
+/*
+** Contents of an external string: bytes owned by the host
+*/
+typedef struct TExtern {
+  const char *data;
+  inlua_Release release;  /* called when the string is collected */
+  void *ud;
+} TExtern;
+
+
+#define getstr(ts)	((ts)->tsv.external ? \
+	cast(const TExtern *, (ts) + 1)->data : cast(const char *, (ts) + 1))
 #define svalue(o)       getstr(rawtsvalue(o))
 
 
@@ -216,6 +228,7 @@ typedef union Udata {
   L_Umaxalign dummy;  /* ensures maximum alignment for `local' udata */
   struct {
     CommonHeader;
+    lu_byte array;  /* element type of a typed array, or 0 */
     struct Table *metatable;
     struct Table *env;
     size_t len;
@@ -243,13 +256,22 @@ typedef struct Proto {
   int sizelineinfo;
   int sizep;  /* size of `p' */
   int sizelocvars;
+  int sizeloopcount;
   int linedefined;
   int lastlinedefined;
   GCObject *gclist;
+  struct JitCode *jit;  /* machine code for this function (see ljit.c) */
+  lu_int32 ncalls;  /* number of calls (to find hot functions) */
+  lu_int32 *loopcount;  /* times each back edge was taken, by pc (lazy) */
+  struct Table **switches;  /* targets of each OP_SWITCH, by constant */
+  int sizeswitches;
+  struct InlineCall *inlined;  /* calls inlined into the code (debug) */
+  int sizeinlined;
   lu_byte nups;  /* number of upvalues */
   lu_byte numparams;
   lu_byte is_vararg;
   lu_byte maxstacksize;
+  lu_byte nilregs;  /* code assumes registers below this are nil at entry */
 } Proto;
 
 
@@ -266,6 +288,21 @@ typedef struct LocVar {
 } LocVar;
 
 
+/*
+** a call whose body was copied into the code (see luaK_inline); the
+** locals of the body follow the function's own in `locvars'
+*/
+typedef struct InlineCall {
+  int startpc;  /* first instruction of the copy */
+  int endpc;    /* first instruction after the copy */
+  int line;     /* line of the call */
+  int func;     /* register of the call; the body's registers follow it */
+  int closure;  /* register holding the inlined function */
+  int firstvar;  /* index of the body's first local in `locvars' */
+  int nvars;    /* number of locals of the body */
+} InlineCall;
+
+
 
 /*
 ** Upvalues
@@ -289,8 +326,8 @@ typedef struct UpVal {
 */
 
 #define ClosureHeader \
-	CommonHeader; lu_byte isC; lu_byte nupvalues; GCObject *gclist; \
-	struct Table *env
+	CommonHeader; lu_byte isC; lu_byte nupvalues; lu_byte ncopies; \
+	GCObject *gclist; struct Table *env
 
 typedef struct CClosure {
   ClosureHeader;
@@ -299,6 +336,11 @@ typedef struct CClosure {
 } CClosure;
 
 
+/*
+** `ncopies' of the upvalues of a Lua closure are values copied in when it
+** was made (see OP_CLOSURE): closed upvalues kept after `upvals' in the
+** same block (see getcopies in lfunc.h), which are not collectable objects
+*/
 typedef struct LClosure {
   ClosureHeader;
   struct Proto *p;
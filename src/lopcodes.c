@@ -52,6 +52,10 @@ const char *const luaP_opnames[NUM_OPCODES+1] = {
   "CLOSE",
   "CLOSURE",
   "VARARG",
+  "GETTABLEOP",
+  "ADDLOOP",
+  "SETTABLELOOP",
+  "SWITCH",
   NULL
 };
 
@@ -98,5 +102,9 @@ const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 0, OpArgN, OpArgN, iABC)		/* OP_CLOSE */
  ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_CLOSURE */
  ,opmode(0, 1, OpArgU, OpArgN, iABC)		/* OP_VARARG */
+ ,opmode(0, 1, OpArgR, OpArgK, iABC)		/* OP_GETTABLEOP */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDLOOP */
+ ,opmode(0, 0, OpArgK, OpArgK, iABC)		/* OP_SETTABLELOOP */
+ ,opmode(0, 0, OpArgU, OpArgU, iABC)		/* OP_SWITCH */
 };
 
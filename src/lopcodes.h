@@ -204,11 +204,16 @@ OP_SETLIST,/*	A B C	R(A)[(C-1)*FPF+i] := R(A+i), 1 <= i <= B	*/
 OP_CLOSE,/*	A 	close all variables in the stack up to (>=) R(A)*/
 OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx], R(A), ... ,R(A+n))	*/
 
-OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
+
+OP_GETTABLEOP,/* A B C	R(A) := R(B)[RK(C)]; then next (numeric) op	*/
+OP_ADDLOOP,/*	A B C	R(A) := RK(B) + RK(C); then next OP_FORLOOP	*/
+OP_SETTABLELOOP,/* A B C	R(A)[RK(B)] := RK(C); then next OP_FORLOOP	*/
+OP_SWITCH/*	A B C	run the B tests of R(A) that follow (see note)	*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_VARARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_SWITCH) + 1)
 
 
 
@@ -230,6 +235,27 @@ OP_VARARG/*	A B	R(A), R(A+1), ..., R(A+B-1) = vararg		*/
       (true or false).
 
   (*) All `skips' (pc++) assume that next instruction is a jump
+
+  (*) OP_CLOSURE is followed by one pseudo-instruction per upvalue of the
+      new closure: OP_GETUPVAL 0 B gives it upvalue B of the running
+      closure, OP_MOVE 0 B shares register B with it as an upvalue, and
+      OP_MOVE 1 B (set by luaK_captures) copies the value of register B
+      into it. Upvalues that are copies in the running closure are copied.
+
+  (*) OP_GETTABLEOP, OP_ADDLOOP and OP_SETTABLELOOP are superinstructions
+      created by luaK_fuse: they do the work of OP_GETTABLE, OP_ADD and
+      OP_SETTABLE and then execute the next instruction (an OP_ADD, OP_SUB,
+      OP_MUL, OP_DIV, OP_LT or OP_LE over numbers, or an OP_FORLOOP) in the
+      same dispatch. The next instruction is kept intact, so jumps into it
+      still work and it is dispatched normally when hooks are active or
+      when its operands are not numbers.
+
+  (*) OP_SWITCH, created by luaK_switches, comes before a chain of B
+      arms, each an OP_EQ of R(A) against a number or string constant and
+      its jump, where failing one test goes to the next arm. It goes at
+      once where the chain would go, through the table Proto.switches[C]
+      built by luaF_initswitches. The chain is kept intact: when hooks
+      are active, OP_SWITCH does nothing and the tests run one by one.
 ===========================================================================*/
 
 
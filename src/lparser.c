@@ -16,6 +16,7 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lgc.h"
 #include "llex.h"
 #include "lmem.h"
 #include "lobject.h"
@@ -29,7 +30,7 @@
 
 #define hasmultret(k)		((k) == VCALL || (k) == VVARARG)
 
-#define getlocvar(fs, i)	((fs)->f->locvars[(fs)->actvar[i]])
+#define getlocvar(fs, i)	((fs)->f->locvars[(fs)->actvar[i].idx])
 
 #define luaY_checklimit(fs,v,l,m)	if ((v)>(l)) errorlimit(fs,l,m)
 
@@ -40,7 +41,8 @@
 typedef struct BlockCnt {
   struct BlockCnt *previous;  /* chain */
   int breaklist;  /* list of jumps out of this loop */
-  lu_byte nactvar;  /* # active locals outside the breakable structure */
+  lu_byte nactvar;  /* first free register outside the block */
+  lu_byte nvars;  /* # declared variables outside the block */
   lu_byte freereg; /* previous free register, added because blocks can be expressions */
   lu_byte upval;  /* true if some variable in the block is an upvalue */
   lu_byte isbreakable;  /* true if `block' is a loop */
@@ -160,30 +162,46 @@ static int registerlocalvar (LexState *ls, TString *varname) {
 }
 
 
-#define new_localvarliteral(ls,v,n) \
-  new_localvar(ls, luaX_newstring(ls, "" v, (sizeof(v)/sizeof(char))-1), n)
+#define new_localvarliteral(ls,v) \
+  new_localvar(ls, luaX_newstring(ls, "" v, (sizeof(v)/sizeof(char))-1))
 
 
-static void new_localvar (LexState *ls, TString *name, int n) {
+/*
+** A variable is declared (pushed on `actvar' with no register) before
+** its initial values are parsed, and gets the next free register when
+** `adjustlocalvars' activates it. Expressions in between may contain
+** blocks with their own variables; these go above the declared ones and
+** are gone before the activation.
+*/
+static void new_localvar (LexState *ls, TString *name) {
   FuncState *fs = ls->fs;
-  luaY_checklimit(fs, fs->nactvar+n+1, INLUAI_MAXVARS, "local variables");
-  fs->actvar[fs->nactvar+n] = cast(unsigned short, registerlocalvar(ls, name));
+  luaY_checklimit(fs, fs->nvars+1, INLUAI_MAXVARS, "local variables");
+  fs->actvar[fs->nvars].idx = cast(unsigned short, registerlocalvar(ls, name));
+  fs->actvar[fs->nvars].reg = NO_REG;
+  fs->actvar[fs->nvars].proto = -1;
+  fs->nvars++;
 }
 
 
 static void adjustlocalvars (LexState *ls, int nvars) {
   FuncState *fs = ls->fs;
-  fs->nactvar = cast_byte(fs->nactvar + nvars);
-  for (; nvars; nvars--) {
-    getlocvar(fs, fs->nactvar - nvars).startpc = fs->pc;
+  int i = fs->nvars;
+  int first = (fs->bl) ? fs->bl->nvars : 0;
+  while (i > first && fs->actvar[i - 1].reg == NO_REG)
+    i--;  /* find the first declared variable */
+  for (; nvars; nvars--, i++) {
+    inlua_assert(i < fs->nvars && fs->actvar[i].reg == NO_REG);
+    fs->actvar[i].reg = fs->nactvar;
+    fs->nactvar = cast_byte(fs->nactvar + 1);
+    getlocvar(fs, i).startpc = fs->pc;
   }
 }
 
 
 static void removevars (LexState *ls, int tolevel) {
   FuncState *fs = ls->fs;
-  while (fs->nactvar > tolevel)
-    getlocvar(fs, --fs->nactvar).endpc = fs->pc;
+  while (fs->nvars > tolevel)
+    getlocvar(fs, --fs->nvars).endpc = fs->pc;
 }
 
 
@@ -211,17 +229,70 @@ static int indexupvalue (FuncState *fs, TString *name, expdesc *v) {
 }
 
 
+/* returns the register of the active variable `n' */
 static int searchvar (FuncState *fs, TString *n) {
   int i;
-  for (i=fs->nactvar-1; i >= 0; i--) {
-    if (fs->actvar[i] < fs->f->sizelocvars && n == getlocvar(fs, i).varname)
-      return i;
+  for (i=fs->nvars-1; i >= 0; i--) {
+    if (fs->actvar[i].reg != NO_REG && n == getlocvar(fs, i).varname)
+      return fs->actvar[i].reg;
   }
   return -1;  /* not found */
 }
 
 
+/*
+** A variable declared alone with a function literal may have its calls
+** inlined, if nothing but calls in this function ever uses it.
+*/
+static Vardesc *getvardesc (FuncState *fs, int reg) {
+  int i = fs->nvars - 1;
+  while (fs->actvar[i].reg != reg) i--;
+  return &fs->actvar[i];
+}
+
+
+static void noinline (FuncState *fs, int reg) {
+  Vardesc *vd = getvardesc(fs, reg);
+  if (vd->proto >= 0) {
+    int i, n = 0;
+    vd->proto = -1;
+    for (i = 0; i < fs->nsites; i++) {  /* forget its calls */
+      if (fs->sites[i].var != vd->idx)
+        fs->sites[n++] = fs->sites[i];
+    }
+    fs->nsites = cast_byte(n);
+  }
+}
+
+
+static void addsite (FuncState *fs, Vardesc *vd, int move, int pc) {
+  if (vd->proto >= 0 && fs->nsites < INLUAI_MAXINLINE) {
+    Inlinesite *s = &fs->sites[fs->nsites++];
+    s->pc = pc;
+    s->move = move;
+    s->proto = vd->proto;
+    s->var = vd->idx;
+  }
+}
+
+
+/* note that a closure captures the variable in register `reg' */
+static void addcapture (FuncState *fs, int reg) {
+  Vardesc *vd = getvardesc(fs, reg);
+  int i;
+  for (i = 0; i < fs->ncaptures; i++) {
+    if (fs->captures[i].var == vd->idx) return;
+  }
+  if (fs->ncaptures < INLUAI_MAXCAPTURES) {
+    Varreg *c = &fs->captures[fs->ncaptures++];
+    c->var = vd->idx;
+    c->reg = vd->reg;
+  }
+}
+
+
 static void markupval (FuncState *fs, int level) {
+  /* `level' is a register: the block that holds it started below it */
   BlockCnt *bl = fs->bl;
   while (bl && bl->nactvar > level) bl = bl->previous;
   if (bl) bl->upval = 1;
@@ -237,8 +308,11 @@ static int singlevaraux (FuncState *fs, TString *n, expdesc *var, int base) {
     int v = searchvar(fs, n);  /* look up at current level */
     if (v >= 0) {
       init_exp(var, VLOCAL, v);
-      if (!base)
+      if (!base) {
         markupval(fs, v);  /* local will be used as an upval */
+        noinline(fs, v);
+        addcapture(fs, v);
+      }
       return VLOCAL;
     }
     else {  /* not found at current level; try upper one */
@@ -255,8 +329,15 @@ static int singlevaraux (FuncState *fs, TString *n, expdesc *var, int base) {
 static void singlevar (LexState *ls, expdesc *var) {
   TString *varname = str_checkname(ls);
   FuncState *fs = ls->fs;
-  if (singlevaraux(fs, varname, var, 1) == VGLOBAL)
-    var->u.s.info = luaK_stringK(fs, varname);  /* info points to global name */
+  switch (singlevaraux(fs, varname, var, 1)) {
+    case VGLOBAL:
+      var->u.s.info = luaK_stringK(fs, varname);  /* info points to global name */
+      break;
+    case VLOCAL:
+      if (ls->t.token != '(')  /* not called? */
+        noinline(fs, var->u.s.info);
+      break;
+  }
 }
 
 
@@ -294,21 +375,19 @@ static void enterlevel (LexState *ls) {
 
 
 static void enterblock (FuncState *fs, BlockCnt *bl, lu_byte isbreakable) {
-  int i;
   bl->breaklist = NO_JUMP;
   bl->isbreakable = isbreakable;
   bl->nactvar = fs->nactvar;
+  bl->nvars = fs->nvars;
   bl->freereg = fs->freereg;
   bl->upval = 0;
   bl->previous = fs->bl;
   fs->bl = bl;
-  // WARNING: local variables in between previous nactvar and freereg are uninitialized.
-  // This behavior is prevents clobbering the stack when a block is used in an expression with nonrelocables.
-  for(i = fs->nactvar; i < fs->freereg; i++) {
-    fs->actvar[i] = (unsigned short) -1; // make detectably invalid
-  }
+  /* a block used in an expression must not clobber the temporaries of
+     that expression: its variables and temporaries start above them.
+     These registers only become part of the block's register floor;
+     they take no `actvar' entries. */
   fs->nactvar = fs->freereg;
-  // inlua_assert(fs->freereg == fs->nactvar);
 }
 
 // If e is not NULL, sets e to be an VBLOCK expression,
@@ -317,7 +396,7 @@ static void leaveblock (FuncState *fs, expdesc *e) {
   int ret_reg = fs->nactvar;
   fs->bl = bl->previous;
   
-  removevars(fs->ls, bl->freereg);
+  removevars(fs->ls, bl->nvars);
   inlua_assert(fs->nactvar >= bl->nactvar); // should not remove more variables than it started with
   fs->nactvar = bl->nactvar; // this needs to be explicit, since blocks start by setting fs->nactvar to freereg.
 
@@ -378,6 +457,10 @@ static void open_func (LexState *ls, FuncState *fs) {
   fs->np = 0;
   fs->nlocvars = 0;
   fs->nactvar = 0;
+  fs->nvars = 0;
+  fs->nsites = 0;
+  fs->nconsts = 0;
+  fs->ncaptures = 0;
   fs->bl = NULL;
   f->source = ls->source;
   f->maxstacksize = 2;  /* registers 0/1 are always valid */
@@ -396,8 +479,15 @@ static void close_func (LexState *ls) {
   Proto *f = fs->f;
   removevars(ls, 0);
   luaK_ret(fs, 0, 0);  /* final return */
+  luaK_inline(fs);
+  luaK_constants(fs);
+  luaK_captures(fs);
+  luaK_jumps(fs);
+  luaK_switches(fs);
+  luaK_fuse(fs);
   luaM_reallocvector(L, f->code, f->sizecode, fs->pc, Instruction);
   f->sizecode = fs->pc;
+  luaF_initswitches(L, f);
   luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, fs->pc, int);
   f->sizelineinfo = fs->pc;
   luaM_reallocvector(L, f->k, f->sizek, fs->nk, TValue);
@@ -603,14 +693,16 @@ static void parlist (LexState *ls) {
     do {
       switch (ls->t.token) {
         case TK_NAME: {  /* param -> NAME */
-          new_localvar(ls, str_checkname(ls), nparams++);
+          new_localvar(ls, str_checkname(ls));
+          nparams++;
           break;
         }
         case TK_DOTS: {  /* param -> `...' */
           luaX_next(ls);
 #if defined(INLUA_COMPAT_VARARG)
           /* use `arg' as default name */
-          new_localvarliteral(ls, "arg", nparams++);
+          new_localvarliteral(ls, "arg");
+          nparams++;
           f->is_vararg = VARARG_HASARG | VARARG_NEEDSARG;
 #endif
           f->is_vararg |= VARARG_ISVARARG;
@@ -633,7 +725,7 @@ static void body (LexState *ls, expdesc *e, int needself, int line) {
   new_fs.f->linedefined = line;
   checknext(ls, '[');
   if (needself) {
-    new_localvarliteral(ls, "self", 0);
+    new_localvarliteral(ls, "self");
     adjustlocalvars(ls, 1);
   }
   parlist(ls);
@@ -797,8 +889,12 @@ static void primaryexp (LexState *ls, expdesc *v) {
         break;
       }
       case '(': {  /* funcargs */
+        Vardesc *vd = (v->k == VLOCAL) ? getvardesc(fs, v->u.s.info) : NULL;
+        int move = fs->pc;
         luaK_exp2nextreg(fs, v);
+        if (fs->pc != move + 1) move = -1;
         funcargs(ls, v);
+        if (vd) addsite(fs, vd, move, v->u.s.info);
         break;
       }
       default: return;
@@ -1239,6 +1335,7 @@ static void forbody (LexState *ls, int base, int line, int nvars, int isnum) {
   checknext(ls, TK_ARROW);
   prep = isnum ? luaK_codeAsBx(fs, OP_FORPREP, base, NO_JUMP) : luaK_jump(fs);
   enterblock(fs, &bl, 0);  /* scope for declared variables */
+  bl.nvars -= nvars;  /* they were declared before it */
   adjustlocalvars(ls, nvars);
   luaK_reserveregs(fs, nvars);
   checknext(ls, '(');
@@ -1257,10 +1354,10 @@ static void fornum (LexState *ls, int line) {
   /* fornum -> NAME = exp1,exp1[,exp1] forbody */
   FuncState *fs = ls->fs;
   int base = fs->freereg;
-  new_localvarliteral(ls, "(for index)", 0);
-  new_localvarliteral(ls, "(for limit)", 1);
-  new_localvarliteral(ls, "(for step)", 2);
-  new_localvar(ls, str_checkname(ls), 3);
+  new_localvarliteral(ls, "(for index)");
+  new_localvarliteral(ls, "(for limit)");
+  new_localvarliteral(ls, "(for step)");
+  new_localvar(ls, str_checkname(ls));
   checknext(ls, '=');
   exp1(ls);  /* initial value */
   checknext(ls, ',');
@@ -1283,14 +1380,16 @@ static void forlist (LexState *ls) {
   int line;
   int base = fs->freereg;
   /* create control variables */
-  new_localvarliteral(ls, "(for generator)", nvars++);
-  new_localvarliteral(ls, "(for state)", nvars++);
-  new_localvarliteral(ls, "(for control)", nvars++);
+  new_localvarliteral(ls, "(for generator)");
+  new_localvarliteral(ls, "(for state)");
+  new_localvarliteral(ls, "(for control)");
+  nvars = 3;
   /* create declared variables */
   line = ls->linenumber;
   checknext(ls, '[');
   do {
-    new_localvar(ls, str_checkname(ls), nvars++);
+    new_localvar(ls, str_checkname(ls));
+    nvars++;
   } while (testnext(ls, ','));
   check_match(ls, ']', '[', line);
   line = ls->linenumber;
@@ -1369,11 +1468,15 @@ static void forexpr(LexState *ls, int line, expdesc *e) {
 
 static void localstat (LexState *ls) {
   /* stat -> LOCAL NAME {`,' NAME} [`=' explist1] */
+  FuncState *fs = ls->fs;
   int nvars = 0;
   int nexps;
+  int proto = -1;
+  int konst;
   expdesc e;
   do {
-    new_localvar(ls, str_checkname(ls), nvars++);
+    new_localvar(ls, str_checkname(ls));
+    nvars++;
   } while (testnext(ls, ','));
   if (testnext(ls, '='))
     nexps = explist1(ls, &e);
@@ -1381,8 +1484,20 @@ static void localstat (LexState *ls) {
     e.k = VVOID;
     nexps = 0;
   }
+  if (nvars == 1 && nexps == 1 && e.k == VRELOCABLE &&
+      GET_OPCODE(getcode(fs, &e)) == OP_CLOSURE)
+    proto = GETARG_Bx(getcode(fs, &e));  /* a function literal */
+  konst = (nvars == 1 && nexps == 1 &&
+           (e.k == VNIL || e.k == VTRUE || e.k == VFALSE || e.k == VK ||
+            e.k == VKNUM || e.k == VLOCAL || e.k == VRELOCABLE));
   adjust_assign(ls, nvars, nexps, &e);
   adjustlocalvars(ls, nvars);
+  fs->actvar[fs->nvars - 1].proto = proto;
+  if (konst && fs->nconsts < INLUAI_MAXCONSTS) {  /* may be a constant */
+    Varreg *c = &fs->consts[fs->nconsts++];
+    c->var = fs->actvar[fs->nvars - 1].idx;
+    c->reg = fs->actvar[fs->nvars - 1].reg;
+  }
   // clear unused temporaries
   ls->fs->freereg = ls->fs->nactvar;
 }
@@ -1550,3 +1665,158 @@ static void chunk (LexState *ls) {
 }
 
 /* }====================================================================== */
+
+
+/*
+** {======================================================================
+** Data chunks: a single literal value, that is, `~', `()' (true), `!()'
+** (false), a number, a string, or a constructor of literal values. The
+** value is built directly, with no code. Items of a constructor wait on
+** the stack (the key, or nil for list items, and the value) until its
+** `}', so its table is created with exactly their number of slots. All
+** that is built stays reachable from the stack, so there is no point in
+** collecting before the end.
+** =======================================================================
+*/
+
+
+static void datavalue (LexState *ls);
+
+
+/* stores list items `first'..`last' (stack pairs) from array index `n' */
+static int datalist (inlua_State *L, Table *t, StkId first, StkId last,
+                     int n) {
+  for (; first < last; first += 2) {
+    if (ttisnil(first)) {
+      setobj2t(L, luaH_setnum(L, t, ++n), first + 1);
+      luaC_barriert(L, t, first + 1);
+    }
+  }
+  return n;
+}
+
+
+static void datatable (LexState *ls) {
+  /* constructor -> `{' [ item { sep item } [sep] ] `}'
+     item -> `.' NAME `=' value | `.(' value `)=' value | value */
+  inlua_State *L = ls->L;
+  ptrdiff_t base = savestack(L, L->top);
+  int line = ls->linenumber;
+  int na = 0, nh = 0, n = 0, pending = 0;
+  StkId o, first;
+  Table *t;
+  enterlevel(ls);
+  checknext(ls, '{');
+  do {
+    if (ls->t.token == '}') break;
+    if (ls->t.token == '.') {  /* keyed item */
+      luaX_next(ls);
+      if (ls->t.token == TK_NAME) {
+        setsvalue2s(L, L->top, str_checkname(ls));
+        incr_top(L);
+      }
+      else {
+        checknext(ls, '(');
+        datavalue(ls);
+        check_condition(ls, !ttisnil(L->top - 1), "table index is nil");
+        checknext(ls, ')');
+      }
+      checknext(ls, '=');
+      nh++;
+    }
+    else {  /* list item */
+      setnilvalue(L->top);
+      incr_top(L);
+      na++;
+    }
+    datavalue(ls);
+  } while (testnext(ls, ',') || testnext(ls, ';'));
+  check_match(ls, '}', '{', line);
+  t = luaH_new(L, na, nh);
+  /* same order of stores as the code for a constructor: keyed items as
+     they come, list items in groups of LFIELDS_PER_FLUSH */
+  first = restorestack(L, base);
+  for (o = first; o < L->top; o += 2) {
+    if (!ttisnil(o)) {
+      setobj2t(L, luaH_set(L, t, o), o + 1);
+      luaC_barriert(L, t, o + 1);
+    }
+    else if (++pending == LFIELDS_PER_FLUSH) {
+      n = datalist(L, t, first, o + 2, n);
+      first = o + 2;
+      pending = 0;
+    }
+  }
+  datalist(L, t, first, L->top, n);
+  L->top = restorestack(L, base);
+  sethvalue(L, L->top, t);
+  incr_top(L);
+  leavelevel(ls);
+}
+
+
+static void datavalue (LexState *ls) {
+  inlua_State *L = ls->L;
+  switch (ls->t.token) {
+    case '~': {
+      setnilvalue(L->top);
+      break;
+    }
+    case '(': {  /* `()' */
+      luaX_next(ls);
+      check(ls, ')');
+      setbvalue(L->top, 1);
+      break;
+    }
+    case '!': {  /* `!()' */
+      luaX_next(ls);
+      checknext(ls, '(');
+      check(ls, ')');
+      setbvalue(L->top, 0);
+      break;
+    }
+    case '-': {
+      luaX_next(ls);
+      check(ls, TK_NUMBER);
+      setnvalue(L->top, inluai_numunm(ls->t.seminfo.r));
+      break;
+    }
+    case TK_NUMBER: {
+      setnvalue(L->top, ls->t.seminfo.r);
+      break;
+    }
+    case TK_STRING: {
+      setsvalue2s(L, L->top, ls->t.seminfo.ts);
+      break;
+    }
+    case '{': {
+      datatable(ls);
+      return;
+    }
+    default: {
+      luaX_syntaxerror(ls, "data value expected");
+    }
+  }
+  incr_top(L);
+  luaX_next(ls);
+}
+
+
+void luaY_data (inlua_State *L, ZIO *z, Mbuffer *buff, const char *name) {
+  /* data -> [`^^'] value [`;'] EOS */
+  struct LexState lexstate;
+  TString *source = luaS_new(L, name);
+  setsvalue2s(L, L->top, source);  /* anchor it */
+  incr_top(L);
+  lexstate.buff = buff;
+  luaX_setinput(L, &lexstate, z, source);
+  luaX_next(&lexstate);  /* read first token */
+  testnext(&lexstate, TK_RETURN);
+  datavalue(&lexstate);
+  testnext(&lexstate, ';');
+  check(&lexstate, TK_EOS);
+  setobjs2s(L, L->top - 2, L->top - 1);  /* replace the name by the value */
+  L->top--;
+}
+
+/* }====================================================================== */
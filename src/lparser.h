@@ -52,6 +52,31 @@ typedef struct upvaldesc {
 } upvaldesc;
 
 
+/* a declared variable */
+typedef struct Vardesc {
+  unsigned short idx;  /* index of the variable in `locvars' */
+  lu_byte reg;  /* its register (NO_REG until it is active) */
+  int proto;  /* index in `p' of the function it holds if it can be inlined,
+                 or -1 */
+} Vardesc;
+
+
+/* a call to a function that may be inlined */
+typedef struct Inlinesite {
+  int pc;  /* the OP_CALL */
+  int move;  /* the OP_MOVE that loads the function, or -1 */
+  int proto;  /* index in `p' of the function */
+  unsigned short var;  /* index in `locvars' of the variable called */
+} Inlinesite;
+
+
+/* a variable that may be a constant, or that a closure captures */
+typedef struct Varreg {
+  unsigned short var;  /* index of the variable in `locvars' */
+  lu_byte reg;  /* its register */
+} Varreg;
+
+
 struct BlockCnt;  /* defined in lparser.c */
 
 
@@ -70,14 +95,23 @@ typedef struct FuncState {
   int nk;  /* number of elements in `k' */
   int np;  /* number of elements in `p' */
   short nlocvars;  /* number of elements in `locvars' */
-  lu_byte nactvar;  /* number of active local variables */
+  lu_byte nactvar;  /* first register above active variables */
+  lu_byte nvars;  /* number of elements in `actvar' */
+  lu_byte nsites;  /* number of elements in `sites' */
+  lu_byte nconsts;  /* number of elements in `consts' */
+  lu_byte ncaptures;  /* number of elements in `captures' */
   upvaldesc upvalues[INLUAI_MAXUPVALUES];  /* upvalues */
-  unsigned short actvar[INLUAI_MAXVARS];  /* declared-variable stack */
+  Vardesc actvar[INLUAI_MAXVARS];  /* declared-variable stack */
+  Inlinesite sites[INLUAI_MAXINLINE];  /* calls that may be inlined */
+  Varreg consts[INLUAI_MAXCONSTS];  /* variables that may be constants */
+  Varreg captures[INLUAI_MAXCAPTURES];  /* variables closures capture */
 } FuncState;
 
 
 INLUAI_FUNC Proto *luaY_parser (inlua_State *L, ZIO *z, Mbuffer *buff,
                                             const char *name);
+INLUAI_FUNC void luaY_data (inlua_State *L, ZIO *z, Mbuffer *buff,
+                                        const char *name);
 
 
 #endif
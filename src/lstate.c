@@ -6,6 +6,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #define lstate_c
 #define INLUA_CORE
@@ -117,7 +118,9 @@ static void close_state (inlua_State *L) {
 
 
 inlua_State *luaE_newthread (inlua_State *L) {
-  inlua_State *L1 = tostate(luaM_malloc(L, state_size(inlua_State)));
+  inlua_State *L1;
+  luaM_tag(L, INLUA_TTHREAD);
+  L1 = tostate(luaM_malloc(L, state_size(inlua_State)));
   luaC_link(L, obj2gco(L1), INLUA_TTHREAD);
   preinit_state(L1, G(L));
   stack_init(L1, L);  /* init stack */
@@ -177,8 +180,22 @@ INLUA_API inlua_State *inlua_newstate (inlua_Alloc f, void *ud) {
   g->totalbytes = sizeof(LG);
   g->gcpause = INLUAI_GCPAUSE;
   g->gcstepmul = INLUAI_GCMUL;
+  g->gctarget = 0;
+  g->gcgrowth = INLUAI_GCGROWTH;
+  g->gcunitcost = 1e-9;
   g->gcdept = 0;
   for (i=0; i<NUM_TAGS; i++) g->mt[i] = NULL;
+  g->gctelemetry = 0;
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
+#if defined(INLUA_USE_STATS)
+  memset(&g->stats, 0, sizeof(g->stats));
+#endif
+#if defined(INLUA_USE_PARALLELGC)
+  g->helper = NULL;
+  g->gcusehelper = 1;
+  g->gcasyncfree = 0;
+  g->gcbatching = 0;
+#endif
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != 0) {
     /* memory allocation error: free partial state */
     close_state(L);
@@ -62,6 +62,35 @@ typedef struct CallInfo {
 #define isLua(ci)	(ttisfunction((ci)->func) && f_isLua(ci))
 
 
+#if defined(INLUA_USE_STATS)
+
+#include "lopcodes.h"
+
+/*
+** execution counters (see inlua_dumpstats)
+*/
+typedef struct Stats {
+  unsigned long opcodes[NUM_OPCODES];  /* instructions executed */
+  unsigned long gethit;  /* table reads that found a value */
+  unsigned long getmiss;  /* table reads that found nil and no `__index' */
+  unsigned long getmeta;  /* reads that went through `__index' */
+  unsigned long strhit;  /* luaS_newlstr calls that found the string */
+  unsigned long strnew;  /* luaS_newlstr calls that created it */
+  unsigned long alloc[LUA_TUPVAL+1];  /* bytes allocated by type */
+  int alloctag;  /* type of the next allocation, which resets it even when
+                    it fails (0 for `other': stacks, buffers, work areas of
+                    the compiler) */
+} Stats;
+
+#define luai_stat(L,c)	(G(L)->stats.c++)
+
+#else
+
+#define luai_stat(L,c)	((void)0)
+
+#endif
+
+
 /*
 ** `global state', shared by all threads of this state
 */
@@ -85,12 +114,26 @@ typedef struct global_State {
   lu_mem gcdept;  /* how much GC is `behind schedule' */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC `granularity' */
+  int gctarget;  /* target step time in microseconds (0: use `gcstepmul') */
+  int gcgrowth;  /* heap-growth budget of pause-target mode */
+  double gcunitcost;  /* measured seconds per unit of collector work */
   inlua_CFunction panic;  /* to be called in unprotected errors */
   TValue l_registry;
   struct inlua_State *mainthread;
   UpVal uvhead;  /* head of double-linked list of all open upvalues */
   struct Table *mt[NUM_TAGS];  /* metatables for basic types */
   TString *tmname[TM_N];  /* array with tag-method names */
+  lu_byte gctelemetry;  /* recording `gcstats'? */
+  inlua_GCStats gcstats;  /* times recorded by the collector */
+#if defined(INLUA_USE_STATS)
+  Stats stats;
+#endif
+#if defined(INLUA_USE_PARALLELGC)
+  struct GCHelper *helper;  /* freeing thread (started on first use) */
+  lu_byte gcusehelper;  /* may `helper' be started? */
+  lu_byte gcasyncfree;  /* may `helper' call `frealloc'? */
+  lu_byte gcbatching;  /* are frees going to `helper' (see luaC_batchfree)? */
+#endif
 } global_State;
 
 
@@ -12,6 +12,7 @@
 
 #include "inlua.h"
 
+#include "ldo.h"
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
@@ -25,6 +26,7 @@ void luaS_resize (inlua_State *L, int newsize) {
   int i;
   if (G(L)->gcstate == GCSsweepstring)
     return;  /* cannot resize during GC traverse */
+  luaM_tag(L, INLUA_TSTRING);
   newhash = luaM_newvector(L, newsize, GCObject *);
   tb = &G(L)->strt;
   for (i=0; i<newsize; i++) newhash[i] = NULL;
@@ -47,22 +49,24 @@ void luaS_resize (inlua_State *L, int newsize) {
 }
 
 
-static TString *newlstr (inlua_State *L, const char *str, size_t l,
-                                       unsigned int h) {
+static TString *newstr (inlua_State *L, size_t size, size_t l,
+                                      unsigned int h) {
   TString *ts;
-  stringtable *tb;
-  if (l+1 > (MAX_SIZET - sizeof(TString))/sizeof(char))
-    luaM_toobig(L);
-  ts = cast(TString *, luaM_malloc(L, (l+1)*sizeof(char)+sizeof(TString)));
+  luaM_tag(L, INLUA_TSTRING);
+  ts = cast(TString *, luaM_malloc(L, size+sizeof(TString)));
   ts->tsv.len = l;
   ts->tsv.hash = h;
   ts->tsv.marked = luaC_white(G(L));
   ts->tsv.tt = INLUA_TSTRING;
   ts->tsv.reserved = 0;
-  memcpy(ts+1, str, l*sizeof(char));
-  ((char *)(ts+1))[l] = '\0';  /* ending 0 */
-  tb = &G(L)->strt;
-  h = lmod(h, tb->size);
+  ts->tsv.external = 0;
+  return ts;
+}
+
+
+static TString *chainstr (inlua_State *L, TString *ts) {
+  stringtable *tb = &G(L)->strt;
+  int h = lmod(ts->tsv.hash, tb->size);
   ts->tsv.next = tb->hash[h];  /* chain new entry */
   tb->hash[h] = obj2gco(ts);
   tb->nuse++;
@@ -72,13 +76,31 @@ static TString *newlstr (inlua_State *L, const char *str, size_t l,
 }
 
 
-TString *luaS_newlstr (inlua_State *L, const char *str, size_t l) {
-  GCObject *o;
+static TString *newlstr (inlua_State *L, const char *str, size_t l,
+                                       unsigned int h) {
+  TString *ts;
+  if (l+1 > (MAX_SIZET - sizeof(TString))/sizeof(char))
+    luaM_toobig(L);
+  ts = newstr(L, (l+1)*sizeof(char), l, h);
+  memcpy(ts+1, str, l*sizeof(char));
+  ((char *)(ts+1))[l] = '\0';  /* ending 0 */
+  return chainstr(L, ts);
+}
+
+
+static unsigned int hashstr (const char *str, size_t l) {
   unsigned int h = cast(unsigned int, l);  /* seed */
   size_t step = (l>>5)+1;  /* if string is too long, don't hash all its chars */
   size_t l1;
   for (l1=l; l1>=step; l1-=step)  /* compute hash */
     h = h ^ ((h<<5)+(h>>2)+cast(unsigned char, str[l1-1]));
+  return h;
+}
+
+
+static TString *findstr (inlua_State *L, const char *str, size_t l,
+                                        unsigned int h) {
+  GCObject *o;
   for (o = G(L)->strt.hash[lmod(h, G(L)->strt.size)];
        o != NULL;
        o = o->gch.next) {
@@ -86,10 +108,67 @@ TString *luaS_newlstr (inlua_State *L, const char *str, size_t l) {
     if (ts->tsv.len == l && (memcmp(str, getstr(ts), l) == 0)) {
       /* string may be dead */
       if (isdead(G(L), o)) changewhite(o);
+      luai_stat(L, strhit);
       return ts;
     }
   }
-  return newlstr(L, str, l, h);  /* not found */
+  luai_stat(L, strnew);
+  return NULL;
+}
+
+
+TString *luaS_newlstr (inlua_State *L, const char *str, size_t l) {
+  unsigned int h = hashstr(str, l);
+  TString *ts = findstr(L, str, l, h);
+  return (ts != NULL) ? ts : newlstr(L, str, l, h);
+}
+
+
+struct NewExt {
+  TString *ts;
+  size_t l;
+  unsigned int h;
+};
+
+
+static void f_newext (inlua_State *L, void *ud) {
+  struct NewExt *n = cast(struct NewExt *, ud);
+  n->ts = newstr(L, sizeof(TExtern), n->l, n->h);
+}
+
+
+/*
+** Strings are interned, so an external string equal to an existing one is
+** not created: the existing string is returned and the buffer is released
+** at once. Otherwise the new string points to `str' (which must end with
+** a '\0' at str[l]) until the collector frees it. The buffer is released
+** also when the string cannot be created, before the error propagates.
+*/
+TString *luaS_newextstr (inlua_State *L, const char *str, size_t l,
+                         inlua_Release release, void *ud) {
+  struct NewExt n;
+  TString *ts;
+  TExtern *e;
+  int status;
+  n.l = l;
+  n.h = hashstr(str, l);
+  ts = findstr(L, str, l, n.h);
+  if (ts != NULL) {
+    if (release) release(ud, str, l);
+    return ts;
+  }
+  status = luaD_rawrunprotected(L, f_newext, &n);
+  if (status != 0) {
+    if (release) release(ud, str, l);
+    luaD_throw(L, status);
+  }
+  ts = n.ts;
+  ts->tsv.external = 1;
+  e = cast(TExtern *, ts+1);
+  e->data = str;
+  e->release = release;
+  e->ud = ud;
+  return chainstr(L, ts);
 }
 
 
@@ -97,9 +176,11 @@ Udata *luaS_newudata (inlua_State *L, size_t s, Table *e) {
   Udata *u;
   if (s > MAX_SIZET - sizeof(Udata))
     luaM_toobig(L);
+  luaM_tag(L, INLUA_TUSERDATA);
   u = cast(Udata *, luaM_malloc(L, s + sizeof(Udata)));
   u->uv.marked = luaC_white(G(L));  /* is not finalized */
   u->uv.tt = INLUA_TUSERDATA;
+  u->uv.array = 0;
   u->uv.len = s;
   u->uv.metatable = NULL;
   u->uv.env = e;
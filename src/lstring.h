@@ -13,7 +13,8 @@
 #include "lstate.h"
 
 
-#define sizestring(s)	(sizeof(union TString)+((s)->len+1)*sizeof(char))
+#define sizestring(s)	(sizeof(union TString)+((s)->external ? \
+			 sizeof(TExtern) : ((s)->len+1)*sizeof(char)))
 
 #define sizeudata(u)	(sizeof(union Udata)+(u)->len)
 
@@ -26,6 +27,8 @@
 INLUAI_FUNC void luaS_resize (inlua_State *L, int newsize);
 INLUAI_FUNC Udata *luaS_newudata (inlua_State *L, size_t s, Table *e);
 INLUAI_FUNC TString *luaS_newlstr (inlua_State *L, const char *str, size_t l);
+INLUAI_FUNC TString *luaS_newextstr (inlua_State *L, const char *str, size_t l,
+                                     inlua_Release release, void *ud);
 
 
 #endif
@@ -262,6 +262,7 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
 
 static void setarrayvector (inlua_State *L, Table *t, int size) {
   int i;
+  luaM_tag(L, INLUA_TTABLE);
   luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
   for (i=t->sizearray; i<size; i++)
      setnilvalue(&t->array[i]);
@@ -281,6 +282,7 @@ static void setnodevector (inlua_State *L, Table *t, int size) {
     if (lsize > MAXBITS)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
+    luaM_tag(L, INLUA_TTABLE);
     t->node = luaM_newvector(L, size, Node);
     for (i=0; i<size; i++) {
       Node *n = gnode(t, i);
@@ -311,6 +313,7 @@ static void resize (inlua_State *L, Table *t, int nasize, int nhsize) {
         setobjt2t(L, luaH_setnum(L, t, i+1), &t->array[i]);
     }
     /* shrink array */
+    luaM_tag(L, INLUA_TTABLE);
     luaM_reallocvector(L, t->array, oldasize, nasize, TValue);
   }
   /* re-insert elements from hash part */
@@ -356,7 +359,9 @@ static void rehash (inlua_State *L, Table *t, const TValue *ek) {
 
 
 Table *luaH_new (inlua_State *L, int narray, int nhash) {
-  Table *t = luaM_new(L, Table);
+  Table *t;
+  luaM_tag(L, INLUA_TTABLE);
+  t = luaM_new(L, Table);
   luaC_link(L, obj2gco(t), INLUA_TTABLE);
   t->metatable = NULL;
   t->flags = cast_byte(~0);
@@ -576,6 +581,9 @@ int luaH_getn (Table *t) {
 }
 
 
+int luaH_isdummy (Node *n) { return n == dummynode; }
+
+
 
 #if defined(LUA_DEBUG)
 
@@ -583,6 +591,4 @@ Node *luaH_mainposition (const Table *t, const TValue *key) {
   return mainposition(t, key);
 }
 
-int luaH_isdummy (Node *n) { return n == dummynode; }
-
 #endif
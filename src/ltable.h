@@ -29,11 +29,11 @@ INLUAI_FUNC void luaH_resizearray (inlua_State *L, Table *t, int nasize);
 INLUAI_FUNC void luaH_free (inlua_State *L, Table *t);
 INLUAI_FUNC int luaH_next (inlua_State *L, Table *t, StkId key);
 INLUAI_FUNC int luaH_getn (Table *t);
+INLUAI_FUNC int luaH_isdummy (Node *n);
 
 
 #if defined(LUA_DEBUG)
 INLUAI_FUNC Node *luaH_mainposition (const Table *t, const TValue *key);
-INLUAI_FUNC int luaH_isdummy (Node *n);
 #endif
 
 
@@ -174,41 +174,169 @@ static int incomplete (inlua_State *L, int status) {
 }
 
 
-static int pushline (inlua_State *L, int firstline) {
+/*
+** The lines of a statement typed in interactive mode are given to the
+** parser as they come. While the lines so far leave a bracket, a string
+** or a long comment open, the statement cannot be complete, so the reader
+** waits for the next line instead of ending the chunk, and the parser
+** goes on from where it stopped. Only a statement left open otherwise
+** (as in `x = 1 +') is parsed again from its first line. The newline
+** that ends the lines so far is given before waiting, so that the lexer
+** can finish a token without reading a line that a syntax error in the
+** statement would then throw away.
+*/
+typedef struct Input {
+  char *text;  /* the lines read, joined by newlines */
+  size_t len, size;
+  size_t given;  /* bytes of `text' given to the parser */
+  const char *prompt2;
+  int depth;  /* brackets left open */
+  int level;  /* level of an open long string or comment, or -1 */
+  int quote;  /* delimiter of an open string, or 0 */
+  int newline;  /* newline before the next line already given? */
+  int eof;  /* no more input? */
+} Input;
+
+
+/* length of a long bracket `[==[' (or `]==]') at `s', or 0 */
+static size_t longbracket (const char *s, int *level) {
+  size_t n = 1;
+  while (s[n] == '=') n++;
+  if (s[n] != s[0]) return 0;
+  *level = (int)n - 1;
+  return n + 1;
+}
+
+
+/* follow brackets, strings and comments along line `s' */
+static void scanline (Input *in, const char *s) {
+  int level;
+  size_t n;
+  while (*s) {
+    if (in->level >= 0) {  /* in a long string or comment */
+      if (*s == ']' && (n = longbracket(s, &level)) > 0 && level == in->level) {
+        in->level = -1;
+        s += n;
+      }
+      else s++;
+    }
+    else if (in->quote) {
+      if (*s == '\\' && s[1] == '\0') return;  /* string goes on */
+      if (*s == '\\') s++;
+      else if (*s == in->quote) in->quote = 0;
+      s++;
+    }
+    else switch (*s) {
+      case '-': {
+        if (s[1] != '-') { s++; break; }
+        if (s[2] == '[' && (n = longbracket(s + 2, &in->level)) > 0) {
+          s += 2 + n;  /* long comment */
+          break;
+        }
+        return;  /* short comment */
+      }
+      case '[': {
+        if ((n = longbracket(s, &in->level)) > 0) s += n;
+        else { in->depth++; s++; }
+        break;
+      }
+      case '(': case '{': in->depth++; s++; break;
+      case ')': case ']': case '}': in->depth--; s++; break;
+      case '"': case '\'': in->quote = *s++; break;
+      default: s++; break;
+    }
+  }
+  in->quote = 0;  /* a string cannot go on to the next line */
+}
+
+
+static int addline (inlua_State *L, Input *in, int firstline) {
   char buffer[INLUA_MAXINPUT];
   char *b = buffer;
   size_t l;
-  const char *prmt = get_prompt(L, firstline);
-  if (inlua_readline(L, b, prmt) == 0)
+  const char *prmt = firstline ? get_prompt(L, 1) : in->prompt2;
+  if (in->eof || inlua_readline(L, b, prmt) == 0) {
+    in->eof = 1;
     return 0;  /* no input */
+  }
   l = strlen(b);
   if (l > 0 && b[l-1] == '\n')  /* line ends with newline? */
-    b[l-1] = '\0';  /* remove it */
-  if (firstline && b[0] == '=')  /* first line starts with `=' ? */
-    inlua_pushfstring(L, "^^ %s", b+1);  /* change it to `return' */
-  else
-    inlua_pushstring(L, b);
+    b[--l] = '\0';  /* remove it */
+  if (in->len + l + 4 > in->size) {
+    size_t size = 2 * in->size + l + 4;
+    char *text = (char *)realloc(in->text, size);
+    if (text == NULL) {
+      l_message(progname, "not enough memory for input");
+      in->eof = 1;
+      inlua_freeline(L, b);
+      return 0;
+    }
+    in->text = text;
+    in->size = size;
+  }
+  if (!firstline)
+    in->text[in->len++] = '\n';
+  if (firstline && b[0] == '=') {  /* first line starts with `=' ? */
+    memcpy(in->text, "^^ ", 3);  /* change it to `return' */
+    memcpy(in->text + 3, b + 1, l - 1);
+    in->len = l + 2;
+  }
+  else {
+    memcpy(in->text + in->len, b, l);
+    in->len += l;
+  }
+  in->text[in->len] = '\0';
   inlua_freeline(L, b);
+  scanline(in, in->text + in->len - l);
   return 1;
 }
 
 
+static const char *getinput (inlua_State *L, void *ud, size_t *size) {
+  Input *in = (Input *)ud;
+  if (in->given == in->len &&
+      (in->depth > 0 || in->level >= 0 || in->quote)) {  /* still open? */
+    if (!in->newline) {  /* end the lines so far first */
+      in->newline = 1;
+      *size = 1;
+      return "\n";
+    }
+    if (addline(L, in, 0))
+      in->given++;  /* its newline was given */
+    in->newline = 0;
+  }
+  *size = in->len - in->given;
+  in->given = in->len;
+  return in->text + in->len - *size;
+}
+
+
 static int loadline (inlua_State *L) {
+  Input in;
   int status;
   inlua_settop(L, 0);
-  if (!pushline(L, 1))
-    return -1;  /* no input */
-  for (;;) {  /* repeat until gets a complete line */
-    status = inluaL_loadbuffer(L, inlua_tostring(L, 1), inlua_strlen(L, 1), "=stdin");
+  in.text = NULL;
+  in.len = in.size = in.given = 0;
+  in.prompt2 = get_prompt(L, 0);
+  in.depth = in.quote = in.newline = in.eof = 0;
+  in.level = -1;
+  if (!addline(L, &in, 1))
+    status = -1;  /* no input */
+  else for (;;) {  /* repeat until gets a complete statement */
+    status = inlua_load(L, getinput, &in, "=stdin");
     if (!incomplete(L, status)) break;  /* cannot try to add lines? */
-    if (!pushline(L, 0))  /* no more input? */
-      return -1;
-    inlua_pushliteral(L, "\n");  /* add a new line... */
-    inlua_insert(L, -2);  /* ...between the two lines */
-    inlua_concat(L, 3);  /* join them */
+    if (!addline(L, &in, 0)) {  /* no more input? */
+      status = -1;
+      break;
+    }
+    in.given = in.newline = 0;  /* parse it again with the new line */
+  }
+  if (status != -1) {
+    inlua_pushlstring(L, in.text, in.len);
+    inlua_saveline(L, -1);
+    inlua_pop(L, 1);  /* remove line */
   }
-  inlua_saveline(L, 1);
-  inlua_remove(L, 1);  /* remove line */
+  free(in.text);
   return status;
 }
 
@@ -374,6 +502,28 @@ static int pmain (inlua_State *L) {
 }
 
 
+#if defined(INLUA_USE_STATS)
+static int writestats (inlua_State *L, const void *p, size_t size, void *f) {
+  (void)L;
+  return (fwrite(p, size, 1, (FILE *)f) != 1) && (size != 0);
+}
+
+
+static void dumpstats (inlua_State *L) {
+  const char *name = getenv("INLUA_STATS");
+  FILE *f;
+  if (name == NULL) return;
+  f = (strcmp(name, "-") == 0) ? stderr : fopen(name, "w");
+  if (f == NULL) {
+    l_message(progname, "cannot open statistics file");
+    return;
+  }
+  inlua_dumpstats(L, writestats, f);
+  if (f != stderr) fclose(f);
+}
+#endif
+
+
 int main (int argc, char **argv) {
   int status;
   struct Smain s;
@@ -386,6 +536,9 @@ int main (int argc, char **argv) {
   s.argv = argv;
   status = inlua_cpcall(L, &pmain, &s);
   report(L, status);
+#if defined(INLUA_USE_STATS)
+  dumpstats(L);
+#endif
   inlua_close(L);
   return (status || s.status) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
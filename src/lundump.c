@@ -90,6 +90,7 @@ static TString* LoadString(LoadState* S)
 static void LoadCode(LoadState* S, Proto* f)
 {
  int n=LoadInt(S);
+ luaM_tag(S->L,LUA_TPROTO);
  f->code=luaM_newvector(S->L,n,Instruction);
  f->sizecode=n;
  LoadVector(S,f->code,n,sizeof(Instruction));
@@ -101,6 +102,7 @@ static void LoadConstants(LoadState* S, Proto* f)
 {
  int i,n;
  n=LoadInt(S);
+ luaM_tag(S->L,LUA_TPROTO);
  f->k=luaM_newvector(S->L,n,TValue);
  f->sizek=n;
  for (i=0; i<n; i++) setnilvalue(&f->k[i]);
@@ -128,6 +130,7 @@ static void LoadConstants(LoadState* S, Proto* f)
   }
  }
  n=LoadInt(S);
+ luaM_tag(S->L,LUA_TPROTO);
  f->p=luaM_newvector(S->L,n,Proto*);
  f->sizep=n;
  for (i=0; i<n; i++) f->p[i]=NULL;
@@ -138,10 +141,12 @@ static void LoadDebug(LoadState* S, Proto* f)
 {
  int i,n;
  n=LoadInt(S);
+ luaM_tag(S->L,LUA_TPROTO);
  f->lineinfo=luaM_newvector(S->L,n,int);
  f->sizelineinfo=n;
  LoadVector(S,f->lineinfo,n,sizeof(int));
  n=LoadInt(S);
+ luaM_tag(S->L,LUA_TPROTO);
  f->locvars=luaM_newvector(S->L,n,LocVar);
  f->sizelocvars=n;
  for (i=0; i<n; i++) f->locvars[i].varname=NULL;
@@ -152,10 +157,26 @@ static void LoadDebug(LoadState* S, Proto* f)
   f->locvars[i].endpc=LoadInt(S);
  }
  n=LoadInt(S);
+ luaM_tag(S->L,LUA_TPROTO);
  f->upvalues=luaM_newvector(S->L,n,TString*);
  f->sizeupvalues=n;
  for (i=0; i<n; i++) f->upvalues[i]=NULL;
  for (i=0; i<n; i++) f->upvalues[i]=LoadString(S);
+ n=LoadInt(S);
+ luaM_tag(S->L,LUA_TPROTO);
+ f->inlined=luaM_newvector(S->L,n,InlineCall);
+ f->sizeinlined=n;
+ for (i=0; i<n; i++)
+ {
+  InlineCall* ic=&f->inlined[i];
+  ic->startpc=LoadInt(S);
+  ic->endpc=LoadInt(S);
+  ic->line=LoadInt(S);
+  ic->func=LoadInt(S);
+  ic->closure=LoadInt(S);
+  ic->firstvar=LoadInt(S);
+  ic->nvars=LoadInt(S);
+ }
 }
 
 static Proto* LoadFunction(LoadState* S, TString* p)
@@ -175,6 +196,7 @@ static Proto* LoadFunction(LoadState* S, TString* p)
  LoadConstants(S,f);
  LoadDebug(S,f);
  IF (!luaG_checkcode(f), "bad code");
+ luaF_initswitches(S->L,f);
  S->L->top--;
  S->L->nCcalls--;
  return f;
@@ -14,10 +14,12 @@
 
 #include "inlua.h"
 
+#include "larray.h"
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "ljit.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -57,16 +59,29 @@ int luaV_tostring (inlua_State *L, StkId obj) {
 }
 
 
+/*
+** hooks before the instruction at `pc' - 1; leaving and entering the copy
+** of an inlined call count as a return and a call
+*/
 static void traceexec (inlua_State *L, const Instruction *pc) {
   lu_byte mask = L->hookmask;
   const Instruction *oldpc = L->savedpc;
+  Proto *p = ci_func(L->ci)->l.p;
+  const InlineCall *from = NULL, *to = NULL;
+  if ((mask & (INLUA_MASKCALL | INLUA_MASKRET)) && p->sizeinlined > 0) {
+    from = luaF_getinlined(p, pcRel(oldpc, p));
+    to = luaF_getinlined(p, pcRel(pc, p));
+    if (from != to && from != NULL && (mask & INLUA_MASKRET))
+      luaD_callhook(L, INLUA_HOOKRET, -1);  /* still at the old `pc' */
+  }
   L->savedpc = pc;
   if ((mask & INLUA_MASKCOUNT) && L->hookcount == 0) {
     resethookcount(L);
     luaD_callhook(L, INLUA_HOOKCOUNT, -1);
   }
+  if (from != to && to != NULL && (mask & INLUA_MASKCALL))
+    luaD_callhook(L, INLUA_HOOKCALL, -1);
   if (mask & INLUA_MASKLINE) {
-    Proto *p = ci_func(L->ci)->l.p;
     int npc = pcRel(pc, p);
     int newline = lgetline(p, npc);
     /* call linehook when enter a new function, when jump back (loop),
@@ -77,6 +92,29 @@ static void traceexec (inlua_State *L, const Instruction *pc) {
 }
 
 
+#if defined(INLUA_USE_OPTRACE)
+
+static FILE *optrace = NULL;
+static int optracing = -1;  /* -1: not checked yet; 0: off; 1: on */
+
+static void traceop (Instruction i) {
+  if (optracing < 0) {
+    const char *fname = getenv("INLUA_OPTRACE");
+    optrace = (fname != NULL) ? fopen(fname, "wb") : NULL;
+    optracing = (optrace != NULL);
+  }
+  if (optracing)
+    putc(cast(int, GET_OPCODE(i)), optrace);
+}
+
+#else
+#define traceop(i)	((void)0)
+#endif
+
+/* trace and count an executed instruction, also one run fused with another */
+#define countop(L,i)	{ traceop(i); luai_stat(L, opcodes[GET_OPCODE(i)]); }
+
+
 static void callTMres (inlua_State *L, StkId res, const TValue *f,
                         const TValue *p1, const TValue *p2) {
   ptrdiff_t result = savestack(L, res);
@@ -114,13 +152,18 @@ void luaV_gettable (inlua_State *L, const TValue *t, TValue *key, StkId val) {
       const TValue *res = luaH_get(h, key); /* do a primitive get */
       if (!ttisnil(res) ||  /* result is no nil? */
           (tm = fasttm(L, h->metatable, TM_INDEX)) == NULL) { /* or no TM? */
+        if (ttisnil(res)) luai_stat(L, getmiss);
+        else luai_stat(L, gethit);
         setobj2s(L, val, res);
         return;
       }
       /* else will try the tag method */
     }
+    else if (isarray(t) && luaA_get(rawuvalue(t), key, val))
+      return;
     else if (ttisnil(tm = luaT_gettmbyobj(L, t, TM_INDEX)))
       luaG_typeerror(L, t, "index");
+    luai_stat(L, getmeta);
     if (ttisfunction(tm)) {
       callTMres(L, val, tm, t, key);
       return;
@@ -148,6 +191,8 @@ void luaV_settable (inlua_State *L, const TValue *t, TValue *key, StkId val) {
       }
       /* else will try the tag method */
     }
+    else if (isarray(t) && luaA_set(L, rawuvalue(t), key, val))
+      return;
     else if (ttisnil(tm = luaT_gettmbyobj(L, t, TM_NEWINDEX)))
       luaG_typeerror(L, t, "index");
     if (ttisfunction(tm)) {
@@ -236,7 +281,7 @@ int luaV_lessthan (inlua_State *L, const TValue *l, const TValue *r) {
 }
 
 
-static int lessequal (inlua_State *L, const TValue *l, const TValue *r) {
+int luaV_lessequal (inlua_State *L, const TValue *l, const TValue *r) {
   int res;
   if (ttype(l) != ttype(r))
     return luaG_ordererror(L, l, r);
@@ -314,8 +359,8 @@ void luaV_concat (inlua_State *L, int total, int last) {
 }
 
 
-static void Arith (inlua_State *L, StkId ra, const TValue *rb,
-                   const TValue *rc, TMS op) {
+void luaV_arith (inlua_State *L, StkId ra, const TValue *rb,
+                 const TValue *rc, TMS op) {
   TValue tempb, tempc;
   const TValue *b, *c;
   if ((b = luaV_tonumber(rb, &tempb)) != NULL &&
@@ -369,35 +414,106 @@ static void Arith (inlua_State *L, StkId ra, const TValue *rb,
           setnvalue(ra, op(nb, nc)); \
         } \
         else \
-          Protect(Arith(L, ra, rb, rc, tm)); \
+          Protect(luaV_arith(L, ra, rb, rc, tm)); \
       }
 
 
 
+/*
+** the instruction after a superinstruction must be dispatched on its own
+** when hooks that see each instruction are active
+*/
+#define nofuse(L)	((L)->hookmask & tracedhooks(cl->p))
+
+
+/*
+** count a taken loop back edge (the instruction at `e'), creating the
+** counters on the first one; with the JIT, a
+** hot loop gets its function compiled and goes on in machine code from
+** the jump target, already in `pc'
+*/
+#if defined(INLUA_USE_JIT)
+#define backedge(L,e) { \
+        if (cl->p->loopcount == NULL) Protect(luaF_initcounts(L, cl->p)); \
+        if (++cl->p->loopcount[(e) - cl->p->code] == INLUAI_JITHOTLOOP && \
+            !nofuse(L)) { \
+          Protect(luaJ_compile(L, cl->p)); \
+          if (cl->p->jit != NULL) goto jitentry; \
+        } \
+      }
+#else
+#define backedge(L,e) { \
+        if (cl->p->loopcount == NULL) Protect(luaF_initcounts(L, cl->p)); \
+        cl->p->loopcount[(e) - cl->p->code]++; \
+      }
+#endif
+
+
+/* the OP_FORLOOP that follows a superinstruction */
+#define fusedforloop(L,pc) { \
+        const Instruction fl = *(pc)++; \
+        StkId rf = RA(fl); \
+        inlua_Number step = nvalue(rf+2); \
+        inlua_Number idx = inluai_numadd(nvalue(rf), step); \
+        inlua_Number limit = nvalue(rf+1); \
+        inlua_assert(GET_OPCODE(fl) == OP_FORLOOP); \
+        countop(L, fl); \
+        if (inluai_numlt(0, step) ? inluai_numle(idx, limit) \
+                                : inluai_numle(limit, idx)) { \
+          dojump(L, pc, GETARG_sBx(fl)); \
+          setnvalue(rf, idx); \
+          setnvalue(rf+3, idx); \
+          backedge(L, (pc) - 1 - GETARG_sBx(fl)); \
+        } \
+      }
+
+
 void luaV_execute (inlua_State *L, int nexeccalls) {
   LClosure *cl;
   StkId base;
   TValue *k;
   const Instruction *pc;
+#if defined(INLUA_USE_JIT)
+  int jitstep;  /* instructions left to interpret before re-entering */
+#endif
  reentry:  /* entry point */
   inlua_assert(isLua(L->ci));
   pc = L->savedpc;
   cl = &clvalue(L->ci->func)->l;
   base = L->base;
   k = cl->p->k;
+#if defined(INLUA_USE_JIT)
+  jitstep = 0;
+ jitentry:
+  if (cl->p->jit != NULL && !nofuse(L)) {
+    pc = luaJ_execute(L, pc);  /* run machine code up to an exit */
+    base = L->base;
+    jitstep = 2;  /* interpret the exit instruction, then go back */
+  }
+#endif
   /* main loop of interpreter */
   for (;;) {
     const Instruction i = *pc++;
     StkId ra;
-    if ((L->hookmask & (INLUA_MASKLINE | INLUA_MASKCOUNT)) &&
-        (--L->hookcount == 0 || L->hookmask & INLUA_MASKLINE)) {
-      traceexec(L, pc);
-      if (L->status == INLUA_YIELD) {  /* did hook yield? */
-        L->savedpc = pc - 1;
-        return;
+#if defined(INLUA_USE_JIT)
+    if (jitstep && --jitstep == 0) {
+      pc--;
+      goto jitentry;
+    }
+#endif
+    if (L->hookmask) {
+      int mask = L->hookmask & tracedhooks(cl->p);
+      if (((mask & INLUA_MASKCOUNT) && --L->hookcount == 0) ||
+          (mask & ~INLUA_MASKCOUNT)) {
+        traceexec(L, pc);
+        if (L->status == INLUA_YIELD) {  /* did hook yield? */
+          L->savedpc = pc - 1;
+          return;
+        }
+        base = L->base;
       }
-      base = L->base;
     }
+    countop(L, i);
     /* warning!! several calls may realloc the stack and invalidate `ra' */
     ra = RA(i);
     inlua_assert(base == L->base && L->base == L->ci->base);
@@ -502,7 +618,7 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
           setnvalue(ra, inluai_numunm(nb));
         }
         else {
-          Protect(Arith(L, ra, rb, rb, TM_UNM));
+          Protect(luaV_arith(L, ra, rb, rb, TM_UNM));
         }
         continue;
       }
@@ -522,6 +638,12 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
             setnvalue(ra, cast_num(tsvalue(rb)->len));
             break;
           }
+          case INLUA_TUSERDATA: {
+            if (uvalue(rb)->array) {
+              setnvalue(ra, cast_num(arraylen(rawuvalue(rb))));
+              break;
+            }
+          }  /* FALLTHROUGH */
           default: {  /* try metamethod */
             Protect(
               if (!call_binTM(L, rb, luaO_nilobject, ra, TM_LEN))
@@ -540,6 +662,8 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
       }
       case OP_JMP: {
         dojump(L, pc, GETARG_sBx(i));
+        if (GETARG_sBx(i) < 0)
+          backedge(L, pc - 1 - GETARG_sBx(i));
         continue;
       }
       case OP_EQ: {
@@ -562,7 +686,7 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
       }
       case OP_LE: {
         Protect(
-          if (lessequal(L, RKB(i), RKC(i)) == GETARG_A(i))
+          if (luaV_lessequal(L, RKB(i), RKC(i)) == GETARG_A(i))
             dojump(L, pc, GETARG_sBx(*pc));
         )
         pc++;
@@ -660,6 +784,7 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
           dojump(L, pc, GETARG_sBx(i));  /* jump back */
           setnvalue(ra, idx);  /* update internal index... */
           setnvalue(ra+3, idx);  /* ...and external index */
+          backedge(L, pc - 1 - GETARG_sBx(i));
         }
         continue;
       }
@@ -688,8 +813,12 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
         L->top = L->ci->top;
         cb = RA(i) + 3;  /* previous call may change the stack */
         if (!ttisnil(cb)) {  /* continue loop? */
+          const Instruction *e = pc - 1;
           setobjs2s(L, cb-1, cb);  /* save control variable */
           dojump(L, pc, GETARG_sBx(*pc));  /* jump back */
+          pc++;
+          backedge(L, e);
+          continue;
         }
         pc++;
         continue;
@@ -723,17 +852,28 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
       case OP_CLOSURE: {
         Proto *p;
         Closure *ncl;
+        UpVal *copy;
         int nup, j;
         p = cl->p->p[GETARG_Bx(i)];
         nup = p->nups;
-        ncl = luaF_newLclosure(L, nup, cl->env);
+        ncl = luaF_newLclosure(L, nup, luaF_ncopies(cl, pc, nup), cl->env);
         ncl->l.p = p;
+        copy = getcopies(&ncl->l);
         for (j=0; j<nup; j++, pc++) {
-          if (GET_OPCODE(*pc) == OP_GETUPVAL)
-            ncl->l.upvals[j] = cl->upvals[GETARG_B(*pc)];
+          const TValue *v = NULL;  /* value to copy in */
+          if (GET_OPCODE(*pc) == OP_GETUPVAL) {
+            UpVal *uv = cl->upvals[GETARG_B(*pc)];
+            if (iscopy(cl, uv)) v = uv->v;
+            else ncl->l.upvals[j] = uv;
+          }
           else {
             inlua_assert(GET_OPCODE(*pc) == OP_MOVE);
-            ncl->l.upvals[j] = luaF_findupval(L, base + GETARG_B(*pc));
+            if (GETARG_A(*pc)) v = base + GETARG_B(*pc);
+            else ncl->l.upvals[j] = luaF_findupval(L, base + GETARG_B(*pc));
+          }
+          if (v) {
+            setobj(L, copy->v, v);
+            ncl->l.upvals[j] = copy++;
           }
         }
         setclvalue(L, ra, ncl);
@@ -761,6 +901,71 @@ void luaV_execute (inlua_State *L, int nexeccalls) {
         }
         continue;
       }
+      case OP_GETTABLEOP: {
+        Instruction ni;
+        TValue *rb, *rc;
+        Protect(luaV_gettable(L, RB(i), RKC(i), ra));
+        ni = *pc;
+        if (nofuse(L)) continue;
+        rb = RKB(ni);
+        rc = RKC(ni);
+        if (ttisnumber(rb) && ttisnumber(rc)) {
+          inlua_Number nb = nvalue(rb), nc = nvalue(rc);
+          pc++;
+          countop(L, ni);
+          switch (GET_OPCODE(ni)) {
+            case OP_ADD: setnvalue(RA(ni), inluai_numadd(nb, nc)); break;
+            case OP_SUB: setnvalue(RA(ni), inluai_numsub(nb, nc)); break;
+            case OP_MUL: setnvalue(RA(ni), inluai_nummul(nb, nc)); break;
+            case OP_DIV: setnvalue(RA(ni), inluai_numdiv(nb, nc)); break;
+            case OP_LT: {
+              if (inluai_numlt(nb, nc) == GETARG_A(ni))
+                dojump(L, pc, GETARG_sBx(*pc));
+              pc++;
+              break;
+            }
+            case OP_LE: {
+              if (inluai_numle(nb, nc) == GETARG_A(ni))
+                dojump(L, pc, GETARG_sBx(*pc));
+              pc++;
+              break;
+            }
+            case OP_ADDLOOP: {
+              setnvalue(RA(ni), inluai_numadd(nb, nc));
+              fusedforloop(L, pc);
+              break;
+            }
+            default: inlua_assert(0); pc--; break;
+          }
+        }
+        continue;  /* else next instruction takes the slow path on its own */
+      }
+      case OP_ADDLOOP: {
+        arith_op(inluai_numadd, TM_ADD);
+        if (nofuse(L)) continue;
+        fusedforloop(L, pc);
+        continue;
+      }
+      case OP_SETTABLELOOP: {
+        Protect(luaV_settable(L, ra, RKB(i), RKC(i)));
+        if (nofuse(L)) continue;
+        fusedforloop(L, pc);
+        continue;
+      }
+      case OP_SWITCH: {
+        Table *t = cl->p->switches[GETARG_C(i)];
+        const TValue *dest = luaO_nilobject;
+        if (nofuse(L)) continue;  /* run the tests one by one */
+        if (ttisnumber(ra) || ttisstring(ra))
+          dest = luaH_get(t, ra);
+        if (ttisnil(dest)) {  /* no arm for it: go where the chain ends */
+          TValue key;
+          setbvalue(&key, 1);
+          dest = luaH_get(t, &key);
+        }
+        pc = cl->p->code + cast_int(nvalue(dest));
+        continue;
+      }
     }
   }
 }
@@ -23,6 +23,7 @@
 
 
 INLUAI_FUNC int luaV_lessthan (inlua_State *L, const TValue *l, const TValue *r);
+INLUAI_FUNC int luaV_lessequal (inlua_State *L, const TValue *l, const TValue *r);
 INLUAI_FUNC int luaV_equalval (inlua_State *L, const TValue *t1, const TValue *t2);
 INLUAI_FUNC const TValue *luaV_tonumber (const TValue *obj, TValue *n);
 INLUAI_FUNC int luaV_tostring (inlua_State *L, StkId obj);
@@ -32,5 +33,7 @@ INLUAI_FUNC void luaV_settable (inlua_State *L, const TValue *t, TValue *key,
                                             StkId val);
 INLUAI_FUNC void luaV_execute (inlua_State *L, int nexeccalls);
 INLUAI_FUNC void luaV_concat (inlua_State *L, int total, int last);
+INLUAI_FUNC void luaV_arith (inlua_State *L, StkId ra, const TValue *rb,
+                             const TValue *rc, TMS op);
 
 #endif
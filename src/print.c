@@ -107,6 +107,9 @@ static void PrintCode(const Proto* f)
    case OP_LOADK:
     printf("\t; "); PrintConstant(f,bx);
     break;
+   case OP_SWITCH:
+    printf("\t; %d tests",b);
+    break;
    case OP_GETUPVAL:
    case OP_SETUPVAL:
     printf("\t; %s", (f->sizeupvalues>0) ? getstr(f->upvalues[b]) : "-");
@@ -116,11 +119,14 @@ static void PrintCode(const Proto* f)
     printf("\t; %s",svalue(&f->k[bx]));
     break;
    case OP_GETTABLE:
+   case OP_GETTABLEOP:
    case OP_SELF:
     if (ISK(c)) { printf("\t; "); PrintConstant(f,INDEXK(c)); }
     break;
    case OP_SETTABLE:
+   case OP_SETTABLELOOP:
    case OP_ADD:
+   case OP_ADDLOOP:
    case OP_SUB:
    case OP_MUL:
    case OP_DIV: